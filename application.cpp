@@ -1,11 +1,18 @@
 #include "application.hpp"
+#include "counter_rng.hpp"
 #include "model_ubo.hpp"
+#include "particle_initializer.hpp"
+#include "profiler.hpp"
 #include "utils.hpp"
-#include "tiny_obj_loader.h"
-#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
 
 Application::Application(int initial_width, int initial_height, std::vector<std::string> arguments)
 	: PV227Application(initial_width, initial_height, arguments) {
+	Profiler::get().set_thread_name("Main");
 	
 	// Debug Memory Size
 	GLint size;
@@ -14,6 +21,13 @@ Application::Application(int initial_width, int initial_height, std::vector<std:
 	std::cout << "Size of Particle: " << sizeof(Particle) << " bytes." << std::endl;
 	std::cout << "Alignment of Particle: " << alignof(Particle) << " bytes." << std::endl;
 	
+	// The seed must be known before the scene is prepared.
+	for (size_t i = 0; i + 1 < arguments.size(); i++) {
+		if (arguments[i] == "--seed") {
+			random_seed = static_cast<uint32_t>(std::stoul(arguments[i + 1]));
+		}
+	}
+
 	Application::compile_shaders();
 	prepare_cameras();
 	prepare_materials();
@@ -21,98 +35,76 @@ Application::Application(int initial_width, int initial_height, std::vector<std:
 	prepare_lights();
 	prepare_scene();
 	prepare_framebuffers();
+
+	// Restores the checkpoint given in the arguments instead of the generated particles, or starts the benchmark.
+	for (size_t i = 0; i + 1 < arguments.size(); i++) {
+		if (arguments[i] == "--restore") {
+			checkpoint_path = arguments[i + 1];
+			restore_checkpoint();
+		}
+		else if (arguments[i] == "--benchmark") {
+			benchmark_path = arguments[i + 1];
+			start_benchmark();
+		}
+	}
 }
 
 Application::~Application() {}
 
 // Shaders
 void Application::compile_shaders() {
-	default_unlit_program = ShaderProgram(lecture_shaders_path / "object.vert", lecture_shaders_path / "unlit.frag");
-	default_lit_program = ShaderProgram(lecture_shaders_path / "object.vert", lecture_shaders_path / "lit.frag");
-
-	pulsating_particle_program = ShaderProgram();
-	pulsating_particle_program.add_vertex_shader(lecture_shaders_path / "pulsating_particle.vert");
-	pulsating_particle_program.add_fragment_shader(lecture_shaders_path / "pulsating_particle.frag");
-	pulsating_particle_program.add_geometry_shader(lecture_shaders_path / "pulsating_particle.geom");
-	pulsating_particle_program.link();
-
-	attracting_particle_program = ShaderProgram();
-	attracting_particle_program.add_vertex_shader(lecture_shaders_path / "attracting_particle.vert");
-	attracting_particle_program.add_fragment_shader(lecture_shaders_path / "attracting_particle.frag");
-	attracting_particle_program.add_geometry_shader(lecture_shaders_path / "attracting_particle.geom");
-	attracting_particle_program.link();
-
-	multi_attracting_particle_program = ShaderProgram();
-	multi_attracting_particle_program.add_vertex_shader(lecture_shaders_path / "multi_attracting_particle.vert");
-	multi_attracting_particle_program.add_fragment_shader(lecture_shaders_path / "multi_attracting_particle.frag");
-	multi_attracting_particle_program.add_geometry_shader(lecture_shaders_path / "multi_attracting_particle.geom");
-	multi_attracting_particle_program.link();
-
-	nbody_particle_program = ShaderProgram();
-	nbody_particle_program.add_vertex_shader(lecture_shaders_path / "nbody_particle.vert");
-	nbody_particle_program.add_fragment_shader(lecture_shaders_path / "nbody_particle.frag");
-	nbody_particle_program.add_geometry_shader(lecture_shaders_path / "nbody_particle.geom");
-	nbody_particle_program.link();
-
-	nbody_update_program = ShaderProgram();
-	nbody_update_program.add_compute_shader(lecture_shaders_path / "nbody.comp");
-	nbody_update_program.link();
-
-	particle_surface_estimator_program = ShaderProgram();
-	particle_surface_estimator_program.add_vertex_shader(lecture_shaders_path / "surface_estimator.vert");
-	particle_surface_estimator_program.add_fragment_shader(lecture_shaders_path / "surface_estimator.frag");
-	particle_surface_estimator_program.add_geometry_shader(lecture_shaders_path / "surface_estimator.geom");
-	particle_surface_estimator_program.link();
+	// All programs are registered with the cache (again on a reload, which only updates their files).
+	program_cache.add(default_unlit_program, { lecture_shaders_path / "object.vert", lecture_shaders_path / "unlit.frag" });
+	program_cache.add(default_lit_program, { lecture_shaders_path / "object.vert", lecture_shaders_path / "lit.frag" });
+	program_cache.add(pulsating_particle_program, { lecture_shaders_path / "pulsating_particle.vert", lecture_shaders_path / "pulsating_particle.frag", lecture_shaders_path / "pulsating_particle.geom" });
+	program_cache.add(attracting_particle_program, { lecture_shaders_path / "attracting_particle.vert", lecture_shaders_path / "attracting_particle.frag", lecture_shaders_path / "attracting_particle.geom" });
+	program_cache.add(multi_attracting_particle_program, { lecture_shaders_path / "multi_attracting_particle.vert", lecture_shaders_path / "multi_attracting_particle.frag", lecture_shaders_path / "multi_attracting_particle.geom" });
+	program_cache.add(nbody_particle_program, { lecture_shaders_path / "nbody_particle.vert", lecture_shaders_path / "nbody_particle.frag", lecture_shaders_path / "nbody_particle.geom" });
+	program_cache.add(nbody_pack_program, { lecture_shaders_path / "nbody_pack.comp" });
+	program_cache.add(nbody_energy_program, { lecture_shaders_path / "nbody_energy.comp" });
+	program_cache.add(barnes_hut_bounds_program, { lecture_shaders_path / "barnes_hut_bounds.comp" });
+	program_cache.add(barnes_hut_keys_program, { lecture_shaders_path / "barnes_hut_keys.comp" });
+	program_cache.add(barnes_hut_scatter_program, { lecture_shaders_path / "barnes_hut_scatter.comp" });
+	program_cache.add(barnes_hut_build_program, { lecture_shaders_path / "barnes_hut_build.comp" });
+	program_cache.add(barnes_hut_reduce_program, { lecture_shaders_path / "barnes_hut_reduce.comp" });
+	program_cache.add(barnes_hut_force_program, { lecture_shaders_path / "barnes_hut_force.comp" });
+	program_cache.add(nbody_reference_program, { lecture_shaders_path / "nbody.comp" });
+	program_cache.add(nbody_sampled_program, { lecture_shaders_path / "nbody.comp" }, { { "SAMPLED", "1" } });
+	program_cache.add(barnes_hut_sampled_program, { lecture_shaders_path / "barnes_hut_force.comp" }, { { "SAMPLED", "1" } });
+	program_cache.add(prefix_sum_program, { lecture_shaders_path / "prefix_sum.comp" });
+	program_cache.add(prefix_sum_add_program, { lecture_shaders_path / "prefix_sum_add.comp" });
+	program_cache.add(particle_surface_estimator_program, { lecture_shaders_path / "surface_estimator.vert", lecture_shaders_path / "surface_estimator.frag", lecture_shaders_path / "surface_estimator.geom" });
+	program_cache.add(pulsating_update_program, { lecture_shaders_path / "pulsating_particle.comp" });
+	program_cache.add(attracting_update_program, { lecture_shaders_path / "attracting_particle.comp" });
+	program_cache.add(surface_estimator_update_program, { lecture_shaders_path / "surface_estimator.comp" });
+	program_cache.add(pulsating_quad_program, { lecture_shaders_path / "pulsating_particle_quad.vert", lecture_shaders_path / "pulsating_particle.frag" });
+	program_cache.add(attracting_quad_program, { lecture_shaders_path / "attracting_particle_quad.vert", lecture_shaders_path / "attracting_particle.frag" });
+	program_cache.add(multi_attracting_quad_program, { lecture_shaders_path / "multi_attracting_particle_quad.vert", lecture_shaders_path / "multi_attracting_particle.frag" });
+	program_cache.add(nbody_quad_program, { lecture_shaders_path / "nbody_particle_quad.vert", lecture_shaders_path / "nbody_particle.frag" });
+	program_cache.add(surface_estimator_quad_program, { lecture_shaders_path / "surface_estimator_quad.vert", lecture_shaders_path / "surface_estimator.frag" });
+	program_cache.add(pulsating_emit_program, { lecture_shaders_path / "pulsating_emit.comp" });
+	program_cache.add(particle_init_program, { lecture_shaders_path / "particle_init.comp" });
+	program_cache.add(particle_compact_program, { lecture_shaders_path / "particle_compact.comp" });
+	program_cache.add(particle_draw_args_program, { lecture_shaders_path / "particle_draw_args.comp" });
+	program_cache.add(attractor_field_program, { lecture_shaders_path / "attractor_field.comp" });
+	program_cache.add(sort_keys_program, { lecture_shaders_path / "sort_keys.comp" });
+	program_cache.add(radix_count_program, { lecture_shaders_path / "radix_count.comp" });
+	program_cache.add(radix_scatter_program, { lecture_shaders_path / "radix_scatter.comp" });
+	program_cache.add(particle_permute_program, { lecture_shaders_path / "particle_permute.comp" });
+	program_cache.add(particle_cull_program, { lecture_shaders_path / "particle_cull.comp" });
+	program_cache.add(particle_point_program, { lecture_shaders_path / "particle_point.vert", lecture_shaders_path / "particle_point.frag" });
+	program_cache.add(particle_upsample_program, { lecture_shaders_path / "fullscreen_triangle.vert", lecture_shaders_path / "particle_upsample.frag" });
+	program_cache.add(grid_count_program, { lecture_shaders_path / "grid_count.comp" });
+	program_cache.add(grid_scatter_program, { lecture_shaders_path / "grid_scatter.comp" });
+	program_cache.add(fluid_update_program, { lecture_shaders_path / "fluid_particle.comp" });
+	add_permuted_programs();
+
+	// Builds only the programs whose sources changed, from the binary cache when possible.
+	program_cache.build();
 
 	std::cout << "Shaders are reloaded." << std::endl;
 }
 
-void Application::from_file(std::filesystem::path path, bool center_vertices) {
-	const std::string extension = path.extension().generic_string();
-
-	if (extension == ".obj") {
-		tinyobj::ObjReader reader;
-
-		if (!reader.ParseFromFile(path.generic_string())) {
-			if (!reader.Error().empty()) {
-				std::cerr << "TinyObjReader: " << reader.Error();
-			}
-		}
-
-		if (!reader.Warning().empty()) {
-			std::cerr << "TinyObjReader: " << reader.Warning();
-		}
-
-		auto& attrib = reader.GetAttrib();
-		auto& shapes = reader.GetShapes();
-		auto& materials = reader.GetMaterials();
-
-		const tinyobj::shape_t& shape = shapes[0];
-
-		glm::vec3 min{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
-		glm::vec3 max{ std::numeric_limits<float>::min(), std::numeric_limits<float>::min(), std::numeric_limits<float>::min() };
-
-		mesh.positions.clear();
-		mesh.indices.clear();
-
-		int vertex_count = 0;
-		for (size_t i = 0; i < attrib.vertices.size() / 3; i++) {
-			mesh.positions.insert(mesh.positions.end(), glm::vec4(attrib.vertices[3 * i + 0], attrib.vertices[3 * i + 1], attrib.vertices[3 * i + 2], 1.0f));
-			vertex_count++;
-		}
-		model_vertex_count = vertex_count;
-
-		int index_count = 0;
-		for (const auto& shape : shapes) {
-			for (const auto& index : shape.mesh.indices) {
-				mesh.indices.insert(mesh.indices.end(), index.vertex_index);
-				index_count++;
-			}
-		}
-		model_index_count = index_count;
-	}
-}
-
 // Initialize Scene
 void Application::prepare_cameras() {
 	// Sets the default camera position.
@@ -131,6 +123,10 @@ void Application::prepare_textures() {
 	star_tex = TextureUtils::load_texture_2d(lecture_textures_path / "star.png");
 	// Particles are really small, use mipmaps for them.
 	TextureUtils::set_texture_2d_parameters(star_tex, GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+
+	// The alpha-blended sprite of BLEND_SORTED_ALPHA.
+	smoke_tex = TextureUtils::load_texture_2d(lecture_textures_path / "smoke.png");
+	TextureUtils::set_texture_2d_parameters(smoke_tex, GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
 }
 
 // Lights
@@ -141,6 +137,9 @@ void Application::prepare_scene() {
 	// Initializes the particles.
 	particles.resize(max_particle_count); // Resize the vector to the maximum number of particles.
 	attraction_points.resize(max_attractors); // Resize the vector to the maximum number of attractors.
+	attractor_speeds.resize(max_attractors);
+	animated_attraction_points.resize(max_attractors);
+	attractor_upload.resize(max_attractors);
 
 	// For N-Body Simulation
 	particle_positions[0].resize(max_particle_count);
@@ -148,17 +147,15 @@ void Application::prepare_scene() {
 	particle_velocities.resize(max_particle_count);
 	
 	std::vector<glm::vec3> particle_colors(max_particle_count);
-	for (int i = 0; i < max_particle_count; i++) {
-		particle_colors[i] = glm::rgbColor(glm::vec3(static_cast<float>(rand()) / static_cast<float>(RAND_MAX) * 360.0f, 1.0f, 1.0f));
-	}
+	ParticleInitializer::initialize_nbody_colors(cpu_simulation, particle_colors.data(), max_particle_count, random_seed);
 
 	// Initializes the particle buffers (N-Body Simulation).
 	glCreateBuffers(2, particle_positions_buffer);
 	glCreateBuffers(1, &particle_velocities_buffer);
 	glCreateBuffers(1, &particle_colors_buffer);
-	glNamedBufferStorage(particle_positions_buffer[0], sizeof(float) * 4 * max_particle_count, nullptr, GL_DYNAMIC_STORAGE_BIT);
-	glNamedBufferStorage(particle_positions_buffer[1], sizeof(float) * 4 * max_particle_count, nullptr, GL_DYNAMIC_STORAGE_BIT);
-	glNamedBufferStorage(particle_velocities_buffer, sizeof(float) * 4 * max_particle_count, nullptr, GL_DYNAMIC_STORAGE_BIT);
+	glNamedBufferStorage(particle_positions_buffer[0], sizeof(float) * 4 * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(particle_positions_buffer[1], sizeof(float) * 4 * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(particle_velocities_buffer, sizeof(float) * 4 * max_particle_count, nullptr, 0);
 	glNamedBufferStorage(particle_colors_buffer, sizeof(float) * 3 * max_particle_count, particle_colors.data(), 0); // We can already upload the colors as they will not be changed.
 
 	// Setup VAOs for rendering particles. (N-Body Simulation)
@@ -175,7 +172,7 @@ void Application::prepare_scene() {
 	glVertexArrayAttribFormat(particle_vao[0], 1, 4, GL_FLOAT, GL_FALSE, 0);
 	glVertexArrayAttribBinding(particle_vao[0], 1, 1);
 
-	glVertexArrayVertexBuffer(particle_vao[1], 0, particle_positions_buffer[0], 0, 4 * sizeof(float));
+	glVertexArrayVertexBuffer(particle_vao[1], 0, particle_positions_buffer[1], 0, 4 * sizeof(float));
 	glVertexArrayVertexBuffer(particle_vao[1], 1, particle_colors_buffer, 0, 4 * sizeof(float));
 
 	glEnableVertexArrayAttrib(particle_vao[1], 0);
@@ -185,397 +182,2621 @@ void Application::prepare_scene() {
 	glEnableVertexArrayAttrib(particle_vao[1], 1);
 	glVertexArrayAttribFormat(particle_vao[1], 1, 4, GL_FLOAT, GL_FALSE, 0);
 	glVertexArrayAttribBinding(particle_vao[1], 1, 1);
+	// The packed copy of the positions and the partial sums of the energy measurement.
+	glCreateBuffers(1, &nbody_packed_positions_buffer);
+	glCreateBuffers(1, &nbody_energy_partials_buffer);
+	glCreateBuffers(1, &nbody_energy_totals_buffer);
+	glNamedBufferStorage(nbody_packed_positions_buffer, sizeof(GLuint) * 2 * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(nbody_energy_partials_buffer, sizeof(glm::vec4) * 2 * ((max_particle_count + local_size_x - 1) / local_size_x), nullptr, 0);
+	glNamedBufferStorage(nbody_energy_totals_buffer, sizeof(glm::vec4) * 2, nullptr, 0);
+
+	// Initializes the tree buffers (Barnes-Hut).
+	glCreateBuffers(1, &bh_bounds_buffer);
+	glCreateBuffers(1, &bh_particle_keys_buffer);
+	glCreateBuffers(1, &bh_particle_indices_buffer);
+	glCreateBuffers(1, &bh_sorted_positions_buffer);
+	glCreateBuffers(1, &bh_links_buffer);
+	glCreateBuffers(1, &bh_parents_buffer);
+	glCreateBuffers(1, &bh_visits_buffer);
+	glCreateBuffers(1, &bh_nodes_buffer);
+	glCreateBuffers(1, &bh_saved_velocities_buffer);
+	glNamedBufferStorage(bh_bounds_buffer, sizeof(GLuint) * 6, nullptr, GL_DYNAMIC_STORAGE_BIT);
+	glNamedBufferStorage(bh_particle_keys_buffer, sizeof(GLuint) * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(bh_particle_indices_buffer, sizeof(GLuint) * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(bh_sorted_positions_buffer, sizeof(float) * 4 * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(bh_links_buffer, sizeof(GLuint) * 4 * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(bh_parents_buffer, sizeof(GLuint) * 2 * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(bh_visits_buffer, sizeof(GLuint) * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(bh_nodes_buffer, sizeof(float) * 4 * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(bh_saved_velocities_buffer, sizeof(float) * 4 * max_particle_count, nullptr, 0);
+	glCreateBuffers(1, &bh_sampled_accelerations_buffer);
+	glNamedBufferStorage(bh_sampled_accelerations_buffer, sizeof(float) * 4 * 2 * bh_accuracy_sample_count, nullptr, 0);
+	glCreateQueries(GL_TIME_ELAPSED, 2, bh_accuracy_queries);
+	glCreateQueries(GL_TIME_ELAPSED, 3, billboard_queries);
+
 	// End For N-Body Simulation
 
-	// Initializes the particle buffer.
-	glGenBuffers(1, &particle_buffer);
-	glGenBuffers(1, &mesh_position_buffer);
-	glGenBuffers(1, &mesh_index_buffer);
+	// Initializes the spatial hash grid (Fluid), with at most one bucket per particle plus the total.
+	glCreateBuffers(1, &grid_cell_starts_buffer);
+	glCreateBuffers(1, &grid_particle_keys_buffer);
+	glCreateBuffers(1, &grid_sorted_particles_buffer);
+	glNamedBufferStorage(grid_cell_starts_buffer, sizeof(GLuint) * (max_particle_count + 1), nullptr, 0);
+	glNamedBufferStorage(grid_particle_keys_buffer, sizeof(GLuint) * 2 * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(grid_sorted_particles_buffer, sizeof(float) * 4 * max_particle_count, nullptr, 0);
+
+	prepare_scan_buffers(max_particle_count + 1);
+	prepare_sort_buffers(max_particle_count);
+
+	// Initializes the lists of the visible particles, the counters are followed by the arguments of the indirect draws.
+	glCreateBuffers(1, &cull_visible_list_buffer);
+	glCreateBuffers(1, &cull_point_list_buffer);
+	glCreateBuffers(1, &cull_counters_buffer);
+	glNamedBufferStorage(cull_visible_list_buffer, sizeof(GLuint) * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(cull_point_list_buffer, sizeof(GLuint) * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(cull_counters_buffer, sizeof(GLuint) * 20, nullptr, 0);
+
+	// Initializes the particle streams (structure-of-arrays layout), sized for full precision.
+	// All particle buffers are written only through particle_uploader (or by shaders), so they need no dynamic storage.
+	glCreateBuffers(1, &particle_position_stream);
+	glCreateBuffers(1, &particle_velocity_stream);
+	glCreateBuffers(1, &particle_color_stream);
+	glCreateBuffers(1, &particle_lifetime_stream);
+	glNamedBufferStorage(particle_position_stream, sizeof(float) * 3 * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(particle_velocity_stream, sizeof(float) * 3 * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(particle_color_stream, sizeof(float) * 3 * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(particle_lifetime_stream, sizeof(float) * 2 * max_particle_count, nullptr, 0);
+
+	// Initializes the lists of live and dead particles (Sphere Pulsating).
+	glCreateBuffers(1, &alive_list_buffer);
+	glCreateBuffers(1, &dead_list_buffer);
+	glCreateBuffers(1, &list_counters_buffer);
+	glNamedBufferStorage(alive_list_buffer, sizeof(GLuint) * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(dead_list_buffer, sizeof(GLuint) * max_particle_count, nullptr, 0);
+	glNamedBufferStorage(list_counters_buffer, sizeof(GLuint) * 8, nullptr, GL_DYNAMIC_STORAGE_BIT);
+	glCreateBuffers(1, &compact_group_counts_buffer);
+	glNamedBufferStorage(compact_group_counts_buffer, sizeof(GLuint) * ((max_particle_count + local_size_x - 1) / local_size_x + 1), nullptr, 0);
+
+	// Initializes the attractor buffer (Multi Attractor), rewritten whenever the attractors move.
+	glCreateBuffers(1, &attractor_buffer);
+	glNamedBufferStorage(attractor_buffer, sizeof(glm::vec4) * max_attractors, nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+	// Initializes the particle buffer, sized for the maximum number of particles so that it is never reallocated.
+	glCreateBuffers(1, &particle_buffer);
+	glNamedBufferStorage(particle_buffer, sizeof(Particle) * max_particle_count, nullptr, 0);
+
+	// Initializes the cached targets of the surface estimator, generation 0 is never used by a loaded mesh.
+	glCreateBuffers(1, &surface_target_buffer);
+	glNamedBufferStorage(surface_target_buffer, sizeof(glm::vec4) * max_particle_count, nullptr, 0);
+	glClearNamedBufferData(surface_target_buffer, GL_RGBA32F, GL_RGBA, GL_FLOAT, nullptr);
 
 	reset_particles();
 	update_model();
 }
 
 // Framebuffers
-void Application::prepare_framebuffers() {}
+void Application::prepare_framebuffers() {
+	glCreateFramebuffers(1, &particle_framebuffer);
+	resize_fullscreen_textures();
+}
 
 // On Resize
-void Application::resize_fullscreen_textures() {}
-
-// Reset Particles
-void Application::reset_particles() {
-	// Initialize random number generators
-	std::random_device rd;
-	std::mt19937 gen(rd());
-	std::uniform_real_distribution<> real_dist(0.0f, 5.0f);  // Random lifetime
-
-	if (display_mode == DISPLAY_PULSATING_SCENE) {
+void Application::resize_fullscreen_textures() {
+	const int divisor = get_particle_resolution_divisor();
+	particle_target_width = std::max((width + divisor - 1) / divisor, 1);
+	particle_target_height = std::max((height + divisor - 1) / divisor, 1);
+
+	if (particle_color_texture != 0) {
+		glDeleteTextures(1, &particle_color_texture);
+		particle_color_texture = 0;
+	}
+	if (divisor == 1 || particle_framebuffer == 0) {
+		// The particles are drawn straight into the window (or the framebuffer is not prepared yet).
+		return;
+	}
 
-		for (int i = 0; i < current_particle_count; i++) {
-			// Initializes the particle position.
-			particles[i].position = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-			particles[i].lifetime = real_dist(gen);
-			particles[i].remaining = particles[i].lifetime;
-		}
+	// Half floats, the additive particles sum beyond one.
+	glCreateTextures(GL_TEXTURE_2D, 1, &particle_color_texture);
+	glTextureStorage2D(particle_color_texture, 1, GL_RGBA16F, particle_target_width, particle_target_height);
+	glTextureParameteri(particle_color_texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTextureParameteri(particle_color_texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTextureParameteri(particle_color_texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(particle_color_texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glNamedFramebufferTexture(particle_framebuffer, GL_COLOR_ATTACHMENT0, particle_color_texture, 0);
+
+	if (glCheckNamedFramebufferStatus(particle_framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "The particle framebuffer is incomplete, the particles are drawn at full resolution." << std::endl;
+		particle_resolution_index = 0;
+		resize_fullscreen_textures();
 	}
-	else if (display_mode == DISPLAY_SINGLE_ATTRACTOR_SCENE || display_mode == DISPLAY_MULTI_ATTRACTOR_SCENE) {
+}
 
-		std::uniform_real_distribution<> vel_dist(-10.0f, 10.f);  // Random position value
+int Application::get_particle_resolution_divisor() const {
+	return PARTICLE_RESOLUTION_DIVISORS[particle_resolution_index];
+}
 
-		// Zeroes the particle data.
-		for (int i = 0; i < current_particle_count; i++) {
-			// Initializes the particle position.
-			particles[i].position = glm::vec4(random_inside_sphere(50.0f), 1.0f);
-			particles[i].velocity = glm::vec3(vel_dist(gen), vel_dist(gen), vel_dist(gen));
-			particles[i].lifetime = real_dist(gen);
-			particles[i].remaining = particles[i].lifetime;
-		}
-	}
-	else if (display_mode == DISPLAY_NBODY_SCENE) {
-		// Zeroes the particle data.
-		for (int i = 0; i < current_particle_count; i++) {
-			// Initializes the particle position.
-			const float alpha = static_cast<float>(rand()) / static_cast<float>(RAND_MAX) * 2.0f * static_cast<float>(M_PI);
-			const float beta = asinf(static_cast<float>(rand()) / static_cast<float>(RAND_MAX) * 2.0f - 1.0f);
-			glm::vec3 point_on_sphere = glm::vec3(cosf(alpha) * cosf(beta), sinf(alpha) * cosf(beta), sinf(beta));
-			
-			//glm::vec3 point_on_sphere = random_inside_sphere(10.0f);
-			
-			particle_positions[0][i] = glm::vec4(point_on_sphere, 1.0f);
-			particle_positions[1][i] = glm::vec4(point_on_sphere, 1.0f);
-			particle_velocities[i] = glm::vec4(0.0f);
+// Reset Particles
+void Application::reset_particles() {
+	// The same seed gives the same particles, the respawns continue from the first step.
+	const auto start = std::chrono::high_resolution_clock::now();
+	simulation_step_index = 0;
+	scatter_attractors();
+	reset_nbody_drift();
+	clear_surface_targets();
+
+	// The GPU backend generates the particles in place, there is nothing to upload.
+	if (simulation_backend == SIMULATION_BACKEND_GPU) {
+		current_particle_count = desired_particle_count;
+		initialize_particles_gpu(0, current_particle_count);
+		if (display_mode == DISPLAY_PULSATING_SCENE) {
+			compact_particles();
 		}
-	}
-	else if (display_mode == DISPLAY_PARTICLE_SURFACE_ESTIMATOR_SCENE) {
 
-		// Zeroes the particle data.
-		for (int i = 0; i < current_particle_count; i++) {
-			// Initializes the particle position.
-			particles[i].position = glm::vec4(random_inside_sphere(25.0f), 1.0f);;
-			particles[i].velocity = glm::vec3(0.0f);
-		}
+		std::cout << "---" << std::endl;
+		std::cout << "Initialized " << current_particle_count << " particles (seed " << random_seed << ") on the GPU." << std::endl;
+		return;
 	}
 
+	initialize_particles_cpu(0, current_particle_count);
+
+	const auto end = std::chrono::high_resolution_clock::now();
+	std::cout << "---" << std::endl;
+	std::cout << "Initialized " << current_particle_count << " particles (seed " << random_seed << ") in "
+		<< std::chrono::duration<float, std::milli>(end - start).count() << " ms." << std::endl;
+
 	// Updates the particle buffer.
 	update_particles_buffer();
 }
 
-glm::vec3 Application::random_inside_sphere(float radius) {
-	std::random_device rd;
-	std::mt19937 gen(rd());
-	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
-	std::uniform_real_distribution<float> radius_dist(0.0f, 1.0f);
+void Application::initialize_particles_gpu(int first, int count) {
+	PROFILE_GPU_SCOPE(gpu_profiler, "Initialize Particles");
+	if (count <= 0) return;
+
+	particle_init_program.use();
+	particle_init_program.uniform("scene", display_mode);
+	particle_init_program.uniform("first_particle", first);
+	particle_init_program.uniform("end_particle", first + count);
+	particle_init_program.uniform("random_seed", static_cast<int>(random_seed));
+	if (display_mode == DISPLAY_NBODY_SCENE) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particle_positions_buffer[0]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, particle_positions_buffer[1]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, particle_velocities_buffer);
+	}
+	else {
+		bind_particle_streams(particle_init_program, true, true, true);
+	}
+	glDispatchCompute((count + local_size_x - 1) / local_size_x, 1, 1);
 
-	// Generate a random point in the unit cube
-	glm::vec3 point(dist(gen), dist(gen), dist(gen));
+	// The particles are read by the compute passes, the draws and the readbacks.
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
 
-	// Normalize the point to get a random direction on the unit sphere
-	point = glm::normalize(point);
+void Application::initialize_particles_cpu(int first, int count) {
+	if (count <= 0) return;
 
-	// Scale by the cube root of a random radius to ensure uniform distribution
-	float r = std::cbrt(radius_dist(gen));
-	return point * (r * radius);
+	// The global index is the counter of the random numbers, so the range gets the same state as in a full reset.
+	if (display_mode == DISPLAY_PULSATING_SCENE) {
+		ParticleInitializer::initialize_pulsating(cpu_simulation, particles.data(), count, random_seed, first);
+	}
+	else if (display_mode == DISPLAY_SINGLE_ATTRACTOR_SCENE || display_mode == DISPLAY_MULTI_ATTRACTOR_SCENE) {
+		ParticleInitializer::initialize_attracting(cpu_simulation, particles.data(), count, random_seed, first);
+	}
+	else if (display_mode == DISPLAY_NBODY_SCENE) {
+		ParticleInitializer::initialize_nbody(cpu_simulation, particle_positions[0].data(), particle_velocities.data(), count, random_seed, first);
+		std::copy(particle_positions[0].begin() + first, particle_positions[0].begin() + first + count, particle_positions[1].begin() + first);
+	}
+	else if (display_mode == DISPLAY_FLUID_SCENE) {
+		ParticleInitializer::initialize_fluid(cpu_simulation, particles.data(), count, random_seed, first);
+	}
+	else if (display_mode == DISPLAY_PARTICLE_SURFACE_ESTIMATOR_SCENE) {
+		ParticleInitializer::initialize_surface_estimator(cpu_simulation, particles.data(), count, random_seed, first);
+	}
 }
 
 // Update Particles Buffer
-void Application::update_particles_buffer() {
+void Application::update_particles_buffer(bool keep_simulated) {
+	PROFILE_GPU_SCOPE(gpu_profiler, "Upload");
+	const int previous_count = current_particle_count;
 	current_particle_count = desired_particle_count;
 
+	// The particles the GPU already simulates are kept, only the added ones are uploaded.
+	const int first = keep_simulated ? std::min(previous_count, current_particle_count) : 0;
+	const int count = current_particle_count - first;
+
 	std::cout << "---" << std::endl;
 	std::cout << "Desired particle count: " << current_particle_count << std::endl;
 
-	if (display_mode == DISPLAY_NBODY_SCENE) 
+	particle_uploader.reset_statistics();
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	if (keep_simulated && simulation_backend == SIMULATION_BACKEND_GPU)
+	{
+		// The CPU copy is not kept up to date with the GPU, the added particles are generated in place instead.
+		initialize_particles_gpu(first, count);
+	}
+	else if (display_mode == DISPLAY_NBODY_SCENE) 
 	{
-		glNamedBufferSubData(particle_positions_buffer[0], 0, sizeof(glm::vec4) * current_particle_count, particle_positions[0].data());
-		glNamedBufferSubData(particle_positions_buffer[1], 0, sizeof(glm::vec4) * current_particle_count, particle_positions[1].data());
-		glNamedBufferSubData(particle_velocities_buffer, 0, sizeof(glm::vec4) * current_particle_count, particle_velocities.data());
+		// The CPU backend simulates its own copy, only the added particles are generated.
+		if (keep_simulated) {
+			initialize_particles_cpu(first, count);
+		}
+
+		particle_uploader.upload(particle_positions_buffer[0], sizeof(glm::vec4) * first, particle_positions[0].data() + first, sizeof(glm::vec4) * count);
+		particle_uploader.upload(particle_positions_buffer[1], sizeof(glm::vec4) * first, particle_positions[1].data() + first, sizeof(glm::vec4) * count);
+		particle_uploader.upload(particle_velocities_buffer, sizeof(glm::vec4) * first, particle_velocities.data() + first, sizeof(glm::vec4) * count);
 
 		std::cout << "Particles buffer size: " << sizeof(float) * (4 + 4 + 3) * current_particle_count << " bytes." << std::endl;
 	}
-	else 
+	else if (particle_layout == PARTICLE_LAYOUT_AOS)
 	{
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, particle_buffer);
-		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Particle) * current_particle_count, particles.data(), GL_DYNAMIC_DRAW);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		if (keep_simulated) {
+			initialize_particles_cpu(first, count);
+		}
+		upload_particles_buffer(first, count);
 
 		std::cout << "Particles buffer size: " << sizeof(Particle) * current_particle_count << " bytes." << std::endl;
 	}
+	else
+	{
+		if (keep_simulated) {
+			initialize_particles_cpu(first, count);
+		}
+		upload_particles_buffer(first, count);
 
-	std::cout << "Particles buffer updated." << std::endl;
-}
-
-void Application::update_model() {
-	from_file(lecture_folder_path / MODEL_PATHS[current_model], false);
-
-	size_t position_size = sizeof(glm::vec4) * mesh.positions.size();
-	size_t index_size = sizeof(int) * mesh.indices.size();
+		const int vector_size = half_precision_streams ? 4 * sizeof(GLushort) : 3 * sizeof(float);
+		std::cout << "Particles buffer size: " << (3 * sizeof(float) + 2 * vector_size + 2 * sizeof(float)) * current_particle_count << " bytes." << std::endl;
+	}
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mesh_position_buffer);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, position_size, mesh.positions.data(), GL_DYNAMIC_READ);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	const auto end = std::chrono::high_resolution_clock::now();
+	std::cout << "Uploaded " << particle_uploader.get_uploaded_bytes() << " bytes in " << std::chrono::duration<float, std::milli>(end - start).count()
+		<< " ms (" << particle_uploader.get_wait_time() << " ms waiting for the staging ring)." << std::endl;
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mesh_index_buffer);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, index_size, mesh.indices.data(), GL_DYNAMIC_READ);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	if (display_mode == DISPLAY_PULSATING_SCENE) {
+		compact_particles();
+	}
 
-	std::cout << "Model Vertex Count: " << model_vertex_count << std::endl;
-	std::cout << "Model Index Count: " << model_index_count << std::endl;
-	std::cout << "Model Buffer Size: " << position_size + index_size << " bytes." << std::endl;
-	std::cout << "Model Updated." << std::endl;
+	std::cout << "Particles buffer updated." << std::endl;
 }
 
-// Update Particles on GPU
-void Application::update_particles_gpu()
-{
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particle_positions_buffer[current_read]);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, particle_positions_buffer[current_write]);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, particle_velocities_buffer);
-
-	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-
-	nbody_update_program.use();
-	nbody_update_program.uniform("t_delta", (float)t_delta * 0.0001f);
-	nbody_update_program.uniform("current_particle_count", current_particle_count);
-	nbody_update_program.uniform("acceleration_factor", acceleration_factor);
-	nbody_update_program.uniform("distance_threshold", distance_threshold);
-
-	// Dispatches the compute shader and measures the elapsed time.
-	glBeginQuery(GL_TIME_ELAPSED, render_time_query);
-	glDispatchCompute(current_particle_count / local_size_x, 1, 1);
-	glEndQuery(GL_TIME_ELAPSED);
+void Application::upload_particles_buffer(int first, int count) {
+	if (particle_layout == PARTICLE_LAYOUT_AOS) {
+		particle_uploader.upload(particle_buffer, sizeof(Particle) * first, particles.data() + first, sizeof(Particle) * count);
+		return;
+	}
 
-	// Waits for OpenGL - don't forget OpenGL is asynchronous.
-	glFinish();
+	// Splits the particles into the streams, the vectors are either 3 floats or 2 words of packed halves.
+	const int vector_words = half_precision_streams ? 2 : 3;
+	std::vector<float> positions(3 * count);
+	std::vector<GLuint> velocities(vector_words * count);
+	std::vector<GLuint> colors(vector_words * count);
+	std::vector<glm::vec2> lifetimes(count);
+
+	for (int i = 0; i < count; i++) {
+		const Particle& particle = particles[first + i];
+		std::memcpy(&positions[3 * i], glm::value_ptr(particle.position), 3 * sizeof(float));
+		lifetimes[i] = glm::vec2(particle.lifetime, particle.remaining);
+
+		if (half_precision_streams) {
+			velocities[2 * i] = glm::packHalf2x16(glm::vec2(particle.velocity.x, particle.velocity.y));
+			velocities[2 * i + 1] = glm::packHalf2x16(glm::vec2(particle.velocity.z, 0.0f));
+			colors[2 * i] = glm::packHalf2x16(glm::vec2(particle.color.x, particle.color.y));
+			colors[2 * i + 1] = glm::packHalf2x16(glm::vec2(particle.color.z, 0.0f));
+		}
+		else {
+			std::memcpy(&velocities[3 * i], glm::value_ptr(particle.velocity), 3 * sizeof(float));
+			std::memcpy(&colors[3 * i], glm::value_ptr(particle.color), 3 * sizeof(float));
+		}
+	}
 
-	// Evaluates the query.
-	GLuint64 render_time;
-	glGetQueryObjectui64v(render_time_query, GL_QUERY_RESULT, &render_time);
-	compute_fps_gpu = 1000.f / (static_cast<float>(render_time) * 1e-6f);
+	particle_uploader.upload(particle_position_stream, sizeof(float) * 3 * first, positions.data(), sizeof(float) * positions.size());
+	particle_uploader.upload(particle_velocity_stream, sizeof(GLuint) * vector_words * first, velocities.data(), sizeof(GLuint) * velocities.size());
+	particle_uploader.upload(particle_color_stream, sizeof(GLuint) * vector_words * first, colors.data(), sizeof(GLuint) * colors.size());
+	particle_uploader.upload(particle_lifetime_stream, sizeof(glm::vec2) * first, lifetimes.data(), sizeof(glm::vec2) * lifetimes.size());
 }
 
-// Update
-void Application::update(float delta) {
-	PV227Application::update(delta);
-
-	// Updates the main camera.
-	const glm::vec3 eye_position = camera.get_eye_position();
-	camera_ubo.set_view(lookAt(eye_position, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
-	camera_ubo.update_opengl_data();
+void Application::set_particle_layout(int layout, bool half_precision) {
+	// The N-Body scene has its own buffers, the particles are converted when the scene changes.
+	if (display_mode != DISPLAY_NBODY_SCENE) {
+		download_particles_buffer();
+	}
 
-	// Updates the global time delta.
-	t_delta = delta;
+	particle_layout = layout;
+	half_precision_streams = half_precision;
 
-	if (display_mode == DISPLAY_NBODY_SCENE) {
-		update_particles_gpu();
+	if (display_mode != DISPLAY_NBODY_SCENE) {
+		update_particles_buffer();
 	}
 }
 
-// Pulsating Simulation (DISPLAY_PULSATING_SCENE)
-void Application::render_pulsating_simulation() {
-	glDepthMask(GL_FALSE);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_ONE, GL_ONE);
-	
-	pulsating_particle_program.use();
-	pulsating_particle_program.uniform("t_time", (float)elapsed_time);
-	pulsating_particle_program.uniform("t_delta", (float)t_delta * 0.0001f);
-	pulsating_particle_program.uniform("particle_size_vs", particle_size);
-
-	// Binds the particle texture.
-	glBindTextureUnit(0, star_tex);
+void Application::bind_particle_streams(CachedShaderProgram& program, bool velocity, bool color, bool lifetime) {
+	program.uniform("particle_layout", particle_layout);
+	program.uniform("half_precision", half_precision_streams);
 
-	// Binds the particle buffer.
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, particle_buffer);
-
-	// Renders the particles.
-	glBindVertexArray(empty_vao);
-	glDrawArrays(GL_POINTS, 0, current_particle_count);
+	if (particle_layout == PARTICLE_LAYOUT_AOS) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, particle_buffer);
+		return;
+	}
 
-	glDepthMask(GL_TRUE);
-	glDisable(GL_BLEND);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, particle_position_stream);
+	if (velocity) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, particle_velocity_stream);
+	if (color) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, particle_color_stream);
+	if (lifetime) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, particle_lifetime_stream);
 }
 
-// Attracting Simulation (DISPLAY_SINGLE_ATTRACTOR_SCENE)
-void Application::render_attracting_simulation() {
-
-	glDepthMask(GL_FALSE);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_ONE, GL_ONE);
-
-	attracting_particle_program.use();
-	attracting_particle_program.uniform("t_time", (float)elapsed_time);
-	attracting_particle_program.uniform("t_delta", (float)t_delta * 0.0001f);
-	attracting_particle_program.uniform("particle_size_vs", particle_size);
-	attracting_particle_program.uniform("attractor_point", attraction_points[0]);
-	attracting_particle_program.uniform("attractor_force", attraction_force);
+int Application::get_particle_traffic() const {
+	// N-Body reads and writes the position and the velocity (not counting the reads of the other particles),
+	// the rendering reads the position and the color.
+	if (display_mode == DISPLAY_NBODY_SCENE) {
+		return 4 * sizeof(glm::vec4) + 2 * sizeof(glm::vec4);
+	}
 
-	// Binds the particle texture.
-	glBindTextureUnit(0, star_tex);
+	// The surface estimator also reads its cached target in each step.
+	const int target_size = (display_mode == DISPLAY_PARTICLE_SURFACE_ESTIMATOR_SCENE) ? sizeof(glm::vec4) : 0;
 
-	// Binds the particle buffer.
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, particle_buffer);
+	// The fluid bins the particles before each step: the count reads the position and writes the key, the scatter reads
+	// both and writes the sorted entry, which the step reads again (once per neighbour, not counted here).
+	const int grid_size = (display_mode == DISPLAY_FLUID_SCENE) ? 2 * sizeof(glm::vec4) + 2 * 2 * sizeof(GLuint) + 2 * sizeof(glm::vec4) : 0;
 
-	// Renders the particles.
-	glBindVertexArray(empty_vao);
-	glDrawArrays(GL_POINTS, 0, current_particle_count);
+	// The whole record is read and written back by the step and read again by the rendering.
+	if (particle_layout == PARTICLE_LAYOUT_AOS) {
+		return 3 * sizeof(Particle) + target_size + grid_size;
+	}
 
-	glDepthMask(GL_TRUE);
-	glDisable(GL_BLEND);
+	const int position_size = 3 * sizeof(float);
+	const int vector_size = half_precision_streams ? 2 * sizeof(GLuint) : 3 * sizeof(float);
+	if (display_mode == DISPLAY_PULSATING_SCENE) {
+		// The step reads and writes the position, reads the velocity and the lifetime and writes remaining (except on respawn),
+		// the compaction reads remaining and writes the index. The rendering reads the index, the position, the color and the lifetime.
+		return 2 * position_size + vector_size + 2 * sizeof(float) + sizeof(float)
+			+ sizeof(float) + sizeof(GLuint)
+			+ sizeof(GLuint) + position_size + vector_size + 2 * sizeof(float);
+	}
+	if (display_mode == DISPLAY_SINGLE_ATTRACTOR_SCENE || display_mode == DISPLAY_MULTI_ATTRACTOR_SCENE) {
+		// The step reads and writes the position and the velocity and reads the color, the rendering reads the position and the color.
+		// With half floats the step alone is 2 * 12 + 3 * 8 = 48 B, the color is read to assign the colors of new particles.
+		return 2 * position_size + 3 * vector_size
+			+ position_size + vector_size;
+	}
+	if (display_mode == DISPLAY_FLUID_SCENE) {
+		// The step reads and writes the position and the velocity and writes the color, the rendering reads the position and the color.
+		return 2 * position_size + 3 * vector_size + grid_size
+			+ position_size + vector_size;
+	}
+	// The step reads and writes the position and the velocity, the rendering reads the position.
+	return 2 * position_size + 2 * vector_size + target_size + position_size;
 }
 
-// Attracting Simulation (DISPLAY_MULTI_ATTRACTOR_SCENE)
-void Application::render_multi_attracting_simulation() {
-
-	glDepthMask(GL_FALSE);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_ONE, GL_ONE);
+void Application::update_model() {
+	// The current model stays in use until the new one is loaded (on the loader thread) and uploaded, see poll_model.
+	mesh_loader.load(lecture_folder_path / MODEL_PATHS[current_model]);
+}
 
-	multi_attracting_particle_program.use();
-	multi_attracting_particle_program.uniform("t_time", (float)elapsed_time);
-	multi_attracting_particle_program.uniform("t_delta", (float)t_delta * 0.0001f);
-	multi_attracting_particle_program.uniform("particle_size_vs", particle_size);
-	multi_attracting_particle_program.uniform("attractor_used", attractor_used);
-	for (int i = 0; i < attractor_used; i++) {
-		multi_attracting_particle_program.uniform("attractor_points[" + std::to_string(i) + "]", attraction_points[i]);
+void Application::poll_model() {
+	PROFILE_SCOPE("Model Poll");
+	if (pending_mesh_fence == nullptr) {
+		if (!mesh_loader.poll(pending_mesh)) return;
+
+		// Uploads the model into new buffers, the old ones may still be read by the steps in flight.
+		const size_t triangle_size = sizeof(glm::vec4) * pending_mesh.triangles.size();
+		const size_t alias_size = sizeof(AliasEntry) * pending_mesh.alias_table.size();
+		glCreateBuffers(1, &pending_mesh_triangle_buffer);
+		glCreateBuffers(1, &pending_mesh_alias_buffer);
+		glNamedBufferStorage(pending_mesh_triangle_buffer, std::max(triangle_size, sizeof(glm::vec4)), nullptr, 0);
+		glNamedBufferStorage(pending_mesh_alias_buffer, std::max(alias_size, sizeof(AliasEntry)), nullptr, 0);
+		particle_uploader.upload(pending_mesh_triangle_buffer, 0, pending_mesh.triangles.data(), triangle_size);
+		particle_uploader.upload(pending_mesh_alias_buffer, 0, pending_mesh.alias_table.data(), alias_size);
+		pending_mesh_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		return;
 	}
-	multi_attracting_particle_program.uniform("attractor_force", attraction_force);
-
-	// Binds the particle texture.
-	glBindTextureUnit(0, star_tex);
 
-	// Binds the particle buffer.
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, particle_buffer);
+	// Swaps the model in once the copies are done, checking the fence without waiting.
+	const GLenum status = glClientWaitSync(pending_mesh_fence, 0, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+	glDeleteSync(pending_mesh_fence);
+	pending_mesh_fence = nullptr;
+
+	glDeleteBuffers(1, &mesh_triangle_buffer);
+	glDeleteBuffers(1, &mesh_alias_buffer);
+	mesh_triangle_buffer = pending_mesh_triangle_buffer;
+	mesh_alias_buffer = pending_mesh_alias_buffer;
+	pending_mesh_triangle_buffer = 0;
+	pending_mesh_alias_buffer = 0;
+
+	mesh = std::move(pending_mesh);
+	model_vertex_count = static_cast<int>(mesh.positions.size());
+	model_index_count = static_cast<int>(mesh.indices.size());
+	// Invalidates the cached targets of all particles.
+	mesh_generation++;
 
-	// Renders the particles.
-	glBindVertexArray(empty_vao);
-	glDrawArrays(GL_POINTS, 0, current_particle_count);
-
-	glDepthMask(GL_TRUE);
-	glDisable(GL_BLEND);
+	std::cout << "Model Vertex Count: " << model_vertex_count << std::endl;
+	std::cout << "Model Index Count: " << model_index_count << std::endl;
+	std::cout << "Model Buffer Size: " << sizeof(glm::vec4) * mesh.triangles.size() + sizeof(AliasEntry) * mesh.alias_table.size() << " bytes." << std::endl;
+	std::cout << "Model Load: " << mesh_loader.get_last_load_info() << std::endl;
+	std::cout << "Model Updated." << std::endl;
 }
 
-// N-Body Simulation (DISPLAY_NBODY_SCENE)
-void Application::render_nbody_simulation() {
-	glDepthMask(GL_FALSE);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_ONE, GL_ONE);
-
-	nbody_particle_program.use();
-	nbody_particle_program.uniform("particle_size_vs", particle_size);
-
-	// Binds the particle texture.
-	glBindTextureUnit(0, star_tex);
-
-	// Binds the particle buffer.
-	glBindVertexArray(particle_vao[current_write]);
-	glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
-	glDrawArrays(GL_POINTS, 0, current_particle_count);
-
-	glDepthMask(GL_TRUE);
-	glDisable(GL_BLEND);
-
-	std::swap(current_read, current_write);
+void Application::clear_surface_targets() {
+	// A cleared target has generation 0, which no loaded mesh has.
+	glClearNamedBufferData(surface_target_buffer, GL_RGBA32F, GL_RGBA, GL_FLOAT, nullptr);
+	cpu_simulation.clear_surface_targets();
 }
 
-void Application::render_surface_estimator() {
-	glDepthMask(GL_FALSE);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_ONE, GL_ONE);
-
-	particle_surface_estimator_program.use();
-	particle_surface_estimator_program.uniform("t_time", (float)elapsed_time);
-	particle_surface_estimator_program.uniform("t_delta", (float)t_delta * 0.0001f);
-	particle_surface_estimator_program.uniform("vertex_count", model_vertex_count);
-	particle_surface_estimator_program.uniform("index_count", model_index_count);
-	particle_surface_estimator_program.uniform("particle_size_vs", particle_size);
+// Update Particles on GPU
+void Application::update_particles_gpu(int step_count)
+{
+	if (bh_accuracy_check_requested && display_mode == DISPLAY_NBODY_SCENE) {
+		bh_accuracy_check_requested = false;
+		check_barnes_hut_accuracy();
+	}
 
-	// Binds the particle texture.
-	glBindTextureUnit(0, star_tex);
+	PROFILE_GPU_SCOPE(gpu_profiler, "Compute Dispatch");
 
-	// Binds the particle buffer.
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, particle_buffer);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, mesh_position_buffer);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, mesh_index_buffer);
+	// Dispatches the compute passes and measures the elapsed time, the result arrives a few frames later.
+	compute_timer.begin();
+	for (int step = 0; step < step_count; step++) {
+		dispatch_simulation_step();
+	}
+	compute_timer.end();
+	compute_time_gpu = compute_timer.get_time();
+}
 
-	// Renders the particles.
-	glBindVertexArray(empty_vao);
-	glDrawArrays(GL_POINTS, 0, current_particle_count);
+int Application::get_emission_count() const
+{
+	return static_cast<int>(std::ceil(emission_limit * current_particle_count));
+}
 
-	glDepthMask(GL_TRUE);
-	glDisable(GL_BLEND);
+float Application::get_simulation_step() const
+{
+	return 1000.0f / static_cast<float>(simulation_rate) * 0.0001f;
 }
 
-// Render Scene
-void Application::render() {
-	// Starts measuring the elapsed time.
-	glBeginQuery(GL_TIME_ELAPSED, render_time_query);
+void Application::dispatch_simulation_step()
+{
+	PROFILE_GPU_SCOPE(gpu_profiler, DISPLAY_NAMES[display_mode]);
+	simulation_time += 1000.0 / simulation_rate;
+	simulation_step_index++;
 
-	// Binds the main window framebuffer.
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glViewport(0, 0, width, height);
+	if (morton_reordering && simulation_step_index % morton_reorder_interval == 0) {
+		reorder_particles();
+	}
 
-	// Clears the framebuffer color.
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glEnable(GL_DEPTH_TEST);
+	if (display_mode == DISPLAY_NBODY_SCENE) {
+		dispatch_nbody_kernel(nbody_kernel, get_simulation_step());
 
-	// Binds the necessary buffers.
-	camera_ubo.bind_buffer_base(CameraUBO::DEFAULT_CAMERA_BINDING);
+		// The written positions are the input of the next step and of the rendering.
+		std::swap(current_read, current_write);
+		return;
+	}
 
 	if (display_mode == DISPLAY_PULSATING_SCENE) {
-		render_pulsating_simulation();
+		// Respawns the dead particles from the list built after the previous step, the update below moves them.
+		pulsating_emit_program.use();
+		pulsating_emit_program.uniform("t_time", static_cast<float>(simulation_time));
+		pulsating_emit_program.uniform("t_delta", get_simulation_step());
+		const int emission_count = get_emission_count();
+		pulsating_emit_program.uniform("emission_count", emission_count);
+		pulsating_emit_program.uniform("step_index", static_cast<int>(simulation_step_index));
+		pulsating_emit_program.uniform("random_seed", static_cast<int>(random_seed));
+		bind_particle_streams(pulsating_emit_program, true, true, true);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, dead_list_buffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 18, list_counters_buffer);
+		if (emission_count > 0) {
+			glDispatchCompute((emission_count + local_size_x - 1) / local_size_x, 1, 1);
+		}
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 	}
-	else if (display_mode == DISPLAY_SINGLE_ATTRACTOR_SCENE) {
-		render_attracting_simulation();
+
+	if (display_mode == DISPLAY_FLUID_SCENE) {
+		// Bins the particles by their current positions, the step finds its neighbours through the grid.
+		build_spatial_grid();
 	}
-	else if (display_mode == DISPLAY_MULTI_ATTRACTOR_SCENE) {
-		render_multi_attracting_simulation();
+	if (display_mode == DISPLAY_MULTI_ATTRACTOR_SCENE) {
+		// Moves the attractors and rebakes the stale part of the field before the step reads them.
+		animate_attractor_points();
+		upload_attractors();
+		if (use_force_field) {
+			refresh_force_field();
+		}
 	}
-	else if (display_mode == DISPLAY_NBODY_SCENE) {
-		render_nbody_simulation();
+
+	CachedShaderProgram& program = (display_mode == DISPLAY_PULSATING_SCENE) ? pulsating_update_program
+		: (display_mode == DISPLAY_SINGLE_ATTRACTOR_SCENE) ? attracting_update_program
+		: (display_mode == DISPLAY_MULTI_ATTRACTOR_SCENE) ? multi_attracting_update_program
+		: (display_mode == DISPLAY_FLUID_SCENE) ? fluid_update_program
+		: surface_estimator_update_program;
+
+	program.use();
+	program.uniform("t_time", static_cast<float>(simulation_time));
+	program.uniform("t_delta", get_simulation_step());
+	program.uniform("current_particle_count", current_particle_count);
+	program.uniform("random_seed", static_cast<int>(random_seed));
+
+	if (display_mode == DISPLAY_SINGLE_ATTRACTOR_SCENE) {
+		program.uniform("attractor_point", attraction_points[0]);
+		program.uniform("attractor_force", attraction_force);
+	}
+	else if (display_mode == DISPLAY_MULTI_ATTRACTOR_SCENE) {
+		program.uniform("attractor_used", attractor_used);
+		program.uniform("attractor_force", attraction_force);
+		program.uniform("use_force_field", use_force_field);
+		program.uniform("force_field_min", glm::vec3(-0.5f * force_field_extent));
+		program.uniform("force_field_size", force_field_extent);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 23, attractor_buffer);
+		glBindTextureUnit(0, force_field_texture);
 	}
 	else if (display_mode == DISPLAY_PARTICLE_SURFACE_ESTIMATOR_SCENE) {
-		render_surface_estimator();
+		// The particles stay in place until the first model is loaded.
+		if (model_index_count == 0) return;
+		program.uniform("triangle_count", model_index_count / 3);
+		program.uniform("mesh_generation", static_cast<float>(mesh_generation));
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, mesh_triangle_buffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, mesh_alias_buffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 19, surface_target_buffer);
+	}
+	else if (display_mode == DISPLAY_FLUID_SCENE) {
+		program.uniform("interaction_radius", fluid_interaction_radius);
+		program.uniform("repulsion", fluid_repulsion);
+		program.uniform("cohesion", fluid_cohesion);
+		program.uniform("containment", fluid_containment);
+		program.uniform("table_size", CpuSimulation::get_hash_table_size(current_particle_count));
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 20, grid_cell_starts_buffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 22, grid_sorted_particles_buffer);
 	}
 
-	// Resets the VAO and the program.
-	glBindVertexArray(0);
-	glUseProgram(0);
+	// Binds the particle buffer (or the streams the update reads or writes).
+	const bool color = display_mode == DISPLAY_SINGLE_ATTRACTOR_SCENE || display_mode == DISPLAY_MULTI_ATTRACTOR_SCENE || display_mode == DISPLAY_FLUID_SCENE;
+	const bool lifetime = display_mode == DISPLAY_PULSATING_SCENE;
+	bind_particle_streams(program, true, color, lifetime);
 
-	// Stops measuring the elapsed time.
-	glEndQuery(GL_TIME_ELAPSED);
+	glDispatchCompute((current_particle_count + local_size_x - 1) / local_size_x, 1, 1);
 
-	// Waits for OpenGL - don't forget OpenGL is asynchronous.
-	glFinish();
+	// The next step and the rendering read what this step wrote.
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
-	// Evaluates the query.
-	if (display_mode != DISPLAY_NBODY_SCENE) {
-		GLuint64 render_time;
-		glGetQueryObjectui64v(render_time_query, GL_QUERY_RESULT, &render_time);
-		fps_gpu = 1000.f / (static_cast<float>(render_time) * 1e-6f);
-	}
-	else {
-		fps_gpu = compute_fps_gpu;
+	if (display_mode == DISPLAY_PULSATING_SCENE) {
+		compact_particles();
 	}
 }
 
-// GUI
-void Application::render_ui() {
-
-	if (!show_ui) return;
-
-	const float unit = ImGui::GetFontSize();
+void Application::compact_particles()
+{
+	const int group_count = (current_particle_count + local_size_x - 1) / local_size_x;
 
-	ImGui::Begin("Controls", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+	// Clears the list sizes, which stay zero without particles.
+	glClearNamedBufferSubData(list_counters_buffer, GL_R32UI, 0, 2 * sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
 
-	std::string fps_cpu_string = "FPS (CPU): ";
-	ImGui::Text(fps_cpu_string.append(std::to_string(fps_cpu)).c_str());
+	particle_compact_program.use();
+	particle_compact_program.uniform("current_particle_count", current_particle_count);
+	bind_particle_streams(particle_compact_program, false, false, true);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, compact_group_counts_buffer);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
-	std::string fps_string = "FPS (GPU): ";
-	ImGui::Text(fps_string.append(std::to_string(fps_gpu)).c_str());
+	// Counts the dead particles of each group, their prefix sum is where each group starts in the dead list.
+	particle_compact_program.uniform("compact_pass", COMPACT_COUNT);
+	glDispatchCompute(group_count, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	exclusive_scan(compact_group_counts_buffer, group_count);
+
+	// The scan rebinds the low bindings.
+	particle_compact_program.use();
+	bind_particle_streams(particle_compact_program, false, false, true);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, compact_group_counts_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, alive_list_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, dead_list_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 18, list_counters_buffer);
+	particle_compact_program.uniform("compact_pass", COMPACT_WRITE);
+	glDispatchCompute(group_count, 1, 1);
+
+	// The lists are read by the emission of the next step and by the rendering.
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
 
-	if (ImGui::Combo("Display", &display_mode, DISPLAY_NAMES, IM_ARRAYSIZE(DISPLAY_NAMES))) {
-		reset_particles();
+void Application::dispatch_nbody_kernel(int kernel, float time_step)
+{
+	if (kernel == NBODY_BARNES_HUT_KERNEL) {
+		build_barnes_hut_tree();
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particle_positions_buffer[current_read]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, particle_positions_buffer[current_write]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, particle_velocities_buffer);
+
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// Selects the kernel, all of them share the same interface.
+	CachedShaderProgram& program = (kernel == NBODY_BARNES_HUT_KERNEL) ? barnes_hut_force_program
+		: (kernel == NBODY_SHARED_KERNEL) ? nbody_shared_update_program
+		: nbody_update_program;
+
+	// The direct kernels read the other bodies from the packed copy, the tree is built from the full positions.
+	const bool packed = nbody_packed_positions && kernel != NBODY_BARNES_HUT_KERNEL;
+	if (packed) {
+		nbody_pack_program.use();
+		nbody_pack_program.uniform("current_particle_count", current_particle_count);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, nbody_packed_positions_buffer);
+		glDispatchCompute((current_particle_count + local_size_x - 1) / local_size_x, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	run_nbody_program(program, kernel, get_nbody_workgroup_size(kernel), time_step, current_particle_count);
+}
+
+void Application::run_nbody_program(CachedShaderProgram& program, int kernel, int workgroup_size, float time_step, int particle_count)
+{
+	set_nbody_uniforms(program, kernel, time_step, particle_count);
+
+	// Rounded up, the kernels skip the invocations past the last particle.
+	glDispatchCompute((particle_count + workgroup_size - 1) / workgroup_size, 1, 1);
+}
+
+void Application::set_nbody_uniforms(CachedShaderProgram& program, int kernel, float time_step, int particle_count)
+{
+	program.use();
+	program.uniform("t_delta", time_step);
+	program.uniform("current_particle_count", particle_count);
+	program.uniform("acceleration_factor", acceleration_factor);
+	program.uniform("distance_threshold", distance_threshold);
+	program.uniform("gravity_model", nbody_gravity_model);
+	program.uniform("softening", nbody_softening);
+	program.uniform("integrator", nbody_integrator);
+
+	if (kernel == NBODY_BARNES_HUT_KERNEL) {
+		program.uniform("theta", bh_theta);
+		program.uniform("leaf_size", bh_leaf_size);
+	}
+}
+
+int Application::get_nbody_workgroup_size(int kernel) const
+{
+	return (kernel == NBODY_BARNES_HUT_KERNEL) ? local_size_x : NBODY_WORKGROUP_SIZES[nbody_workgroup_size_index];
+}
+
+ShaderDefines Application::get_nbody_defines(int kernel, int workgroup_size, int unroll) const
+{
+	// Only the tiled kernel has an unrolled loop, the naive one ignores the factor.
+	ShaderDefines defines = { { "WORKGROUP_SIZE", std::to_string(workgroup_size) } };
+	if (kernel == NBODY_SHARED_KERNEL) {
+		defines.push_back({ "UNROLL", std::to_string(unroll) });
+	}
+	if (nbody_packed_positions) {
+		defines.push_back({ "PACKED_POSITIONS", "1" });
+	}
+	return defines;
+}
+
+ShaderDefines Application::get_multi_attractor_defines() const
+{
+	// Each count is a separate program, so only the small counts (where the loop overhead matters) are specialized.
+	if (!specialize_attractor_count || attractor_used > max_specialized_attractors) return {};
+	return { { "ATTRACTOR_COUNT", std::to_string(attractor_used) } };
+}
+
+bool Application::add_permuted_programs()
+{
+	const int workgroup_size = NBODY_WORKGROUP_SIZES[nbody_workgroup_size_index];
+	const int unroll = NBODY_UNROLL_FACTORS[nbody_unroll_index];
+
+	bool changed = false;
+	changed |= program_cache.add(nbody_update_program, { lecture_shaders_path / "nbody.comp" }, get_nbody_defines(NBODY_NAIVE_KERNEL, workgroup_size, unroll));
+	changed |= program_cache.add(nbody_shared_update_program, { lecture_shaders_path / "nbody_shared.comp" }, get_nbody_defines(NBODY_SHARED_KERNEL, workgroup_size, unroll));
+	changed |= program_cache.add(multi_attracting_update_program, { lecture_shaders_path / "multi_attracting_particle.comp" }, get_multi_attractor_defines());
+	return changed;
+}
+
+void Application::update_shader_permutations()
+{
+	// The permutations built before are loaded from the binary cache.
+	if (add_permuted_programs()) {
+		program_cache.build();
+	}
+}
+
+std::string Application::get_nbody_tuning_key() const
+{
+	return std::string("nbody-k").append(std::to_string(nbody_kernel))
+		.append("-g").append(std::to_string(nbody_gravity_model))
+		.append(nbody_packed_positions ? "-half" : "-float")
+		.append("-n").append(std::to_string(current_particle_count));
+}
+
+void Application::select_nbody_permutation()
+{
+	// The Barnes-Hut kernel has no permutations.
+	if (nbody_kernel == NBODY_BARNES_HUT_KERNEL) {
+		if (nbody_autotune_active) release_nbody_autotune();
+		nbody_autotune_requested = false;
+		return;
+	}
+
+	// The results belong to the driver the programs are built with.
+	if (!permutation_tuner.is_loaded() && program_cache.get_driver_hash() != 0) {
+		char name[48];
+		std::snprintf(name, sizeof(name), "autotune_%016llx.txt", static_cast<unsigned long long>(program_cache.get_driver_hash()));
+		permutation_tuner.load(program_cache.get_directory() / name);
+	}
+
+	// A running benchmark measures the selected kernel, so nothing is measured (only the remembered results are applied).
+	const std::string key = get_nbody_tuning_key();
+	const bool can_measure = !benchmark.is_running();
+	if (nbody_autotune_active) {
+		if (can_measure && key == nbody_autotune_key) {
+			continue_nbody_autotune();
+			return;
+		}
+		release_nbody_autotune();
+	}
+	if (!can_measure) nbody_autotune_requested = false;
+	if (!nbody_autotune_requested && key == nbody_tuned_key) return;
+
+	std::vector<int> parameters;
+	if (!nbody_autotune_requested && permutation_tuner.find(key, parameters) && parameters.size() == 2) {
+		nbody_workgroup_size_index = glm::clamp(parameters[0], 0, static_cast<int>(IM_ARRAYSIZE(NBODY_WORKGROUP_SIZES)) - 1);
+		nbody_unroll_index = glm::clamp(parameters[1], 0, static_cast<int>(IM_ARRAYSIZE(NBODY_UNROLL_FACTORS)) - 1);
+	}
+	else if (nbody_autotune_requested || (nbody_autotune && can_measure)) {
+		// The key is taken once the measurement finishes.
+		nbody_autotune_requested = false;
+		begin_nbody_autotune(key);
+		return;
+	}
+	nbody_autotune_requested = false;
+	nbody_tuned_key = key;
+}
+
+void Application::begin_nbody_autotune(const std::string& key)
+{
+	const int kernel = nbody_kernel;
+	const std::filesystem::path path = lecture_shaders_path / ((kernel == NBODY_SHARED_KERNEL) ? "nbody_shared.comp" : "nbody.comp");
+
+	// All permutations (only the workgroup sizes for the naive kernel), the selected one is measured first.
+	nbody_autotune_permutations = { glm::ivec2(nbody_workgroup_size_index, nbody_unroll_index) };
+	for (int size = 0; size < IM_ARRAYSIZE(NBODY_WORKGROUP_SIZES); size++) {
+		for (int unroll = 0; unroll < IM_ARRAYSIZE(NBODY_UNROLL_FACTORS); unroll++) {
+			if (kernel != NBODY_SHARED_KERNEL && unroll != nbody_unroll_index) continue;
+			if (glm::ivec2(size, unroll) != nbody_autotune_permutations.front()) nbody_autotune_permutations.push_back(glm::ivec2(size, unroll));
+		}
+	}
+
+	// Builds them all at once, so the driver compiles them in parallel (or loads the ones measured before from the cache).
+	for (const glm::ivec2& permutation : nbody_autotune_permutations) {
+		nbody_autotune_programs.push_back(std::make_unique<CachedShaderProgram>());
+		program_cache.add(*nbody_autotune_programs.back(), { path }, get_nbody_defines(kernel, NBODY_WORKGROUP_SIZES[permutation.x], NBODY_UNROLL_FACTORS[permutation.y]));
+	}
+	program_cache.build();
+
+	// Each permutation has its own query and its own slot for the checked velocity, they are all read at the end.
+	const int permutation_count = static_cast<int>(nbody_autotune_permutations.size());
+	nbody_autotune_queries.resize(permutation_count);
+	glCreateQueries(GL_TIME_ELAPSED, permutation_count, nbody_autotune_queries.data());
+	glCreateBuffers(1, &nbody_autotune_velocities_buffer);
+	glNamedBufferStorage(nbody_autotune_velocities_buffer, sizeof(glm::vec4) * permutation_count, nullptr, 0);
+
+	// The cost grows with the square of the count, so larger counts are measured on their first particles only.
+	nbody_autotune_active = true;
+	nbody_autotune_key = key;
+	nbody_autotune_kernel = kernel;
+	nbody_autotune_particle_count = std::min(current_particle_count, nbody_autotune_max_count);
+	nbody_autotune_next = 0;
+}
+
+void Application::continue_nbody_autotune()
+{
+	const int permutation_count = static_cast<int>(nbody_autotune_permutations.size());
+	if (nbody_autotune_next < permutation_count) {
+		measure_nbody_permutation(nbody_autotune_next);
+		nbody_autotune_next++;
+		if (nbody_autotune_next == permutation_count) {
+			nbody_autotune_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+		return;
+	}
+
+	// Reads the results once all permutations are done, checking the fence without waiting.
+	const GLenum status = glClientWaitSync(nbody_autotune_fence, 0, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+	finish_nbody_autotune();
+}
+
+void Application::measure_nbody_permutation(int permutation)
+{
+	// The permutations that failed to build are rejected when the results are read.
+	CachedShaderProgram& program = *nbody_autotune_programs[permutation];
+	if (program.get_program() == 0) return;
+
+	const int kernel = nbody_autotune_kernel;
+	const int count = nbody_autotune_particle_count;
+	const int workgroup_size = NBODY_WORKGROUP_SIZES[nbody_autotune_permutations[permutation].x];
+	const float time_step = get_simulation_step();
+
+	// The kernels update the velocities in place, they are restored after the dispatches. The written positions are
+	// overwritten by the next simulation step.
+	const GLsizeiptr velocities_size = sizeof(glm::vec4) * count;
+	glCopyNamedBufferSubData(particle_velocities_buffer, bh_saved_velocities_buffer, 0, 0, velocities_size);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particle_positions_buffer[current_read]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, particle_positions_buffer[current_write]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, particle_velocities_buffer);
+	if (nbody_packed_positions) {
+		nbody_pack_program.use();
+		nbody_pack_program.uniform("current_particle_count", count);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, nbody_packed_positions_buffer);
+		glDispatchCompute((count + local_size_x - 1) / local_size_x, 1, 1);
+	}
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// The first dispatch is not timed, the velocity of the last particle (past the last whole group) it leaves is
+	// compared with the selected permutation.
+	run_nbody_program(program, kernel, workgroup_size, time_step, count);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	const GLintptr last_offset = sizeof(glm::vec4) * std::max(count - 1, 0);
+	glCopyNamedBufferSubData(particle_velocities_buffer, nbody_autotune_velocities_buffer, last_offset, sizeof(glm::vec4) * permutation, sizeof(glm::vec4));
+	glCopyNamedBufferSubData(bh_saved_velocities_buffer, particle_velocities_buffer, 0, 0, velocities_size);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glBeginQuery(GL_TIME_ELAPSED, nbody_autotune_queries[permutation]);
+	for (int step = 0; step < nbody_autotune_steps; step++) {
+		run_nbody_program(program, kernel, workgroup_size, time_step, count);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+	glEndQuery(GL_TIME_ELAPSED);
+
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glCopyNamedBufferSubData(bh_saved_velocities_buffer, particle_velocities_buffer, 0, 0, velocities_size);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void Application::finish_nbody_autotune()
+{
+	// The GPU has finished, so neither the velocities nor the queries wait.
+	const int permutation_count = static_cast<int>(nbody_autotune_permutations.size());
+	std::vector<glm::vec4> velocities(permutation_count);
+	glGetNamedBufferSubData(nbody_autotune_velocities_buffer, 0, sizeof(glm::vec4) * permutation_count, velocities.data());
+
+	glm::vec4 reference_velocity = glm::vec4(0.0f);
+	bool reference_valid = false;
+	int best = 0;
+	float best_time = std::numeric_limits<float>::max();
+	nbody_autotune_count = 0;
+	nbody_autotune_rejected = 0;
+	nbody_autotune_default_time = 0.0f;
+	for (int p = 0; p < permutation_count; p++) {
+		if (nbody_autotune_programs[p]->get_program() == 0) {
+			nbody_autotune_rejected++;
+			continue;
+		}
+
+		const glm::vec4& velocity = velocities[p];
+		if (!reference_valid) {
+			reference_velocity = velocity;
+			reference_valid = true;
+		}
+		else if (glm::length(glm::vec3(velocity - reference_velocity)) > 1e-3f * std::max(glm::length(glm::vec3(reference_velocity)), 1.0f)) {
+			nbody_autotune_rejected++;
+			continue;
+		}
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(nbody_autotune_queries[p], GL_QUERY_RESULT, &elapsed);
+		const float time = static_cast<float>(elapsed) * 1e-6f / nbody_autotune_steps;
+
+		nbody_autotune_count++;
+		if (p == 0) {
+			nbody_autotune_default_time = time;
+		}
+		if (time < best_time) {
+			best_time = time;
+			best = p;
+		}
+	}
+
+	const std::string key = nbody_autotune_key;
+	const int kernel = nbody_autotune_kernel;
+	const int measured_count = nbody_autotune_particle_count;
+	nbody_workgroup_size_index = nbody_autotune_permutations[best].x;
+	nbody_unroll_index = nbody_autotune_permutations[best].y;
+	nbody_autotune_best_time = (nbody_autotune_count > 0) ? best_time : 0.0f;
+	release_nbody_autotune();
+	update_shader_permutations();
+
+	permutation_tuner.store(key, { nbody_workgroup_size_index, nbody_unroll_index });
+	nbody_tuned_key = key;
+
+	std::cout << "---" << std::endl;
+	std::cout << "Autotuned " << NBODY_KERNEL_NAMES[kernel] << " kernel for " << current_particle_count << " particles (measured on "
+		<< measured_count << "): workgroup size " << NBODY_WORKGROUP_SIZES[nbody_workgroup_size_index];
+	if (kernel == NBODY_SHARED_KERNEL) {
+		std::cout << ", unroll " << NBODY_UNROLL_FACTORS[nbody_unroll_index];
+	}
+	std::cout << ", " << nbody_autotune_best_time << " ms per step (was " << nbody_autotune_default_time << " ms), "
+		<< nbody_autotune_count << " measured, " << nbody_autotune_rejected << " rejected" << std::endl;
+}
+
+void Application::release_nbody_autotune()
+{
+	// The measured programs are dropped, the selected permutation is loaded from the binary they stored.
+	for (const auto& program : nbody_autotune_programs) {
+		program_cache.remove(*program);
+	}
+	nbody_autotune_programs.clear();
+	nbody_autotune_permutations.clear();
+
+	glDeleteQueries(static_cast<GLsizei>(nbody_autotune_queries.size()), nbody_autotune_queries.data());
+	nbody_autotune_queries.clear();
+	glDeleteBuffers(1, &nbody_autotune_velocities_buffer);
+	nbody_autotune_velocities_buffer = 0;
+	if (nbody_autotune_fence != nullptr) {
+		glDeleteSync(nbody_autotune_fence);
+		nbody_autotune_fence = nullptr;
+	}
+	nbody_autotune_active = false;
+}
+
+void Application::track_nbody_drift()
+{
+	// Takes the newest measurement of the current generation that arrived.
+	// The generation and the step are stored as the bits of floats.
+	glm::vec4 totals[2];
+	int32_t generation = -1;
+	uint32_t step = 0;
+	const bool arrived = nbody_energy_readback.poll(totals);
+	if (arrived) {
+		std::memcpy(&generation, &totals[0].z, sizeof(generation));
+		std::memcpy(&step, &totals[1].w, sizeof(step));
+	}
+	if (arrived && generation == nbody_drift_generation) {
+		const float energy = totals[0].x + totals[0].y;
+		const glm::vec3 momentum = glm::vec3(totals[1]);
+		if (!nbody_drift_baseline_valid) {
+			nbody_drift_baseline_valid = true;
+			nbody_baseline_energy = energy;
+			nbody_baseline_momentum = momentum;
+			nbody_baseline_step = step;
+		}
+		nbody_energy = energy;
+		nbody_energy_drift = std::abs(energy - nbody_baseline_energy) / std::max(std::abs(nbody_baseline_energy), 1e-12f);
+		nbody_momentum_drift = glm::length(momentum - nbody_baseline_momentum) / static_cast<float>(std::max(current_particle_count, 1));
+		nbody_drift_steps = step - nbody_baseline_step;
+	}
+
+	if (nbody_drift_frame++ % nbody_drift_interval != 0) return;
+	PROFILE_GPU_SCOPE(gpu_profiler, "Energy Measurement");
+
+	// The all-pairs potential costs about as much as one step of the naive kernel.
+	const int group_count = (current_particle_count + local_size_x - 1) / local_size_x;
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particle_positions_buffer[current_read]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, particle_velocities_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 25, nbody_energy_partials_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 26, nbody_energy_totals_buffer);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	nbody_energy_program.use();
+	nbody_energy_program.uniform("current_particle_count", current_particle_count);
+	nbody_energy_program.uniform("acceleration_factor", acceleration_factor);
+	nbody_energy_program.uniform("distance_threshold", distance_threshold);
+	nbody_energy_program.uniform("gravity_model", nbody_gravity_model);
+	nbody_energy_program.uniform("softening", nbody_softening);
+	nbody_energy_program.uniform("reduce_partials", false);
+	glDispatchCompute(group_count, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	nbody_energy_program.uniform("reduce_partials", true);
+	nbody_energy_program.uniform("partial_count", group_count);
+	nbody_energy_program.uniform("generation", nbody_drift_generation);
+	nbody_energy_program.uniform("step_index", static_cast<int>(simulation_step_index));
+	glDispatchCompute(1, 1, 1);
+
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	nbody_energy_readback.request(nbody_energy_totals_buffer, 0);
+}
+
+void Application::reset_nbody_drift()
+{
+	nbody_drift_generation++;
+	nbody_drift_baseline_valid = false;
+	nbody_drift_frame = 0;
+	nbody_energy_drift = 0.0f;
+	nbody_momentum_drift = 0.0f;
+	nbody_drift_steps = 0;
+}
+
+void Application::build_barnes_hut_tree()
+{
+	PROFILE_GPU_SCOPE(gpu_profiler, "Barnes-Hut Tree");
+	const int group_count = (current_particle_count + local_size_x - 1) / local_size_x;
+
+	// Resets the bounding box (min to the largest and max to the smallest ordered value) and the visits of the inner nodes.
+	const GLuint initial_bounds[6] = { 0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu, 0u, 0u, 0u };
+	glNamedBufferSubData(bh_bounds_buffer, 0, sizeof(initial_bounds), initial_bounds);
+	glClearNamedBufferData(bh_visits_buffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particle_positions_buffer[current_read]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, bh_particle_indices_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, bh_bounds_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, bh_particle_keys_buffer);
+
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// Computes the bounding box of all particles.
+	barnes_hut_bounds_program.use();
+	barnes_hut_bounds_program.uniform("current_particle_count", current_particle_count);
+	glDispatchCompute(group_count, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// Computes the Morton code of each particle within the cube around the bounding box.
+	barnes_hut_keys_program.use();
+	barnes_hut_keys_program.uniform("current_particle_count", current_particle_count);
+	glDispatchCompute(group_count, 1, 1);
+
+	// Sorts the particles by their codes, which places the particles of each node next to each other.
+	radix_sort(bh_particle_keys_buffer, bh_particle_indices_buffer, current_particle_count, 30);
+
+	// The sort rebinds the low bindings (through the prefix sum).
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particle_positions_buffer[current_read]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, bh_particle_indices_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, bh_parents_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, bh_links_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, bh_particle_keys_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, bh_sorted_positions_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, bh_nodes_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, bh_visits_buffer);
+
+	// Sorts the positions by their codes.
+	barnes_hut_scatter_program.use();
+	barnes_hut_scatter_program.uniform("current_particle_count", current_particle_count);
+	glDispatchCompute(group_count, 1, 1);
+
+	// Builds the inner nodes from the sorted codes, all of them at once.
+	barnes_hut_build_program.use();
+	barnes_hut_build_program.uniform("current_particle_count", current_particle_count);
+	glDispatchCompute((std::max(current_particle_count - 1, 0) + local_size_x - 1) / local_size_x, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// Computes the centers of mass of the inner nodes, from the bodies up to the root.
+	barnes_hut_reduce_program.use();
+	barnes_hut_reduce_program.uniform("current_particle_count", current_particle_count);
+	glDispatchCompute(group_count, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void Application::check_barnes_hut_accuracy()
+{
+	const int sample_count = std::min(current_particle_count, bh_accuracy_sample_count);
+	const int sample_stride = std::max(current_particle_count / std::max(sample_count, 1), 1);
+	const GLsizeiptr samples_size = sizeof(glm::vec4) * bh_accuracy_sample_count;
+
+	build_barnes_hut_tree();
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particle_positions_buffer[current_read]);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// Evaluates the samples with one kernel, the full precision direct sum serves as the reference.
+	auto run_kernel = [&](int kernel, CachedShaderProgram& program, int slot) {
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 13, bh_sampled_accelerations_buffer, samples_size * slot, samples_size);
+		set_nbody_uniforms(program, kernel, 0.0f, current_particle_count);
+		program.uniform("sample_count", sample_count);
+		program.uniform("sample_stride", sample_stride);
+
+		// One invocation per sample, each of them sums all particles (or traverses the tree).
+		glBeginQuery(GL_TIME_ELAPSED, bh_accuracy_queries[slot]);
+		glDispatchCompute((sample_count + local_size_x - 1) / local_size_x, 1, 1);
+		glEndQuery(GL_TIME_ELAPSED);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	};
+	run_kernel(NBODY_NAIVE_KERNEL, nbody_sampled_program, 0);
+	run_kernel(NBODY_BARNES_HUT_KERNEL, barnes_hut_sampled_program, 1);
+
+	// Both kernels only wrote the samples, nothing needs to be restored.
+	std::vector<glm::vec4> reference(sample_count);
+	std::vector<glm::vec4> estimate(sample_count);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glGetNamedBufferSubData(bh_sampled_accelerations_buffer, 0, sizeof(glm::vec4) * sample_count, reference.data());
+	glGetNamedBufferSubData(bh_sampled_accelerations_buffer, samples_size, sizeof(glm::vec4) * sample_count, estimate.data());
+
+	GLuint64 direct_time = 0;
+	GLuint64 tree_time = 0;
+	glGetQueryObjectui64v(bh_accuracy_queries[0], GL_QUERY_RESULT, &direct_time);
+	glGetQueryObjectui64v(bh_accuracy_queries[1], GL_QUERY_RESULT, &tree_time);
+	bh_direct_time = static_cast<float>(direct_time) * 1e-6f;
+	bh_tree_time = static_cast<float>(tree_time) * 1e-6f;
+
+	// Evaluates the relative error of the accelerations.
+	double error_sum = 0.0;
+	float error_max = 0.0f;
+	for (int i = 0; i < sample_count; i++) {
+		const glm::vec3 reference_acceleration = glm::vec3(reference[i]);
+		const glm::vec3 estimate_acceleration = glm::vec3(estimate[i]);
+		const float error = glm::length(estimate_acceleration - reference_acceleration) / std::max(glm::length(reference_acceleration), 1e-12f);
+		error_sum += error;
+		error_max = std::max(error_max, error);
+	}
+	bh_mean_error = static_cast<float>(error_sum / std::max(sample_count, 1));
+	bh_max_error = error_max;
+
+	std::cout << "---" << std::endl;
+	std::cout << "Barnes-Hut (theta " << bh_theta << ") mean error: " << bh_mean_error * 100.0f << " %, max error: " << bh_max_error * 100.0f << " %" << std::endl;
+	std::cout << "Direct sum: " << bh_direct_time << " ms, Barnes-Hut: " << bh_tree_time << " ms (" << sample_count << " particles)" << std::endl;
+}
+
+void Application::scatter_attractors()
+{
+	for (int i = 0; i < max_attractors; i++) {
+		const glm::vec4 numbers = CounterRng::uniform(random_seed, static_cast<uint32_t>(i), CounterRng::STREAM_ATTRACTOR);
+		if (i >= max_edited_attractors) {
+			attraction_points[i] = CounterRng::inside_sphere(numbers.x, numbers.y, numbers.z, attractor_scatter_radius);
+		}
+		attractor_speeds[i] = 2.0f * numbers.w - 1.0f;
+	}
+	attractors_changed = true;
+}
+
+void Application::animate_attractor_points()
+{
+	if (!animate_attractors && !attractors_changed) return;
+
+	// The positions depend only on the simulation time, so both backends and the restored checkpoints agree.
+	const float seconds = static_cast<float>(simulation_time * 0.001);
+	for (int i = 0; i < attractor_used; i++) {
+		const glm::vec3 point = attraction_points[i];
+		if (!animate_attractors) {
+			animated_attraction_points[i] = point;
+			continue;
+		}
+		const float angle = attractor_speeds[i] * attractor_angular_speed * seconds;
+		const float cos_angle = std::cos(angle);
+		const float sin_angle = std::sin(angle);
+		animated_attraction_points[i] = glm::vec3(cos_angle * point.x + sin_angle * point.z, point.y, cos_angle * point.z - sin_angle * point.x);
+	}
+	attractors_changed = true;
+}
+
+void Application::upload_attractors()
+{
+	if (!attractors_changed) return;
+	attractors_changed = false;
+
+	for (int i = 0; i < attractor_used; i++) {
+		attractor_upload[i] = glm::vec4(animated_attraction_points[i], 1.0f);
+	}
+	glNamedBufferSubData(attractor_buffer, 0, sizeof(glm::vec4) * attractor_used, attractor_upload.data());
+
+	// Every voxel depends on every attractor, the whole field is stale.
+	force_field_stale_slices = force_field_texture_resolution;
+}
+
+void Application::refresh_force_field()
+{
+	PROFILE_GPU_SCOPE(gpu_profiler, "Force Field");
+	const int resolution = FORCE_FIELD_RESOLUTIONS[force_field_resolution_index];
+	int slice_count = std::min(force_field_slices_per_step, force_field_stale_slices);
+
+	if (force_field_texture_resolution != resolution) {
+		// A new field is baked at once, the particles would be pulled by an empty one otherwise.
+		glDeleteTextures(1, &force_field_texture);
+		glCreateTextures(GL_TEXTURE_3D, 1, &force_field_texture);
+		glTextureStorage3D(force_field_texture, 1, GL_RGBA16F, resolution, resolution, resolution);
+		glTextureParameteri(force_field_texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(force_field_texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(force_field_texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(force_field_texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(force_field_texture, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		force_field_texture_resolution = resolution;
+		force_field_next_slice = 0;
+		force_field_stale_slices = resolution;
+		slice_count = resolution;
+	}
+	if (slice_count <= 0) return;
+
+	attractor_field_program.use();
+	attractor_field_program.uniform("attractor_used", attractor_used);
+	attractor_field_program.uniform("resolution", resolution);
+	attractor_field_program.uniform("first_slice", force_field_next_slice);
+	attractor_field_program.uniform("slice_count", slice_count);
+	attractor_field_program.uniform("force_field_min", glm::vec3(-0.5f * force_field_extent));
+	attractor_field_program.uniform("force_field_size", force_field_extent);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 23, attractor_buffer);
+	glBindImageTexture(0, force_field_texture, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+	const int group_count = (resolution + force_field_group_size - 1) / force_field_group_size;
+	glDispatchCompute(group_count, group_count, (slice_count + force_field_group_size - 1) / force_field_group_size);
+
+	// The step samples the field.
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	// Continues with the oldest slices, the refreshes sweep through the field.
+	force_field_next_slice = (force_field_next_slice + slice_count) % resolution;
+	force_field_stale_slices -= slice_count;
+}
+
+void Application::build_spatial_grid()
+{
+	PROFILE_GPU_SCOPE(gpu_profiler, "Spatial Grid");
+	const int group_count = (current_particle_count + local_size_x - 1) / local_size_x;
+	const int table_size = CpuSimulation::get_hash_table_size(current_particle_count);
+
+	// Clears the bucket counts, the extra element receives the total.
+	glClearNamedBufferSubData(grid_cell_starts_buffer, GL_R32UI, 0, sizeof(GLuint) * (table_size + 1), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 20, grid_cell_starts_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 21, grid_particle_keys_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 22, grid_sorted_particles_buffer);
+
+	// Finds the bucket of each particle and counts the particles in each bucket.
+	grid_count_program.use();
+	grid_count_program.uniform("current_particle_count", current_particle_count);
+	grid_count_program.uniform("interaction_radius", fluid_interaction_radius);
+	grid_count_program.uniform("table_size", table_size);
+	bind_particle_streams(grid_count_program, false, false, false);
+	glDispatchCompute(group_count, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// Turns the counts into the bucket ranges.
+	exclusive_scan(grid_cell_starts_buffer, table_size + 1);
+
+	// Sorts the particles by their bucket.
+	grid_scatter_program.use();
+	grid_scatter_program.uniform("current_particle_count", current_particle_count);
+	bind_particle_streams(grid_scatter_program, false, false, false);
+	glDispatchCompute(group_count, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void Application::prepare_scan_buffers(int max_count)
+{
+	// Each level of the scan needs one sum per block of the level below.
+	int count = max_count;
+	while (count > 1) {
+		count = (count + scan_block_size - 1) / scan_block_size;
+
+		GLuint block_sums_buffer;
+		glCreateBuffers(1, &block_sums_buffer);
+		glNamedBufferStorage(block_sums_buffer, sizeof(GLuint) * count, nullptr, 0);
+		scan_block_sums_buffers.push_back(block_sums_buffer);
+	}
+}
+
+void Application::exclusive_scan(GLuint buffer, int count, int level)
+{
+	const int block_count = (count + scan_block_size - 1) / scan_block_size;
+	const GLuint block_sums_buffer = scan_block_sums_buffers[level];
+
+	// Scans each block and stores the block totals.
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, block_sums_buffer);
+	prefix_sum_program.use();
+	prefix_sum_program.uniform("element_count", count);
+	glDispatchCompute(block_count, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	if (block_count > 1) {
+		// Scans the block totals and adds them back to the blocks.
+		exclusive_scan(block_sums_buffer, block_count, level + 1);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, block_sums_buffer);
+		prefix_sum_add_program.use();
+		prefix_sum_add_program.uniform("element_count", count);
+		glDispatchCompute(block_count, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+}
+
+void Application::prepare_sort_buffers(int max_count)
+{
+	// The digit counts are stored digit by digit for each work group of the count and scatter passes.
+	const int group_count = (max_count + local_size_x - 1) / local_size_x;
+
+	glCreateBuffers(1, &sort_keys_buffer);
+	glCreateBuffers(1, &sort_values_buffer);
+	glCreateBuffers(1, &sort_keys_alt_buffer);
+	glCreateBuffers(1, &sort_values_alt_buffer);
+	glCreateBuffers(1, &sort_digit_counts_buffer);
+	glNamedBufferStorage(sort_keys_buffer, sizeof(GLuint) * max_count, nullptr, 0);
+	glNamedBufferStorage(sort_values_buffer, sizeof(GLuint) * max_count, nullptr, 0);
+	glNamedBufferStorage(sort_keys_alt_buffer, sizeof(GLuint) * max_count, nullptr, 0);
+	glNamedBufferStorage(sort_values_alt_buffer, sizeof(GLuint) * max_count, nullptr, 0);
+	glNamedBufferStorage(sort_digit_counts_buffer, sizeof(GLuint) * radix_digit_count * group_count, nullptr, 0);
+	glCreateQueries(GL_TIME_ELAPSED, 2, sort_benchmark_queries);
+}
+
+void Application::radix_sort(GLuint keys, GLuint values, int count, int key_bits)
+{
+	PROFILE_GPU_SCOPE(gpu_profiler, "Radix Sort");
+	const int group_count = (count + local_size_x - 1) / local_size_x;
+	const int pass_count = (key_bits + radix_digit_bits - 1) / radix_digit_bits;
+
+	// Each pass moves the keys and the values into the other pair of buffers.
+	GLuint keys_in = keys, values_in = values;
+	GLuint keys_out = (keys == sort_keys_alt_buffer) ? sort_keys_buffer : sort_keys_alt_buffer;
+	GLuint values_out = (values == sort_values_alt_buffer) ? sort_values_buffer : sort_values_alt_buffer;
+
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	for (int pass = 0; pass < pass_count; pass++) {
+		const int shift = pass * radix_digit_bits;
+
+		// Counts the digits of each group, their prefix sum is where each group writes each digit.
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 30, keys_in);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 34, sort_digit_counts_buffer);
+		radix_count_program.use();
+		radix_count_program.uniform("element_count", count);
+		radix_count_program.uniform("shift", shift);
+		glDispatchCompute(group_count, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		exclusive_scan(sort_digit_counts_buffer, radix_digit_count * group_count);
+
+		// Scatters the keys and the values, stable within each digit.
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 30, keys_in);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 31, values_in);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 32, keys_out);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 33, values_out);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 34, sort_digit_counts_buffer);
+		radix_scatter_program.use();
+		radix_scatter_program.uniform("element_count", count);
+		radix_scatter_program.uniform("shift", shift);
+		glDispatchCompute(group_count, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		std::swap(keys_in, keys_out);
+		std::swap(values_in, values_out);
+	}
+
+	// An odd number of passes ends in the other buffers.
+	if (keys_in != keys) {
+		glCopyNamedBufferSubData(keys_in, keys, 0, 0, sizeof(GLuint) * count);
+		glCopyNamedBufferSubData(values_in, values, 0, 0, sizeof(GLuint) * count);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+}
+
+void Application::compute_sort_keys(int key_mode)
+{
+	const int group_count = (current_particle_count + local_size_x - 1) / local_size_x;
+
+	sort_keys_program.use();
+	sort_keys_program.uniform("current_particle_count", current_particle_count);
+	sort_keys_program.uniform("nbody_positions", display_mode == DISPLAY_NBODY_SCENE);
+	sort_keys_program.uniform("skip_dead", display_mode == DISPLAY_PULSATING_SCENE);
+	sort_keys_program.uniform("use_visible_list", key_mode == SORT_KEYS_DEPTH && frustum_culling);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 35, cull_visible_list_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 37, cull_counters_buffer);
+	if (display_mode == DISPLAY_NBODY_SCENE) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particle_positions_buffer[current_read]);
+	}
+	else {
+		bind_particle_streams(sort_keys_program, false, false, true);
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, bh_bounds_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 30, sort_keys_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 31, sort_values_buffer);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	if (key_mode == SORT_KEYS_MORTON) {
+		// The Morton codes are relative to the bounding box, computed the same way as for the Barnes-Hut tree.
+		const GLuint initial_bounds[6] = { 0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu, 0u, 0u, 0u };
+		glNamedBufferSubData(bh_bounds_buffer, 0, sizeof(initial_bounds), initial_bounds);
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+		sort_keys_program.uniform("key_mode", SORT_KEYS_BOUNDS);
+		glDispatchCompute(group_count, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	sort_keys_program.uniform("key_mode", key_mode);
+	glDispatchCompute(group_count, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void Application::permute_particle_stream(GLuint stream, int stride, int offset, int word_count)
+{
+	const int group_count = (current_particle_count + local_size_x - 1) / local_size_x;
+
+	// The Barnes-Hut accuracy check only uses its copy of the velocities temporarily, so it also serves as the scratch (16 bytes per particle).
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 27, sort_values_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 28, stream);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 29, bh_saved_velocities_buffer);
+	particle_permute_program.use();
+	particle_permute_program.uniform("element_count", current_particle_count);
+	particle_permute_program.uniform("stride", stride);
+	particle_permute_program.uniform("offset", offset);
+	particle_permute_program.uniform("word_count", word_count);
+
+	particle_permute_program.uniform("copy_back", false);
+	glDispatchCompute(group_count, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	particle_permute_program.uniform("copy_back", true);
+	glDispatchCompute(group_count, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void Application::reorder_particles()
+{
+	PROFILE_GPU_SCOPE(gpu_profiler, "Morton Reordering");
+	compute_sort_keys(SORT_KEYS_MORTON);
+	radix_sort(sort_keys_buffer, sort_values_buffer, current_particle_count, 30);
+
+	if (display_mode == DISPLAY_NBODY_SCENE) {
+		// The positions are gathered straight into the write buffer, which becomes the read buffer.
+		const int group_count = (current_particle_count + local_size_x - 1) / local_size_x;
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 27, sort_values_buffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 28, particle_positions_buffer[current_read]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 29, particle_positions_buffer[current_write]);
+		particle_permute_program.use();
+		particle_permute_program.uniform("element_count", current_particle_count);
+		particle_permute_program.uniform("stride", 4);
+		particle_permute_program.uniform("offset", 0);
+		particle_permute_program.uniform("word_count", 4);
+		particle_permute_program.uniform("copy_back", false);
+		glDispatchCompute(group_count, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		std::swap(current_read, current_write);
+
+		permute_particle_stream(particle_velocities_buffer, 4, 0, 4);
+		permute_particle_stream(particle_colors_buffer, 3, 0, 3);
+	}
+	else if (particle_layout == PARTICLE_LAYOUT_AOS) {
+		// The structures are moved one vec4 at a time, so the scratch is never larger than 16 bytes per particle.
+		const int particle_words = sizeof(Particle) / sizeof(GLuint);
+		for (int offset = 0; offset < particle_words; offset += 4) {
+			permute_particle_stream(particle_buffer, particle_words, offset, 4);
+		}
+	}
+	else {
+		const int vector_words = half_precision_streams ? 2 : 3;
+		permute_particle_stream(particle_position_stream, 3, 0, 3);
+		permute_particle_stream(particle_velocity_stream, vector_words, 0, vector_words);
+		permute_particle_stream(particle_color_stream, vector_words, 0, vector_words);
+		permute_particle_stream(particle_lifetime_stream, 2, 0, 2);
+	}
+
+	if (display_mode == DISPLAY_PARTICLE_SURFACE_ESTIMATOR_SCENE) {
+		permute_particle_stream(surface_target_buffer, 4, 0, 4);
+	}
+	if (display_mode == DISPLAY_PULSATING_SCENE) {
+		// The lists refer to the old indices.
+		compact_particles();
+	}
+	glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void Application::sort_particles_by_depth()
+{
+	PROFILE_GPU_SCOPE(gpu_profiler, "Depth Sort");
+	compute_sort_keys(SORT_KEYS_DEPTH);
+	radix_sort(sort_keys_buffer, sort_values_buffer, current_particle_count, 32);
+
+	// The geometry shader path reads the order as the element buffer.
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT);
+}
+
+void Application::cull_particles()
+{
+	PROFILE_GPU_SCOPE(gpu_profiler, "Culling");
+	const int group_count = (current_particle_count + local_size_x - 1) / local_size_x;
+
+	// Clears the list sizes, the cull appends to both lists.
+	glClearNamedBufferSubData(cull_counters_buffer, GL_R32UI, 0, 2 * sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+	particle_cull_program.use();
+	particle_cull_program.uniform("current_particle_count", current_particle_count);
+	particle_cull_program.uniform("nbody_positions", display_mode == DISPLAY_NBODY_SCENE);
+	particle_cull_program.uniform("skip_dead", display_mode == DISPLAY_PULSATING_SCENE);
+	particle_cull_program.uniform("particle_size_vs", particle_size);
+	particle_cull_program.uniform("viewport_height", static_cast<float>(particle_target_height));
+	particle_cull_program.uniform("lod_pixel_size", lod_pixel_size);
+	particle_cull_program.uniform("billboard_mode", billboard_mode);
+	if (display_mode == DISPLAY_NBODY_SCENE) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particle_positions_buffer[current_read]);
+	}
+	else {
+		bind_particle_streams(particle_cull_program, false, false, true);
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 35, cull_visible_list_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 36, cull_point_list_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 37, cull_counters_buffer);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	particle_cull_program.uniform("write_draw_args", false);
+	glDispatchCompute(group_count, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// Writes the arguments of the indirect draws from the final counts.
+	particle_cull_program.uniform("write_draw_args", true);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	// The counts for the UI.
+	cull_count_readback.request(cull_counters_buffer, 0);
+	cull_count_readback.poll(cull_counts);
+}
+
+void Application::measure_sort_throughput()
+{
+	const int count = std::max(current_particle_count, 1);
+
+	// Random keys from the counter-based generator and the identity as the values.
+	std::vector<GLuint> keys(count);
+	std::vector<GLuint> values(count);
+	for (int i = 0; i < count; i++) {
+		keys[i] = CounterRng::pcg4d(glm::uvec4(static_cast<uint32_t>(i), 0u, CounterRng::STREAM_SORT_KEYS, random_seed)).x;
+		values[i] = static_cast<GLuint>(i);
+	}
+
+	float times[2] = { 0.0f, 0.0f };
+	const int key_bits[2] = { 32, 30 };
+	std::vector<GLuint> sorted(count);
+	sort_benchmark_valid = true;
+	for (int i = 0; i < 2; i++) {
+		particle_uploader.upload(sort_keys_buffer, 0, keys.data(), sizeof(GLuint) * count);
+		particle_uploader.upload(sort_values_buffer, 0, values.data(), sizeof(GLuint) * count);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		// The query measures only the GPU time of the sort, the uploads before it need not be finished.
+		glBeginQuery(GL_TIME_ELAPSED, sort_benchmark_queries[i]);
+		radix_sort(sort_keys_buffer, sort_values_buffer, count, key_bits[i]);
+		glEndQuery(GL_TIME_ELAPSED);
+
+		// Checks the order of the sorted bits and that the values still belong to their keys.
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glGetNamedBufferSubData(sort_keys_buffer, 0, sizeof(GLuint) * count, sorted.data());
+		const GLuint mask = (key_bits[i] == 32) ? 0xFFFFFFFFu : ((1u << key_bits[i]) - 1u);
+		for (int j = 1; j < count; j++) {
+			if ((sorted[j - 1] & mask) > (sorted[j] & mask)) {
+				sort_benchmark_valid = false;
+				break;
+			}
+		}
+		GLuint last_value = 0;
+		glGetNamedBufferSubData(sort_values_buffer, sizeof(GLuint) * (count - 1), sizeof(GLuint), &last_value);
+		if (last_value >= static_cast<GLuint>(count) || keys[last_value] != sorted[count - 1]) {
+			sort_benchmark_valid = false;
+		}
+	}
+
+	// The sorts are done (their keys were read back), so the results are available without waiting.
+	for (int i = 0; i < 2; i++) {
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(sort_benchmark_queries[i], GL_QUERY_RESULT, &elapsed);
+		times[i] = static_cast<float>(elapsed) * 1e-6f;
+	}
+
+	sort_benchmark_count = count;
+	sort_time_32 = times[0];
+	sort_time_30 = times[1];
+
+	std::cout << "---" << std::endl;
+	std::cout << "Radix sort of " << count << " keys: " << sort_time_32 << " ms (32 bits), " << sort_time_30 << " ms (30 bits)"
+		<< (sort_benchmark_valid ? "" : ", NOT SORTED") << std::endl;
+}
+
+// Update
+void Application::update(float delta) {
+	// The frame starts with the update, the GPU sections of the earlier frames are collected meanwhile.
+	Profiler::get().begin_frame();
+	gpu_profiler.begin_frame();
+	PROFILE_SCOPE("Update");
+
+	PV227Application::update(delta);
+
+	// Updates the main camera.
+	const glm::vec3 eye_position = camera.get_eye_position();
+	camera_ubo.set_view(lookAt(eye_position, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+	camera_ubo.update_opengl_data();
+
+	// Updates the global time delta.
+	t_delta = delta;
+
+	if (benchmark.is_running()) {
+		begin_benchmark_frame();
+	}
+
+	if (parity_check_requested) {
+		parity_check_requested = false;
+		check_gpu_parity();
+	}
+
+	if (sort_benchmark_requested) {
+		sort_benchmark_requested = false;
+		measure_sort_throughput();
+	}
+
+	// Rebuilds the programs whose permutation changed, the N-Body kernels first select the tuned one.
+	if (display_mode == DISPLAY_NBODY_SCENE && simulation_backend == SIMULATION_BACKEND_GPU) {
+		select_nbody_permutation();
+	}
+	else if (nbody_autotune_active) {
+		release_nbody_autotune();
+	}
+	update_shader_permutations();
+
+	if (checkpoint_save_requested) {
+		checkpoint_save_requested = false;
+		save_checkpoint();
+	}
+	if (checkpoint_restore_requested) {
+		checkpoint_restore_requested = false;
+		restore_checkpoint();
+	}
+
+	// Swaps in the selected model when it is ready.
+	poll_model();
+
+	// Advances the simulation by whole fixed steps, the remainder is carried over to the next frame.
+	const float step_duration = 1000.0f / static_cast<float>(simulation_rate);
+	simulation_accumulator += delta;
+	simulation_steps = static_cast<int>(simulation_accumulator / step_duration);
+	if (benchmark.is_running()) {
+		// The benchmark measures exactly one step per frame, independently of how long the frames take.
+		simulation_steps = 1;
+		simulation_accumulator = 0.0f;
+	}
+	else if (simulation_steps > max_substeps) {
+		// Drops the time the simulation cannot catch up with instead of spiralling into ever longer frames.
+		simulation_steps = max_substeps;
+		simulation_accumulator = 0.0f;
+	}
+	else {
+		simulation_accumulator -= simulation_steps * step_duration;
+	}
+
+	if (simulation_steps == 0) {
+		return;
+	}
+
+	if (simulation_backend == SIMULATION_BACKEND_CPU) {
+		update_particles_cpu(simulation_steps);
+	}
+	else {
+		update_particles_gpu(simulation_steps);
+	}
+
+	if (display_mode == DISPLAY_PULSATING_SCENE) {
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		alive_count_readback.request(list_counters_buffer, 0);
+		alive_count_readback.poll(&alive_particle_count);
+	}
+	if (display_mode == DISPLAY_NBODY_SCENE && nbody_track_drift) {
+		track_nbody_drift();
+	}
+}
+
+// Update Particles on CPU
+void Application::update_particles_cpu(int step_count)
+{
+	PROFILE_GPU_SCOPE(gpu_profiler, "CPU Simulation");
+	const auto start = std::chrono::high_resolution_clock::now();
+	for (int step = 0; step < step_count; step++) {
+		simulation_time += 1000.0 / simulation_rate;
+		simulation_step_index++;
+		simulate_particles_cpu();
+		if (display_mode == DISPLAY_NBODY_SCENE) {
+			std::swap(current_read, current_write);
+		}
+	}
+	const auto end = std::chrono::high_resolution_clock::now();
+	cpu_step_time = std::chrono::duration<float, std::milli>(end - start).count();
+
+	// Uploads the new state once per frame, the shaders only read it.
+	if (display_mode == DISPLAY_NBODY_SCENE) {
+		particle_uploader.upload(particle_positions_buffer[current_read], 0, particle_positions[current_read].data(), sizeof(glm::vec4) * current_particle_count);
+		particle_uploader.upload(particle_velocities_buffer, 0, particle_velocities.data(), sizeof(glm::vec4) * current_particle_count);
+	}
+	else {
+		upload_particles_buffer(0, current_particle_count);
+	}
+
+	if (display_mode == DISPLAY_PULSATING_SCENE) {
+		compact_particles();
+	}
+}
+
+void Application::simulate_particles_cpu()
+{
+	const float time = static_cast<float>(simulation_time);
+	const float delta = get_simulation_step();
+
+	if (display_mode == DISPLAY_PULSATING_SCENE) {
+		cpu_simulation.update_pulsating(particles.data(), current_particle_count, time, delta, random_seed, simulation_step_index, get_emission_count());
+	}
+	else if (display_mode == DISPLAY_SINGLE_ATTRACTOR_SCENE) {
+		cpu_simulation.update_attracting(particles.data(), current_particle_count, delta, attraction_points[0], attraction_force, random_seed);
+	}
+	else if (display_mode == DISPLAY_MULTI_ATTRACTOR_SCENE) {
+		// The CPU backend always sums over all attractors, it does not use the baked force field.
+		animate_attractor_points();
+		cpu_simulation.update_multi_attracting(particles.data(), current_particle_count, delta, animated_attraction_points.data(), attractor_used, attraction_force, random_seed);
+	}
+	else if (display_mode == DISPLAY_NBODY_SCENE) {
+		cpu_simulation.update_nbody(particle_positions[current_read].data(), particle_positions[current_write].data(), particle_velocities.data(),
+			current_particle_count, delta, acceleration_factor, distance_threshold, nbody_gravity_model, nbody_softening, nbody_integrator);
+	}
+	else if (display_mode == DISPLAY_PARTICLE_SURFACE_ESTIMATOR_SCENE) {
+		cpu_simulation.update_surface_estimator(particles.data(), current_particle_count, delta, mesh, mesh_generation, surface_attraction_force, random_seed);
+	}
+	else if (display_mode == DISPLAY_FLUID_SCENE) {
+		cpu_simulation.update_fluid(particles.data(), current_particle_count, delta, fluid_interaction_radius, fluid_repulsion, fluid_cohesion, fluid_containment);
+	}
+}
+
+void Application::download_particles_buffer()
+{
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	if (display_mode == DISPLAY_NBODY_SCENE) {
+		// The last written positions are in the read buffer, the indices are swapped after rendering.
+		glGetNamedBufferSubData(particle_positions_buffer[current_read], 0, sizeof(glm::vec4) * current_particle_count, particle_positions[current_read].data());
+		glGetNamedBufferSubData(particle_velocities_buffer, 0, sizeof(glm::vec4) * current_particle_count, particle_velocities.data());
+	}
+	else if (particle_layout == PARTICLE_LAYOUT_AOS) {
+		glGetNamedBufferSubData(particle_buffer, 0, sizeof(Particle) * current_particle_count, particles.data());
+	}
+	else {
+		// Merges the streams back into the particles.
+		const int vector_words = half_precision_streams ? 2 : 3;
+		std::vector<float> positions(3 * current_particle_count);
+		std::vector<GLuint> velocities(vector_words * current_particle_count);
+		std::vector<GLuint> colors(vector_words * current_particle_count);
+		std::vector<glm::vec2> lifetimes(current_particle_count);
+
+		glGetNamedBufferSubData(particle_position_stream, 0, sizeof(float) * positions.size(), positions.data());
+		glGetNamedBufferSubData(particle_velocity_stream, 0, sizeof(GLuint) * velocities.size(), velocities.data());
+		glGetNamedBufferSubData(particle_color_stream, 0, sizeof(GLuint) * colors.size(), colors.data());
+		glGetNamedBufferSubData(particle_lifetime_stream, 0, sizeof(glm::vec2) * lifetimes.size(), lifetimes.data());
+
+		for (int i = 0; i < current_particle_count; i++) {
+			Particle& particle = particles[i];
+			particle.position = glm::vec4(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2], 1.0f);
+			particle.lifetime = lifetimes[i].x;
+			particle.remaining = lifetimes[i].y;
+
+			if (half_precision_streams) {
+				particle.velocity = glm::vec3(glm::unpackHalf2x16(velocities[2 * i]), glm::unpackHalf2x16(velocities[2 * i + 1]).x);
+				particle.color = glm::vec3(glm::unpackHalf2x16(colors[2 * i]), glm::unpackHalf2x16(colors[2 * i + 1]).x);
+			}
+			else {
+				std::memcpy(glm::value_ptr(particle.velocity), &velocities[3 * i], 3 * sizeof(float));
+				std::memcpy(glm::value_ptr(particle.color), &colors[3 * i], 3 * sizeof(float));
+			}
+		}
+	}
+}
+
+void Application::check_gpu_parity()
+{
+	download_particles_buffer();
+
+	float position_error = 0.0f;
+	float velocity_error = 0.0f;
+
+	if (display_mode == DISPLAY_NBODY_SCENE) {
+		const std::vector<glm::vec4> initial_velocities(particle_velocities.begin(), particle_velocities.begin() + current_particle_count);
+
+		// One GPU step with the full precision direct-sum kernel, which is what the CPU computes (the selected permutation
+		// may read the half precision positions).
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particle_positions_buffer[current_read]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, particle_positions_buffer[current_write]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, particle_velocities_buffer);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		run_nbody_program(nbody_reference_program, NBODY_NAIVE_KERNEL, local_size_x, get_simulation_step(), current_particle_count);
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+		std::vector<glm::vec4> gpu_positions(current_particle_count);
+		std::vector<glm::vec4> gpu_velocities(current_particle_count);
+		glGetNamedBufferSubData(particle_positions_buffer[current_write], 0, sizeof(glm::vec4) * current_particle_count, gpu_positions.data());
+		glGetNamedBufferSubData(particle_velocities_buffer, 0, sizeof(glm::vec4) * current_particle_count, gpu_velocities.data());
+
+		// Restores the velocities so that the GPU state stays consistent.
+		particle_uploader.upload(particle_velocities_buffer, 0, initial_velocities.data(), sizeof(glm::vec4) * current_particle_count);
+
+		simulate_particles_cpu();
+		for (int i = 0; i < current_particle_count; i++) {
+			position_error = std::max(position_error, glm::length(gpu_positions[i] - particle_positions[current_write][i]));
+			velocity_error = std::max(velocity_error, glm::length(gpu_velocities[i] - particle_velocities[i]));
+		}
+		std::copy(initial_velocities.begin(), initial_velocities.end(), particle_velocities.begin());
+	}
+	else {
+		const std::vector<Particle> initial(particles.begin(), particles.begin() + current_particle_count);
+		const double initial_time = simulation_time;
+		const uint32_t initial_step_index = simulation_step_index;
+
+		// One GPU step of the scene's compute pass, the CPU step below uses the same (already advanced) time. The reordering
+		// is skipped, as it would change the order of the GPU particles only.
+		const bool reordering = morton_reordering;
+		morton_reordering = false;
+		dispatch_simulation_step();
+		morton_reordering = reordering;
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+		download_particles_buffer();
+		const std::vector<Particle> gpu_particles(particles.begin(), particles.begin() + current_particle_count);
+
+		std::copy(initial.begin(), initial.end(), particles.begin());
+		simulate_particles_cpu();
+		for (int i = 0; i < current_particle_count; i++) {
+			position_error = std::max(position_error, glm::length(gpu_particles[i].position - particles[i].position));
+			velocity_error = std::max(velocity_error, glm::length(gpu_particles[i].velocity - particles[i].velocity));
+		}
+
+		// Restores the state before the check, so that the simulation is not advanced outside its clock. The lists of the
+		// pulsating scene are rebuilt from the restored lifetimes.
+		std::copy(initial.begin(), initial.end(), particles.begin());
+		upload_particles_buffer(0, current_particle_count);
+		simulation_time = initial_time;
+		simulation_step_index = initial_step_index;
+		if (display_mode == DISPLAY_PULSATING_SCENE) {
+			compact_particles();
+		}
+	}
+
+	parity_position_error = position_error;
+	parity_velocity_error = velocity_error;
+
+	std::cout << "---" << std::endl;
+	std::cout << "GPU/CPU parity of " << DISPLAY_NAMES[display_mode] << " (" << current_particle_count << " particles)" << std::endl;
+	std::cout << "Max position error: " << parity_position_error << ", max velocity error: " << parity_velocity_error << std::endl;
+}
+
+bool Application::save_checkpoint()
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	CheckpointHeader header{};
+	header.display_mode = display_mode;
+	header.particle_count = current_particle_count;
+	header.current_read = current_read;
+	header.simulation_time = simulation_time;
+	header.random_seed = random_seed;
+	header.step_index = simulation_step_index;
+	header.attractor_used = attractor_used;
+	header.attraction_force = attraction_force;
+	for (int i = 0; i < max_edited_attractors; i++) {
+		header.attraction_points[i][0] = attraction_points[i].x;
+		header.attraction_points[i][1] = attraction_points[i].y;
+		header.attraction_points[i][2] = attraction_points[i].z;
+	}
+	header.nbody_kernel = nbody_kernel;
+	header.acceleration_factor = acceleration_factor;
+	header.distance_threshold = distance_threshold;
+	header.nbody_gravity_model = nbody_gravity_model;
+	header.nbody_softening = nbody_softening;
+	header.nbody_integrator = nbody_integrator;
+	header.bh_theta = bh_theta;
+	header.emission_limit = emission_limit;
+	header.current_model = current_model;
+	header.fluid_interaction_radius = fluid_interaction_radius;
+	header.fluid_repulsion = fluid_repulsion;
+	header.fluid_cohesion = fluid_cohesion;
+	header.fluid_containment = fluid_containment;
+
+	// The CPU arrays are up to date with the CPU backend, otherwise the state is read back from the GPU first.
+	const void* sections[CHECKPOINT_SECTION_COUNT] = { nullptr, nullptr, nullptr, nullptr };
+	uint64_t section_sizes[CHECKPOINT_SECTION_COUNT] = { 0, 0, 0, 0 };
+	if (display_mode == DISPLAY_NBODY_SCENE) {
+		if (simulation_backend == SIMULATION_BACKEND_GPU) {
+			download_particles_buffer();
+			glGetNamedBufferSubData(particle_positions_buffer[current_write], 0, sizeof(glm::vec4) * current_particle_count, particle_positions[current_write].data());
+		}
+		const uint64_t size = sizeof(glm::vec4) * current_particle_count;
+		sections[CHECKPOINT_POSITIONS_0] = particle_positions[0].data();
+		sections[CHECKPOINT_POSITIONS_1] = particle_positions[1].data();
+		sections[CHECKPOINT_VELOCITIES] = particle_velocities.data();
+		section_sizes[CHECKPOINT_POSITIONS_0] = size;
+		section_sizes[CHECKPOINT_POSITIONS_1] = size;
+		section_sizes[CHECKPOINT_VELOCITIES] = size;
+	}
+	else {
+		if (simulation_backend == SIMULATION_BACKEND_GPU) {
+			download_particles_buffer();
+		}
+		sections[CHECKPOINT_PARTICLES] = particles.data();
+		section_sizes[CHECKPOINT_PARTICLES] = sizeof(Particle) * current_particle_count;
+	}
+
+	const bool saved = Checkpoint::write(checkpoint_path, header, sections, section_sizes);
+
+	const auto end = std::chrono::high_resolution_clock::now();
+	checkpoint_time = std::chrono::duration<float, std::milli>(end - start).count();
+
+	std::cout << "---" << std::endl;
+	if (!saved) {
+		std::cerr << "Cannot write the checkpoint " << checkpoint_path.generic_string() << std::endl;
+		return false;
+	}
+	std::cout << "Checkpoint of " << DISPLAY_NAMES[display_mode] << " (" << current_particle_count << " particles) saved into "
+		<< checkpoint_path.generic_string() << " in " << checkpoint_time << " ms." << std::endl;
+	return true;
+}
+
+bool Application::restore_checkpoint()
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	std::cout << "---" << std::endl;
+	const Checkpoint checkpoint(checkpoint_path);
+	if (!checkpoint.is_valid()) {
+		std::cerr << "Cannot read the checkpoint " << checkpoint_path.generic_string() << std::endl;
+		return false;
+	}
+
+	// Rejects the checkpoints this build cannot hold or whose sections do not match the scene.
+	const CheckpointHeader& header = checkpoint.get_header();
+	const int count = header.particle_count;
+	const bool nbody = header.display_mode == DISPLAY_NBODY_SCENE;
+	const bool sections_valid = nbody
+		? checkpoint.get_section_size(CHECKPOINT_POSITIONS_0) == sizeof(glm::vec4) * count
+			&& checkpoint.get_section_size(CHECKPOINT_POSITIONS_1) == sizeof(glm::vec4) * count
+			&& checkpoint.get_section_size(CHECKPOINT_VELOCITIES) == sizeof(glm::vec4) * count
+		: checkpoint.get_section_size(CHECKPOINT_PARTICLES) == sizeof(Particle) * count;
+	if (header.display_mode < 0 || header.display_mode >= IM_ARRAYSIZE(DISPLAY_NAMES) || count <= 0 || count > max_particle_count || !sections_valid
+		|| header.current_model < 0 || header.current_model >= IM_ARRAYSIZE(MODEL_NAMES)) {
+		std::cerr << "The checkpoint " << checkpoint_path.generic_string() << " does not match this build." << std::endl;
+		return false;
+	}
+
+	display_mode = header.display_mode;
+	desired_particle_count = count;
+	current_particle_count = count;
+	current_read = header.current_read & 1;
+	current_write = 1 - current_read;
+	simulation_time = header.simulation_time;
+	random_seed = header.random_seed;
+	simulation_step_index = header.step_index;
+	simulation_accumulator = 0.0f;
+	// The targets are not stored, they are drawn again from the restored seed.
+	clear_surface_targets();
+	attractor_used = glm::clamp(header.attractor_used, 1, max_attractors);
+	attraction_force = header.attraction_force;
+	for (int i = 0; i < max_edited_attractors; i++) {
+		attraction_points[i] = glm::vec3(header.attraction_points[i][0], header.attraction_points[i][1], header.attraction_points[i][2]);
+	}
+	// The other attractors and the orbit speeds follow from the seed.
+	scatter_attractors();
+	nbody_kernel = glm::clamp(header.nbody_kernel, 0, IM_ARRAYSIZE(NBODY_KERNEL_NAMES) - 1);
+	acceleration_factor = header.acceleration_factor;
+	distance_threshold = header.distance_threshold;
+	nbody_gravity_model = glm::clamp(header.nbody_gravity_model, 0, IM_ARRAYSIZE(NBODY_GRAVITY_NAMES) - 1);
+	nbody_softening = header.nbody_softening;
+	nbody_integrator = glm::clamp(header.nbody_integrator, 0, IM_ARRAYSIZE(NBODY_INTEGRATOR_NAMES) - 1);
+	reset_nbody_drift();
+	bh_theta = header.bh_theta;
+	emission_limit = header.emission_limit;
+	fluid_interaction_radius = header.fluid_interaction_radius;
+	fluid_repulsion = header.fluid_repulsion;
+	fluid_cohesion = header.fluid_cohesion;
+	fluid_containment = header.fluid_containment;
+	if (header.current_model != current_model) {
+		current_model = header.current_model;
+		update_model();
+	}
+
+	// The uploads copy straight from the mapped pages, the CPU arrays are only filled when the CPU backend needs them.
+	const bool cpu = simulation_backend == SIMULATION_BACKEND_CPU;
+	if (nbody) {
+		const size_t size = sizeof(glm::vec4) * count;
+		particle_uploader.upload(particle_positions_buffer[0], 0, checkpoint.get_section(CHECKPOINT_POSITIONS_0), size);
+		particle_uploader.upload(particle_positions_buffer[1], 0, checkpoint.get_section(CHECKPOINT_POSITIONS_1), size);
+		particle_uploader.upload(particle_velocities_buffer, 0, checkpoint.get_section(CHECKPOINT_VELOCITIES), size);
+		if (cpu) {
+			std::memcpy(particle_positions[0].data(), checkpoint.get_section(CHECKPOINT_POSITIONS_0), size);
+			std::memcpy(particle_positions[1].data(), checkpoint.get_section(CHECKPOINT_POSITIONS_1), size);
+			std::memcpy(particle_velocities.data(), checkpoint.get_section(CHECKPOINT_VELOCITIES), size);
+		}
+	}
+	else {
+		const size_t size = sizeof(Particle) * count;
+		if (particle_layout == PARTICLE_LAYOUT_AOS) {
+			particle_uploader.upload(particle_buffer, 0, checkpoint.get_section(CHECKPOINT_PARTICLES), size);
+		}
+		// The streams of the structure-of-arrays layout are split from the CPU array.
+		if (cpu || particle_layout == PARTICLE_LAYOUT_SOA) {
+			std::memcpy(particles.data(), checkpoint.get_section(CHECKPOINT_PARTICLES), size);
+		}
+		if (particle_layout == PARTICLE_LAYOUT_SOA) {
+			upload_particles_buffer(0, count);
+		}
+		if (display_mode == DISPLAY_PULSATING_SCENE) {
+			compact_particles();
+		}
+	}
+
+	// The uploads copied the mapped pages into the staging ring, so the mapping can be closed without waiting for the GPU.
+	const auto end = std::chrono::high_resolution_clock::now();
+	checkpoint_time = std::chrono::duration<float, std::milli>(end - start).count();
+
+	std::cout << "Checkpoint of " << DISPLAY_NAMES[display_mode] << " (" << count << " particles) restored from "
+		<< checkpoint_path.generic_string() << " in " << checkpoint_time << " ms." << std::endl;
+	return true;
+}
+
+void Application::start_benchmark()
+{
+	std::vector<int> scenes(IM_ARRAYSIZE(DISPLAY_NAMES));
+	for (int i = 0; i < IM_ARRAYSIZE(DISPLAY_NAMES); i++) {
+		scenes[i] = i;
+	}
+	std::vector<int> billboard_modes = { billboard_mode };
+	if (benchmark_billboards) {
+		billboard_modes = { BILLBOARD_GEOMETRY_SHADER, BILLBOARD_VERTEX_PULLING, BILLBOARD_INSTANCED };
+	}
+
+	benchmark_saved_display_mode = display_mode;
+	benchmark_saved_particle_count = current_particle_count;
+	benchmark_saved_billboard_mode = billboard_mode;
+
+	benchmark.start(scenes, 256, max_particle_count, billboard_modes, benchmark_warmup_frames, benchmark_measured_frames, benchmark_frame_limit);
+
+	std::cout << "---" << std::endl;
+	std::cout << "Benchmark of " << benchmark.get_case_count() << " cases started, writing into " << benchmark_path.generic_string() << "." << std::endl;
+}
+
+void Application::begin_benchmark_frame()
+{
+	benchmark_frame_start = std::chrono::high_resolution_clock::now();
+
+	BenchmarkCase next_case;
+	if (!benchmark.begin_frame(next_case)) return;
+
+	display_mode = next_case.scene;
+	billboard_mode = next_case.billboard_mode;
+	desired_particle_count = next_case.particle_count;
+	current_particle_count = next_case.particle_count;
+	reset_particles();
+
+	std::cout << "Benchmark case " << benchmark.get_case_index() + 1 << " / " << benchmark.get_case_count() << ": " << DISPLAY_NAMES[display_mode]
+		<< ", " << current_particle_count << " particles, " << BILLBOARD_NAMES[billboard_mode] << std::endl;
+
+	// The CPU work of the switch is not part of the frame.
+	benchmark_frame_start = std::chrono::high_resolution_clock::now();
+}
+
+void Application::end_benchmark_frame()
+{
+	const auto end = std::chrono::high_resolution_clock::now();
+	const float cpu_frame_time = std::chrono::duration<float, std::milli>(end - benchmark_frame_start).count();
+	const float compute_time = (simulation_backend == SIMULATION_BACKEND_CPU) ? cpu_step_time : compute_time_gpu;
+	benchmark.end_frame(cpu_frame_time, compute_time, render_timer.get_time());
+
+	if (!benchmark.is_running()) {
+		finish_benchmark();
+	}
+}
+
+void Application::finish_benchmark()
+{
+	const std::vector<std::string> scene_names(std::begin(DISPLAY_NAMES), std::end(DISPLAY_NAMES));
+	const std::vector<std::string> billboard_names(std::begin(BILLBOARD_NAMES), std::end(BILLBOARD_NAMES));
+	const bool written = benchmark.write(benchmark_path, scene_names, billboard_names, SIMULATION_BACKEND_NAMES[simulation_backend],
+		PARTICLE_LAYOUT_NAMES[particle_layout]);
+
+	std::cout << "---" << std::endl;
+	if (written) {
+		std::cout << "Benchmark finished, " << benchmark.get_results().size() << " results written into " << benchmark_path.generic_string() << "." << std::endl;
+	}
+	else {
+		std::cerr << "Cannot write the benchmark results into " << benchmark_path.generic_string() << std::endl;
+	}
+
+	display_mode = benchmark_saved_display_mode;
+	billboard_mode = benchmark_saved_billboard_mode;
+	desired_particle_count = benchmark_saved_particle_count;
+	current_particle_count = benchmark_saved_particle_count;
+	reset_particles();
+}
+
+// Pulsating Simulation (DISPLAY_PULSATING_SCENE)
+void Application::render_pulsating_simulation() {
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	
+	// Writes the draw arguments for the live particles only, the cull pass already wrote them for the visible ones.
+	if (!draw_list_culled) {
+		particle_draw_args_program.use();
+		particle_draw_args_program.uniform("billboard_mode", billboard_mode);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 18, list_counters_buffer);
+		glDispatchCompute(1, 1, 1);
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+	}
+
+	CachedShaderProgram& program = (billboard_mode == BILLBOARD_GEOMETRY_SHADER) ? pulsating_particle_program : pulsating_quad_program;
+	program.use();
+	program.uniform("t_time", (float)elapsed_time);
+	program.uniform("random_seed", static_cast<int>(random_seed));
+	program.uniform("particle_size_vs", particle_size);
+
+	// Binds the particle texture and sets the blending.
+	bind_particle_blending(program);
+
+	// Binds the particle buffer (or the streams the scene draws from) and the list of live particles.
+	bind_particle_streams(program, false, true, true);
+	// The draw list holds the live particles first (the sorted order also holds the dead ones at the end).
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, (draw_list_buffer != 0) ? draw_list_buffer : alive_list_buffer);
+
+	// Renders the live particles.
+	glBindVertexArray(empty_vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw_list_culled ? cull_counters_buffer : list_counters_buffer);
+	draw_particle_billboards(program, true);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+}
+
+// Attracting Simulation (DISPLAY_SINGLE_ATTRACTOR_SCENE)
+void Application::render_attracting_simulation() {
+
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+
+	CachedShaderProgram& program = (billboard_mode == BILLBOARD_GEOMETRY_SHADER) ? attracting_particle_program : attracting_quad_program;
+	program.use();
+	program.uniform("t_time", (float)elapsed_time);
+	program.uniform("random_seed", static_cast<int>(random_seed));
+	program.uniform("particle_size_vs", particle_size);
+
+	// Binds the particle texture and sets the blending.
+	bind_particle_blending(program);
+
+	// Binds the particle buffer (or the streams the scene draws from).
+	bind_particle_streams(program, false, true, false);
+
+	// Renders the particles.
+	glBindVertexArray(empty_vao);
+	draw_particle_billboards(program);
+
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+}
+
+// Attracting Simulation (DISPLAY_MULTI_ATTRACTOR_SCENE)
+void Application::render_multi_attracting_simulation() {
+
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+
+	CachedShaderProgram& program = (billboard_mode == BILLBOARD_GEOMETRY_SHADER) ? multi_attracting_particle_program : multi_attracting_quad_program;
+	program.use();
+	program.uniform("t_time", (float)elapsed_time);
+	program.uniform("random_seed", static_cast<int>(random_seed));
+	program.uniform("particle_size_vs", particle_size);
+
+	// Binds the particle texture and sets the blending.
+	bind_particle_blending(program);
+
+	// Binds the particle buffer (or the streams the scene draws from).
+	bind_particle_streams(program, false, true, false);
+
+	// Renders the particles.
+	glBindVertexArray(empty_vao);
+	draw_particle_billboards(program);
+
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+}
+
+// N-Body Simulation (DISPLAY_NBODY_SCENE)
+void Application::render_nbody_simulation() {
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+
+	CachedShaderProgram& program = (billboard_mode == BILLBOARD_GEOMETRY_SHADER) ? nbody_particle_program : nbody_quad_program;
+	program.use();
+	program.uniform("particle_size_vs", particle_size);
+
+	// Binds the particle texture and sets the blending.
+	bind_particle_blending(program);
+
+	// Binds the particle buffer with the positions of the last step, as vertex attributes or as storage buffers for pulling.
+	glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+	if (billboard_mode == BILLBOARD_GEOMETRY_SHADER) {
+		glBindVertexArray(particle_vao[current_read]);
+	}
+	else {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particle_positions_buffer[current_read]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, particle_colors_buffer);
+		glBindVertexArray(empty_vao);
+	}
+	draw_particle_billboards(program);
+
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+}
+
+void Application::render_surface_estimator() {
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+
+	CachedShaderProgram& program = (billboard_mode == BILLBOARD_GEOMETRY_SHADER) ? particle_surface_estimator_program : surface_estimator_quad_program;
+	program.use();
+	program.uniform("t_time", (float)elapsed_time);
+	program.uniform("random_seed", static_cast<int>(random_seed));
+	program.uniform("particle_size_vs", particle_size);
+
+	// Binds the particle texture and sets the blending.
+	bind_particle_blending(program);
+
+	// Binds the particle buffer (or the streams the scene draws from).
+	bind_particle_streams(program, false, false, false);
+
+	// Renders the particles.
+	glBindVertexArray(empty_vao);
+	draw_particle_billboards(program);
+
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+}
+
+void Application::render_particle_points() {
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+
+	particle_point_program.use();
+	bind_particle_blending(particle_point_program);
+	particle_point_program.uniform("point_intensity", point_intensity);
+	particle_point_program.uniform("nbody_positions", display_mode == DISPLAY_NBODY_SCENE);
+	particle_point_program.uniform("fade_by_lifetime", display_mode == DISPLAY_PULSATING_SCENE);
+	particle_point_program.uniform("use_constant_color", display_mode == DISPLAY_PARTICLE_SURFACE_ESTIMATOR_SCENE);
+	particle_point_program.uniform("constant_color", surface_particle_color);
+
+	if (display_mode == DISPLAY_NBODY_SCENE) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particle_positions_buffer[current_read]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, particle_colors_buffer);
+	}
+	else {
+		bind_particle_streams(particle_point_program, false, true, true);
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 36, cull_point_list_buffer);
+
+	// One vertex per point, the count was written by the cull pass.
+	glBindVertexArray(empty_vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cull_counters_buffer);
+	glDrawArraysIndirect(GL_POINTS, reinterpret_cast<const void*>(16 * sizeof(GLuint)));
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+}
+
+void Application::composite_particles() {
+	PROFILE_GPU_SCOPE(gpu_profiler, "Particle Upsample");
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+
+	// The target holds premultiplied colors, with both blend modes.
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	particle_upsample_program.use();
+	particle_upsample_program.uniform("range_sigma", upsample_range_sigma);
+	glBindTextureUnit(0, particle_color_texture);
+
+	glBindVertexArray(empty_vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glDisable(GL_BLEND);
+	glDepthMask(GL_TRUE);
+	glEnable(GL_DEPTH_TEST);
+}
+
+void Application::render_scene() {
+	PROFILE_GPU_SCOPE(gpu_profiler, DISPLAY_NAMES[display_mode]);
+
+	// Finds the particles to draw and their order, the scenes draw them from the resulting list.
+	draw_list_buffer = 0;
+	draw_list_culled = frustum_culling;
+	if (frustum_culling) {
+		cull_particles();
+		draw_list_buffer = cull_visible_list_buffer;
+	}
+	if (blend_mode == BLEND_SORTED_ALPHA) {
+		sort_particles_by_depth();
+		draw_list_buffer = sort_values_buffer;
+	}
+
+	// The points are all farther than the quads (the particles have the same size), so they are drawn first.
+	if (frustum_culling && lod_pixel_size > 0.0f) {
+		render_particle_points();
+	}
+
+	if (display_mode == DISPLAY_PULSATING_SCENE) {
+		render_pulsating_simulation();
+	}
+	else if (display_mode == DISPLAY_SINGLE_ATTRACTOR_SCENE || display_mode == DISPLAY_FLUID_SCENE) {
+		// The fluid is drawn the same way, from the positions and the colors.
+		render_attracting_simulation();
+	}
+	else if (display_mode == DISPLAY_MULTI_ATTRACTOR_SCENE) {
+		render_multi_attracting_simulation();
+	}
+	else if (display_mode == DISPLAY_NBODY_SCENE) {
+		render_nbody_simulation();
+	}
+	else if (display_mode == DISPLAY_PARTICLE_SURFACE_ESTIMATOR_SCENE) {
+		render_surface_estimator();
+	}
+}
+
+void Application::draw_particle_billboards(CachedShaderProgram& program, bool indirect) {
+	// The indirect draws already pull the particles from a list (the pulsating scene binds the draw list itself).
+	const bool use_draw_order = (draw_list_buffer != 0) && !indirect;
+	if (billboard_mode != BILLBOARD_GEOMETRY_SHADER) {
+		program.uniform("instanced", billboard_mode == BILLBOARD_INSTANCED);
+		program.uniform("use_draw_order", use_draw_order);
+		if (use_draw_order) {
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, draw_list_buffer);
+		}
+	}
+
+	// The arguments follow the list sizes in the counters buffer.
+	if (indirect) {
+		const GLenum primitive = (billboard_mode == BILLBOARD_GEOMETRY_SHADER) ? GL_POINTS : GL_TRIANGLES;
+		glDrawArraysIndirect(primitive, reinterpret_cast<const void*>(4 * sizeof(GLuint)));
+		return;
+	}
+
+	// The culled lists are drawn with the arguments written by the cull pass, so the draws follow the visible count.
+	if (use_draw_order && draw_list_culled) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cull_counters_buffer);
+		if (billboard_mode == BILLBOARD_GEOMETRY_SHADER) {
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, draw_list_buffer);
+			glDrawElementsIndirect(GL_POINTS, GL_UNSIGNED_INT, reinterpret_cast<const void*>(8 * sizeof(GLuint)));
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		}
+		else {
+			glDrawArraysIndirect(GL_TRIANGLES, reinterpret_cast<const void*>(4 * sizeof(GLuint)));
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		return;
+	}
+
+	if (billboard_mode == BILLBOARD_GEOMETRY_SHADER) {
+		// The geometry shader expands each point, from a draw list the points are fetched through the element buffer.
+		if (use_draw_order) {
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, draw_list_buffer);
+			glDrawElements(GL_POINTS, current_particle_count, GL_UNSIGNED_INT, nullptr);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+			return;
+		}
+		glDrawArrays(GL_POINTS, 0, current_particle_count);
+		return;
+	}
+
+	// Two triangles per particle, the vertex shader finds the particle and the corner from the vertex (or instance) index.
+	if (billboard_mode == BILLBOARD_INSTANCED) {
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, current_particle_count);
+	}
+	else {
+		glDrawArrays(GL_TRIANGLES, 0, 6 * current_particle_count);
+	}
+}
+
+void Application::bind_particle_blending(CachedShaderProgram& program) {
+	// The smoke is premultiplied by its alpha in the fragment shader.
+	if (blend_mode == BLEND_SORTED_ALPHA) {
+		glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+		glBindTextureUnit(0, smoke_tex);
+		program.uniform("opacity", smoke_opacity);
+	}
+	else {
+		glBlendFunc(GL_ONE, GL_ONE);
+		glBindTextureUnit(0, star_tex);
+		program.uniform("opacity", 1.0f);
+	}
+}
+
+void Application::compare_billboard_modes() {
+	const int mode = billboard_mode;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, width, height);
+	glEnable(GL_DEPTH_TEST);
+	camera_ubo.bind_buffer_base(CameraUBO::DEFAULT_CAMERA_BINDING);
+
+	std::cout << "---" << std::endl;
+	std::cout << "Billboards of " << DISPLAY_NAMES[display_mode] << " (" << current_particle_count << " particles)" << std::endl;
+	for (int i = 0; i < 3; i++) {
+		billboard_mode = i;
+
+		// The first frame is not measured, it may include the driver's deferred work.
+		render_scene();
+
+		glBeginQuery(GL_TIME_ELAPSED, billboard_queries[i]);
+		for (int frame = 0; frame < billboard_comparison_frames; frame++) {
+			render_scene();
+		}
+		glEndQuery(GL_TIME_ELAPSED);
+	}
+
+	// All modes are submitted before the first result is read, so there is only one wait.
+	for (int i = 0; i < 3; i++) {
+		GLuint64 render_time;
+		glGetQueryObjectui64v(billboard_queries[i], GL_QUERY_RESULT, &render_time);
+		billboard_times[i] = static_cast<float>(render_time) * 1e-6f / billboard_comparison_frames;
+
+		std::cout << BILLBOARD_NAMES[i] << ": " << billboard_times[i] << " ms (" << 1000.0f / billboard_times[i] << " FPS)" << std::endl;
+	}
+
+	billboard_mode = mode;
+}
+
+// Render Scene
+void Application::render() {
+	// Measures the billboard modes before the frame, the frame clears what they drew.
+	if (billboard_comparison_requested) {
+		billboard_comparison_requested = false;
+		compare_billboard_modes();
+	}
+
+	PROFILE_GPU_SCOPE(gpu_profiler, "Render");
+
+	// Starts measuring the elapsed time.
+	render_timer.begin();
+
+	// Binds the main window framebuffer.
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, width, height);
+
+	// Clears the framebuffer color.
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+
+	// Binds the necessary buffers.
+	camera_ubo.bind_buffer_base(CameraUBO::DEFAULT_CAMERA_BINDING);
+
+	if (get_particle_resolution_divisor() > 1) {
+		// Draws the particles into the smaller target (over transparent black) and upsamples them onto the screen.
+		glBindFramebuffer(GL_FRAMEBUFFER, particle_framebuffer);
+		glViewport(0, 0, particle_target_width, particle_target_height);
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		render_scene();
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(0, 0, width, height);
+		composite_particles();
+	}
+	else {
+		render_scene();
+	}
+
+	// Resets the VAO and the program.
+	glBindVertexArray(0);
+	glUseProgram(0);
+
+	// Stops measuring the elapsed time, there is no glFinish so the CPU can prepare the next frame meanwhile.
+	render_timer.end();
+
+	// Uses the latest finished measurement (the simulation steps are measured separately in compute_time_gpu).
+	const float render_time = render_timer.get_time();
+	fps_gpu = (render_time > 0.0f) ? 1000.f / render_time : 0.0f;
+
+	if (benchmark.is_running()) {
+		end_benchmark_frame();
+	}
+}
+
+// GUI
+void Application::render_ui() {
+	PROFILE_SCOPE("UI");
+
+	if (!show_ui) return;
+
+	const float unit = ImGui::GetFontSize();
+
+	ImGui::Begin("Controls", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+
+	std::string fps_cpu_string = "FPS (CPU): ";
+	ImGui::Text(fps_cpu_string.append(std::to_string(fps_cpu)).c_str());
+
+	std::string fps_string = "FPS (GPU): ";
+	ImGui::Text(fps_string.append(std::to_string(fps_gpu)).c_str());
+
+	std::string compute_time_string = "Compute (GPU): ";
+	ImGui::Text(compute_time_string.append(std::to_string(compute_time_gpu)).append(" ms").c_str());
+
+	if (ImGui::Combo("Display", &display_mode, DISPLAY_NAMES, IM_ARRAYSIZE(DISPLAY_NAMES))) {
+		reset_particles();
+	}
+
+	if (ImGui::CollapsingHeader("Simulation Backend")) {
+		if (ImGui::Combo("Backend", &simulation_backend, SIMULATION_BACKEND_NAMES, IM_ARRAYSIZE(SIMULATION_BACKEND_NAMES))) {
+			// The CPU continues from the state the GPU simulated so far.
+			if (simulation_backend == SIMULATION_BACKEND_CPU) {
+				download_particles_buffer();
+			}
+		}
+
+		std::string cpu_string = "CPU: ";
+		ImGui::Text(cpu_string.append(std::to_string(cpu_simulation.get_thread_count())).append(" threads, ").append(cpu_simulation.get_simd_name()).c_str());
+
+		// Particle steps per second by the selected backend, over all the steps of the last frame.
+		const float step_time = (simulation_backend == SIMULATION_BACKEND_CPU) ? cpu_step_time : compute_time_gpu;
+		std::string throughput_string = "Throughput: ";
+		ImGui::Text(throughput_string.append(std::to_string(current_particle_count * simulation_steps / (step_time * 1000.0f))).append(" M particles/s").c_str());
+
+		if (ImGui::Button("Check GPU Parity", ImVec2(150.f, 0.f))) {
+			parity_check_requested = true;
+		}
+		std::string parity_string = "Max Position / Velocity Error: ";
+		ImGui::Text(parity_string.append(std::to_string(parity_position_error)).append(" / ").append(std::to_string(parity_velocity_error)).c_str());
+	}
+
+	if (ImGui::CollapsingHeader("Sorting")) {
+		// The reordering changes only the order in memory, not the simulation (the CPU backend keeps its own order).
+		ImGui::Checkbox("Morton Reordering", &morton_reordering);
+		ImGui::SliderInt("Reorder Interval (steps)", &morton_reorder_interval, 16, 4096);
+
+		if (ImGui::Button("Measure Sort Throughput", ImVec2(200.f, 0.f))) {
+			sort_benchmark_requested = true;
+		}
+		const float keys = static_cast<float>(sort_benchmark_count);
+		std::string sort_32_string = "32-bit Keys: ";
+		ImGui::Text(sort_32_string.append(std::to_string(sort_time_32)).append(" ms (").append(std::to_string(sort_time_32 > 0.0f ? keys / (sort_time_32 * 1000.0f) : 0.0f)).append(" M keys/s)").c_str());
+		std::string sort_30_string = "30-bit Keys: ";
+		ImGui::Text(sort_30_string.append(std::to_string(sort_time_30)).append(" ms (").append(std::to_string(sort_time_30 > 0.0f ? keys / (sort_time_30 * 1000.0f) : 0.0f)).append(" M keys/s)").c_str());
+		std::string valid_string = "Keys: ";
+		ImGui::Text(valid_string.append(std::to_string(sort_benchmark_count)).append(sort_benchmark_valid || sort_benchmark_count == 0 ? ", sorted" : ", NOT SORTED").c_str());
+	}
+
+	if (ImGui::CollapsingHeader("Checkpoints")) {
+		std::string path_string = "File: ";
+		ImGui::Text(path_string.append(checkpoint_path.generic_string()).c_str());
+		if (ImGui::Button("Save Checkpoint", ImVec2(150.f, 0.f))) {
+			checkpoint_save_requested = true;
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Restore Checkpoint", ImVec2(150.f, 0.f))) {
+			checkpoint_restore_requested = true;
+		}
+		std::string time_string = "Last Save / Restore: ";
+		ImGui::Text(time_string.append(std::to_string(checkpoint_time)).append(" ms").c_str());
+	}
+
+	if (ImGui::CollapsingHeader("Profiling")) {
+		bool recording = Profiler::get().is_enabled();
+		if (ImGui::Checkbox("Record Sections", &recording)) {
+			Profiler::get().set_enabled(recording);
+		}
+		ImGui::Checkbox("Show Frame Breakdown", &show_frame_breakdown);
+		if (ImGui::Button("Export Trace", ImVec2(150.f, 0.f))) {
+			std::cout << "---" << std::endl;
+			if (Profiler::get().export_chrome_trace(trace_path)) {
+				std::cout << "Trace written into " << trace_path.generic_string() << " (open it in chrome://tracing or Perfetto)." << std::endl;
+			}
+			else {
+				std::cerr << "Cannot write the trace " << trace_path.generic_string() << std::endl;
+			}
+		}
+		std::string trace_string = "File: ";
+		ImGui::Text(trace_string.append(trace_path.generic_string()).c_str());
+	}
+
+	if (ImGui::CollapsingHeader("Benchmark")) {
+		ImGui::SliderInt("Warmup Frames", &benchmark_warmup_frames, 8, 128);
+		ImGui::SliderInt("Measured Frames", &benchmark_measured_frames, 16, 1024);
+		ImGui::SliderFloat("Frame Limit (ms)", &benchmark_frame_limit, 16.0f, 1000.0f, "%.0f");
+		ImGui::Checkbox("Sweep Billboards", &benchmark_billboards);
+		if (!benchmark.is_running()) {
+			if (ImGui::Button("Run Benchmark", ImVec2(150.f, 0.f))) {
+				start_benchmark();
+			}
+		}
+		else {
+			if (ImGui::Button("Stop Benchmark", ImVec2(150.f, 0.f))) {
+				benchmark.stop();
+				finish_benchmark();
+			}
+			std::string progress_string = "Case: ";
+			ImGui::Text(progress_string.append(std::to_string(benchmark.get_case_index() + 1)).append(" / ").append(std::to_string(benchmark.get_case_count())).c_str());
+		}
+		std::string file_string = "File: ";
+		ImGui::Text(file_string.append(benchmark_path.generic_string()).c_str());
+	}
+
+	if (ImGui::CollapsingHeader("Simulation Timing")) {
+		ImGui::SliderInt("Simulation Rate (Hz)", &simulation_rate, 30, 480);
+		ImGui::SliderInt("Max Substeps", &max_substeps, 1, 16);
+		std::string steps_string = "Steps This Frame: ";
+		ImGui::Text(steps_string.append(std::to_string(simulation_steps)).c_str());
 	}
 
 	if (ImGui::CollapsingHeader("Particle Settings")) {
@@ -587,35 +2808,221 @@ void Application::render_ui() {
 		int exponent = static_cast<int>(log2(current_particle_count) - 8);
 		if (ImGui::Combo("Particle Count", &exponent, particle_labels, IM_ARRAYSIZE(particle_labels))) {
 			desired_particle_count = static_cast<int>(glm::pow(2, exponent + 8));
-			update_particles_buffer();
+			update_particles_buffer(true);
 		}
 
 		ImGui::SliderFloat("Particle Size", &particle_size, 0.1f, 2.0f, "%.1f");
 
+		ImGui::Combo("Billboards", &billboard_mode, BILLBOARD_NAMES, IM_ARRAYSIZE(BILLBOARD_NAMES));
+		if (ImGui::Button("Compare Billboards", ImVec2(150.f, 0.f))) {
+			billboard_comparison_requested = true;
+		}
+		for (int i = 0; i < 3; i++) {
+			std::string billboard_string = std::string(BILLBOARD_NAMES[i]).append(": ");
+			ImGui::Text(billboard_string.append(std::to_string(billboard_times[i])).append(" ms (").append(std::to_string(billboard_times[i] > 0.0f ? 1000.0f / billboard_times[i] : 0.0f)).append(" FPS)").c_str());
+		}
+
+		ImGui::Combo("Blending", &blend_mode, BLEND_NAMES, IM_ARRAYSIZE(BLEND_NAMES));
+		if (blend_mode == BLEND_SORTED_ALPHA) {
+			ImGui::SliderFloat("Smoke Opacity", &smoke_opacity, 0.05f, 1.0f, "%.2f");
+		}
+
+		if (ImGui::Combo("Particle Resolution", &particle_resolution_index, PARTICLE_RESOLUTION_NAMES, IM_ARRAYSIZE(PARTICLE_RESOLUTION_NAMES))) {
+			resize_fullscreen_textures();
+		}
+		if (get_particle_resolution_divisor() > 1) {
+			ImGui::SliderFloat("Upsample Range Sigma", &upsample_range_sigma, 0.05f, 2.0f, "%.2f");
+		}
+		std::string target_string = "Particle Target: ";
+		ImGui::Text(target_string.append(std::to_string(particle_target_width)).append(" x ").append(std::to_string(particle_target_height)).c_str());
+
+		ImGui::Checkbox("Frustum Culling", &frustum_culling);
+		if (frustum_culling) {
+			ImGui::SliderFloat("Point LOD Size (px)", &lod_pixel_size, 0.0f, 8.0f, "%.1f");
+			ImGui::SliderFloat("Point Intensity", &point_intensity, 0.0f, 1.0f, "%.2f");
+			std::string visible_string = "Visible Quads / Points: ";
+			ImGui::Text(visible_string.append(std::to_string(cull_counts[0])).append(" / ").append(std::to_string(cull_counts[1])).c_str());
+		}
+
+		int layout = particle_layout;
+		bool half_precision = half_precision_streams;
+		if (ImGui::Combo("Layout", &layout, PARTICLE_LAYOUT_NAMES, IM_ARRAYSIZE(PARTICLE_LAYOUT_NAMES))) {
+			set_particle_layout(layout, half_precision);
+		}
+		if (particle_layout == PARTICLE_LAYOUT_SOA && ImGui::Checkbox("Half Precision Velocity & Color", &half_precision)) {
+			set_particle_layout(layout, half_precision);
+		}
+		std::string traffic_string = "Particle Traffic: ";
+		ImGui::Text(traffic_string.append(std::to_string(get_particle_traffic())).append(" B/particle (step + render)").c_str());
+
+		int seed = static_cast<int>(random_seed);
+		if (ImGui::InputInt("Seed", &seed)) {
+			random_seed = static_cast<uint32_t>(seed);
+		}
 		if (ImGui::Button("Reset Particles", ImVec2(150.f, 0.f))) {
 			reset_particles();
 		}
 	}
 
 	if (ImGui::CollapsingHeader("Scene Controls")) {
+		if (display_mode == DISPLAY_PULSATING_SCENE) {
+			ImGui::SliderFloat("Emission Limit (per step)", &emission_limit, 0.0f, 1.0f, "%.3f");
+			std::string alive_string = "Live Particles: ";
+			ImGui::Text(alive_string.append(std::to_string(alive_particle_count)).append(" / ").append(std::to_string(current_particle_count)).c_str());
+		}
 		if (display_mode == DISPLAY_SINGLE_ATTRACTOR_SCENE || display_mode == DISPLAY_MULTI_ATTRACTOR_SCENE) {
-			ImGui::SliderInt("Attractors Count", &attractor_used, 1, max_attractors);
+			if (ImGui::SliderInt("Attractors Count", &attractor_used, 1, max_attractors)) {
+				attractors_changed = true;
+			}
 			
-			for (int i = 0; i < ((display_mode == DISPLAY_SINGLE_ATTRACTOR_SCENE) ? 1 : attractor_used); i++) {
+			// The attractors beyond the edited ones are scattered by the seed.
+			for (int i = 0; i < ((display_mode == DISPLAY_SINGLE_ATTRACTOR_SCENE) ? 1 : std::min(attractor_used, max_edited_attractors)); i++) {
 				std::string label = "Attractor " + std::to_string(i);
-				ImGui::InputFloat3(label.c_str(), glm::value_ptr(attraction_points[i]));
+				if (ImGui::InputFloat3(label.c_str(), glm::value_ptr(attraction_points[i]))) {
+					attractors_changed = true;
+				}
 			}
 			ImGui::SliderFloat("Force", &attraction_force, 0.1f, 25.0f, "%.1f");
+			if (display_mode == DISPLAY_MULTI_ATTRACTOR_SCENE) {
+				if (ImGui::Checkbox("Animate Attractors", &animate_attractors)) {
+					attractors_changed = true;
+				}
+				ImGui::SliderFloat("Angular Speed", &attractor_angular_speed, 0.0f, 2.0f, "%.2f");
+				ImGui::Checkbox("Baked Force Field", &use_force_field);
+				ImGui::Checkbox("Specialize Attractor Count", &specialize_attractor_count);
+				if (use_force_field) {
+					ImGui::Combo("Field Resolution", &force_field_resolution_index, FORCE_FIELD_RESOLUTION_NAMES, IM_ARRAYSIZE(FORCE_FIELD_RESOLUTION_NAMES));
+					if (ImGui::SliderFloat("Field Size", &force_field_extent, 20.0f, 400.0f, "%.0f")) {
+						force_field_stale_slices = force_field_texture_resolution;
+					}
+					ImGui::SliderInt("Slices per Step", &force_field_slices_per_step, 1, 32);
+					std::string stale_string = "Stale Slices: ";
+					ImGui::Text(stale_string.append(std::to_string(force_field_stale_slices)).append(" / ").append(std::to_string(force_field_texture_resolution)).c_str());
+				}
+			}
 		}
 		else if (display_mode == DISPLAY_NBODY_SCENE) {
-			ImGui::SliderFloat("Acceleration Factor", &acceleration_factor, 0.1f, 5.0f, "%.1f");
-			ImGui::SliderFloat("Distance Threshold", &distance_threshold, 0.001f, 0.1f, "%.3f");
+			ImGui::Combo("Kernel", &nbody_kernel, NBODY_KERNEL_NAMES, IM_ARRAYSIZE(NBODY_KERNEL_NAMES));
+			if (nbody_kernel == NBODY_BARNES_HUT_KERNEL) {
+				ImGui::SliderFloat("Opening Angle (Theta)", &bh_theta, 0.0f, 1.5f, "%.2f");
+				if (ImGui::Button("Check Accuracy", ImVec2(150.f, 0.f))) {
+					bh_accuracy_check_requested = true;
+				}
+				std::string error_string = "Mean / Max Error: ";
+				ImGui::Text(error_string.append(std::to_string(bh_mean_error * 100.0f)).append(" % / ").append(std::to_string(bh_max_error * 100.0f)).append(" %").c_str());
+				std::string timing_string = "Direct / Barnes-Hut (Samples): ";
+				ImGui::Text(timing_string.append(std::to_string(bh_direct_time)).append(" ms / ").append(std::to_string(bh_tree_time)).append(" ms").c_str());
+			}
+			// A different force or integrator changes what is conserved, the drift starts from a new baseline.
+			bool model_changed = false;
+			model_changed |= ImGui::SliderFloat("Acceleration Factor", &acceleration_factor, 0.1f, 5.0f, "%.1f");
+			model_changed |= ImGui::Combo("Gravity", &nbody_gravity_model, NBODY_GRAVITY_NAMES, IM_ARRAYSIZE(NBODY_GRAVITY_NAMES));
+			if (nbody_gravity_model == NBODY_GRAVITY_PLUMMER) {
+				model_changed |= ImGui::SliderFloat("Softening", &nbody_softening, 0.001f, 0.5f, "%.3f");
+			}
+			else {
+				model_changed |= ImGui::SliderFloat("Distance Threshold", &distance_threshold, 0.001f, 0.1f, "%.3f");
+			}
+			model_changed |= ImGui::Combo("Integrator", &nbody_integrator, NBODY_INTEGRATOR_NAMES, IM_ARRAYSIZE(NBODY_INTEGRATOR_NAMES));
+			if (nbody_kernel != NBODY_BARNES_HUT_KERNEL) {
+				ImGui::Checkbox("Half Precision Positions", &nbody_packed_positions);
+				ImGui::Combo("Workgroup Size", &nbody_workgroup_size_index, NBODY_WORKGROUP_SIZE_NAMES, IM_ARRAYSIZE(NBODY_WORKGROUP_SIZE_NAMES));
+				if (nbody_kernel == NBODY_SHARED_KERNEL) {
+					ImGui::Combo("Unroll", &nbody_unroll_index, NBODY_UNROLL_NAMES, IM_ARRAYSIZE(NBODY_UNROLL_NAMES));
+				}
+				ImGui::Checkbox("Autotune New Configurations", &nbody_autotune);
+				if (ImGui::Button("Autotune", ImVec2(150.f, 0.f))) {
+					nbody_autotune_requested = true;
+				}
+				std::string tuned_string = "Best / Previous: ";
+				ImGui::Text(tuned_string.append(std::to_string(nbody_autotune_best_time)).append(" ms / ").append(std::to_string(nbody_autotune_default_time)).append(" ms").c_str());
+				std::string measured_string = "Measured / Rejected: ";
+				ImGui::Text(measured_string.append(std::to_string(nbody_autotune_count)).append(" / ").append(std::to_string(nbody_autotune_rejected)).c_str());
+				std::string results_string = "Remembered Results: ";
+				ImGui::Text(results_string.append(std::to_string(permutation_tuner.get_result_count())).c_str());
+			}
+			model_changed |= ImGui::Checkbox("Track Energy Drift", &nbody_track_drift);
+			if (model_changed) {
+				reset_nbody_drift();
+			}
+			if (nbody_track_drift) {
+				std::string energy_string = "Energy: ";
+				ImGui::Text(energy_string.append(std::to_string(nbody_energy)).c_str());
+				std::string drift_string = "Energy / Momentum Drift: ";
+				ImGui::Text(drift_string.append(std::to_string(nbody_energy_drift * 100.0f)).append(" % / ").append(std::to_string(nbody_momentum_drift)).c_str());
+				std::string steps_string = "Steps Since Baseline: ";
+				ImGui::Text(steps_string.append(std::to_string(nbody_drift_steps)).c_str());
+				if (ImGui::Button("Reset Baseline", ImVec2(150.f, 0.f))) {
+					reset_nbody_drift();
+				}
+			}
 		}
 		else if (display_mode == DISPLAY_PARTICLE_SURFACE_ESTIMATOR_SCENE) {
 			if (ImGui::Combo("Model", &current_model, MODEL_NAMES, IM_ARRAYSIZE(MODEL_NAMES))) {
 				update_model();
 			}
 		}
+		else if (display_mode == DISPLAY_FLUID_SCENE) {
+			ImGui::SliderFloat("Interaction Radius", &fluid_interaction_radius, 0.25f, 4.0f, "%.2f");
+			ImGui::SliderFloat("Repulsion", &fluid_repulsion, 0.0f, 20000.0f, "%.0f");
+			ImGui::SliderFloat("Cohesion", &fluid_cohesion, 0.0f, 4000.0f, "%.0f");
+			ImGui::SliderFloat("Containment", &fluid_containment, 0.0f, 200.0f, "%.1f");
+			std::string buckets_string = "Grid Buckets: ";
+			ImGui::Text(buckets_string.append(std::to_string(CpuSimulation::get_hash_table_size(current_particle_count))).c_str());
+		}
+	}
+
+	ImGui::End();
+
+	if (show_frame_breakdown) {
+		render_frame_breakdown();
+	}
+}
+
+void Application::render_frame_breakdown() {
+	const float unit = ImGui::GetFontSize();
+
+	// The newest frame whose GPU sections have all arrived (the CPU ones are complete once the frame is over).
+	const uint64_t current_frame = Profiler::get().get_frame();
+	const uint64_t frame = std::min(gpu_profiler.get_resolved_frame(), current_frame > 0 ? current_frame - 1 : 0);
+	frame_breakdown_events.clear();
+	Profiler::get().collect_frame(frame, frame_breakdown_events);
+
+	ImGui::Begin("Frame Breakdown", &show_frame_breakdown, ImGuiWindowFlags_AlwaysAutoResize);
+
+	std::string frame_string = "Frame: ";
+	ImGui::Text(frame_string.append(std::to_string(frame)).append(" (").append(std::to_string(current_frame - frame)).append(" frames ago)").c_str());
+
+	const int main_thread = Profiler::get_thread_index();
+	for (const bool gpu : { false, true }) {
+		ImGui::Separator();
+		ImGui::Text(gpu ? "GPU" : "CPU");
+
+		// The bars are relative to the top level sections of the main thread (or of the GPU).
+		float total = 0.0f;
+		for (const ProfileEvent& event : frame_breakdown_events) {
+			if (event.depth == 0 && event.thread == (gpu ? Profiler::GPU_THREAD : main_thread)) {
+				total += static_cast<float>(event.duration) * 1e-6f;
+			}
+		}
+
+		for (const ProfileEvent& event : frame_breakdown_events) {
+			if ((event.thread == Profiler::GPU_THREAD) != gpu) continue;
+
+			const float time = static_cast<float>(event.duration) * 1e-6f;
+			const float indent = unit * static_cast<float>(event.depth + 1);
+			ImGui::Indent(indent);
+			ImGui::ProgressBar(total > 0.0f ? std::min(time / total, 1.0f) : 0.0f, ImVec2(unit * 8.0f, 0.0f), "");
+			ImGui::SameLine();
+			std::string event_string = event.name;
+			event_string.append(": ").append(std::to_string(time)).append(" ms");
+			if (!gpu && event.thread != main_thread) {
+				const char* thread_name = Profiler::get().get_thread_name(event.thread);
+				event_string.append(" [").append(thread_name != nullptr ? thread_name : "Worker").append("]");
+			}
+			ImGui::Text(event_string.c_str());
+			ImGui::Unindent(indent);
+		}
 	}
 
 	ImGui::End();
@@ -623,6 +3030,7 @@ void Application::render_ui() {
 
 void Application::on_resize(int width, int height) {
 	PV227Application::on_resize(width, height);
+	// Reallocates the particle target for the new window size.
 	resize_fullscreen_textures();
 }
 
@@ -1,23 +1,23 @@
 #pragma once
 
+#include "async_readback.hpp"
+#include "benchmark_suite.hpp"
 #include "camera_ubo.hpp"
+#include "checkpoint.hpp"
+#include "cpu_simulation.hpp"
+#include "gpu_profiler.hpp"
+#include "gpu_timer.hpp"
 #include "light_ubo.hpp"
+#include "mesh_loader.hpp"
+#include "particle.hpp"
+#include "permutation_tuner.hpp"
 #include "phong_material_ubo.hpp"
+#include "program_cache.hpp"
 #include "pv227_application.hpp"
+#include "streaming_buffer.hpp"
 #include "ubo_impl.hpp"
-
-struct Particle {
-	glm::vec4 position; // The position of particles (on CPU).
-	glm::vec3 velocity; // The velocity of particles (on CPU).
-	float lifetime; // The lifetime of the particle
-	glm::vec3 color; // The colors of all particles (on GPU).
-	float remaining; // The remaining time of the particle
-};
-
-struct Mesh {
-	std::vector<glm::vec4> positions;
-	std::vector<int> indices;
-};
+#include <chrono>
+#include <memory>
 
 class Application : public PV227Application {
 	// Variables (Geometry)
@@ -25,6 +25,7 @@ protected:
 	// Variables (Textures)
 protected:
 	GLuint star_tex;
+	GLuint smoke_tex;
 	// Variables (Light)
 protected:
 	// Variables (Camera)
@@ -32,15 +33,73 @@ protected:
 	CameraUBO camera_ubo;
 	// Variables (Shaders)
 protected:
-	ShaderProgram pulsating_particle_program;
-	ShaderProgram attracting_particle_program;
-	ShaderProgram multi_attracting_particle_program;
-	ShaderProgram nbody_particle_program;
-	ShaderProgram nbody_update_program;
-	ShaderProgram particle_surface_estimator_program;
+	// Built by program_cache from the cached binaries or the sources.
+	ProgramCache program_cache;
+	// The default programs of the lectures, these hide the ShaderProgram members of PV227Application so they are built by the cache as well.
+	CachedShaderProgram default_unlit_program;
+	CachedShaderProgram default_lit_program;
+	CachedShaderProgram pulsating_particle_program;
+	CachedShaderProgram attracting_particle_program;
+	CachedShaderProgram multi_attracting_particle_program;
+	CachedShaderProgram nbody_particle_program;
+	CachedShaderProgram nbody_update_program;
+	CachedShaderProgram nbody_shared_update_program;
+	CachedShaderProgram nbody_pack_program;
+	CachedShaderProgram nbody_energy_program;
+	CachedShaderProgram barnes_hut_bounds_program;
+	CachedShaderProgram barnes_hut_keys_program;
+	CachedShaderProgram barnes_hut_scatter_program;
+	CachedShaderProgram barnes_hut_build_program;
+	CachedShaderProgram barnes_hut_reduce_program;
+	CachedShaderProgram barnes_hut_force_program;
+	CachedShaderProgram nbody_reference_program;
+	CachedShaderProgram nbody_sampled_program;
+	CachedShaderProgram barnes_hut_sampled_program;
+	CachedShaderProgram prefix_sum_program;
+	CachedShaderProgram prefix_sum_add_program;
+	CachedShaderProgram particle_surface_estimator_program;
+	CachedShaderProgram pulsating_update_program;
+	CachedShaderProgram attracting_update_program;
+	CachedShaderProgram multi_attracting_update_program;
+	CachedShaderProgram surface_estimator_update_program;
+	CachedShaderProgram pulsating_quad_program;
+	CachedShaderProgram attracting_quad_program;
+	CachedShaderProgram multi_attracting_quad_program;
+	CachedShaderProgram nbody_quad_program;
+	CachedShaderProgram surface_estimator_quad_program;
+	CachedShaderProgram pulsating_emit_program;
+	CachedShaderProgram particle_init_program;
+	CachedShaderProgram particle_compact_program;
+	CachedShaderProgram particle_draw_args_program;
+	CachedShaderProgram grid_count_program;
+	CachedShaderProgram grid_scatter_program;
+	CachedShaderProgram fluid_update_program;
+	CachedShaderProgram attractor_field_program;
+	CachedShaderProgram sort_keys_program;
+	CachedShaderProgram radix_count_program;
+	CachedShaderProgram radix_scatter_program;
+	CachedShaderProgram particle_permute_program;
+	CachedShaderProgram particle_cull_program;
+	CachedShaderProgram particle_point_program;
+	CachedShaderProgram particle_upsample_program;
 
 	// Variables (Frame Buffers)
 protected:
+	// The particles can be drawn into an offscreen target at a fraction of the window resolution and upsampled onto the
+	// screen, which divides the fragment work of the overlapping quads by the square of the divisor.
+	const char* PARTICLE_RESOLUTION_NAMES[3] = { "Full", "1/2", "1/4" };
+	const int PARTICLE_RESOLUTION_DIVISORS[3] = { 1, 2, 4 };
+	int particle_resolution_index = 0;
+
+	// The color difference (relative to the brightness) at which the bilateral upsample stops blending the texels.
+	float upsample_range_sigma = 0.25f;
+
+	// The reduced-resolution target, the texture is only allocated with a divisor above one.
+	GLuint particle_framebuffer = 0;
+	GLuint particle_color_texture = 0;
+	int particle_target_width = 0;
+	int particle_target_height = 0;
+
 	// Variables (GUI)
 	bool show_ui = true;
 protected:
@@ -61,15 +120,176 @@ protected:
 	// The particle data.
 	std::vector<Particle> particles;
 
+	// The seed of the counter-based random numbers (CounterRng) of the initial states and the respawns ('--seed <n>' in the arguments).
+	uint32_t random_seed = 1;
+
+	// -- Billboards --
+	// How the particles are expanded into quads: in a geometry shader, in the vertex shader from gl_VertexID, or as instances.
+	const int BILLBOARD_GEOMETRY_SHADER = 0;
+	const int BILLBOARD_VERTEX_PULLING = 1;
+	const int BILLBOARD_INSTANCED = 2;
+
+	const char* BILLBOARD_NAMES[3] = { "Geometry Shader", "Vertex Pulling", "Instanced Quads" };
+
+	int billboard_mode = BILLBOARD_VERTEX_PULLING;
+
+	// The number of frames rendered with each mode by the comparison.
+	const int billboard_comparison_frames = 16;
+	bool billboard_comparison_requested = false;
+	float billboard_times[3] = { 0.0f, 0.0f, 0.0f }; // The average render time of each mode in milliseconds.
+	GLuint billboard_queries[3]; // The render time of each mode, separate from the frame timers.
+
+	// -- Blending --
+	// Additive blending needs no order, the alpha-blended smoke is drawn back to front in the order of a depth sort every frame.
+	const int BLEND_ADDITIVE = 0;
+	const int BLEND_SORTED_ALPHA = 1;
+
+	const char* BLEND_NAMES[2] = { "Additive (Star)", "Sorted Alpha (Smoke)" };
+
+	int blend_mode = BLEND_ADDITIVE;
+	float smoke_opacity = 0.35f;
+
+
+	// -- Culling --
+	// The particles outside the view frustum are dropped before drawing, the distant ones are drawn as single-pixel points.
+	bool frustum_culling = true;
+
+	// The projected size of a particle (in pixels) below which it is drawn as a point, 0 draws all visible particles as quads.
+	float lod_pixel_size = 1.5f;
+
+	// The average intensity of the particle texture, which the points stand in for.
+	float point_intensity = 0.25f;
+
+	// The visible quads and points, their counts and the arguments of the indirect draws (see particle_cull.comp).
+	GLuint cull_visible_list_buffer;
+	GLuint cull_point_list_buffer;
+	GLuint cull_counters_buffer;
+
+	// The numbers of visible quads and points of a recent frame (read back for the UI without waiting).
+	AsyncReadback cull_count_readback{ sizeof(GLuint) * 2 };
+	GLuint cull_counts[2] = { 0, 0 };
+
+	// The list of particle indices the current frame is drawn from (0 draws all particles in memory order), and whether
+	// it is a culled list whose size is only known on GPU (in cull_counters_buffer).
+	GLuint draw_list_buffer = 0;
+	bool draw_list_culled = false;
+
+	// This must be the same as the color in surface_estimator(_quad).vert.
+	const glm::vec3 surface_particle_color = glm::vec3(250 / 255.f, 202 / 255.f, 0.f);
+
+	// -- Live Particle Lists (Sphere Pulsating) --
+	// The indices of the live and dead particles, rebuilt by particle_compact.comp after every step.
+	GLuint alive_list_buffer;
+	GLuint dead_list_buffer;
+
+	// The sizes of both lists followed by the arguments of glDrawArraysIndirect (see particle_draw_args.comp).
+	GLuint list_counters_buffer;
+
+	// The dead particles of each work group of the compaction (and their prefix sum), which keeps the lists in index order.
+	GLuint compact_group_counts_buffer;
+
+	// The passes of particle_compact.comp, these must be the same as COMPACT_* in particle_compact.comp.
+	const int COMPACT_COUNT = 0;
+	const int COMPACT_WRITE = 1;
+
+	// The largest fraction of the particles respawned from the dead list per step.
+	float emission_limit = 1.0f;
+
+	// The number of live particles after a recent frame (read back for the UI without waiting).
+	AsyncReadback alive_count_readback{ sizeof(GLuint) };
+	int alive_particle_count = 0;
+
 	// The particle buffer.
 	GLuint particle_buffer;
 
+	// The persistently mapped staging ring all particle uploads go through.
+	StreamingBuffer particle_uploader;
+
+	// -- Particle Layout --
+	const int PARTICLE_LAYOUT_AOS = 0;
+	const int PARTICLE_LAYOUT_SOA = 1;
+
+	const char* PARTICLE_LAYOUT_NAMES[2] = { "Array of Structures", "Structure of Arrays" };
+
+	int particle_layout = PARTICLE_LAYOUT_AOS;
+
+	// Whether the velocity and color streams store half floats (only with PARTICLE_LAYOUT_SOA).
+	bool half_precision_streams = false;
+
+	// The streams of PARTICLE_LAYOUT_SOA.
+	GLuint particle_position_stream;
+	GLuint particle_velocity_stream;
+	GLuint particle_color_stream;
+	GLuint particle_lifetime_stream;
+
+	// -- Simulation Backend --
+	const int SIMULATION_BACKEND_GPU = 0;
+	const int SIMULATION_BACKEND_CPU = 1;
+
+	const char* SIMULATION_BACKEND_NAMES[2] = { "GPU", "CPU" };
+
+	int simulation_backend = SIMULATION_BACKEND_GPU;
+
+	// The CPU implementation of all scenes.
+	CpuSimulation cpu_simulation;
+
+	// The duration of the last CPU update in milliseconds.
+	float cpu_step_time = 0.0f;
+
+	// The largest differences between one GPU and one CPU step from the same state.
+	bool parity_check_requested = false;
+	float parity_position_error = 0.0f;
+	float parity_velocity_error = 0.0f;
+
+	// -- Checkpoints --
+	// The file the whole simulation state is saved into and restored from ('--restore <file>' restores it at startup).
+	std::filesystem::path checkpoint_path = "checkpoint.pckp";
+	bool checkpoint_save_requested = false;
+	bool checkpoint_restore_requested = false;
+	float checkpoint_time = 0.0f; // The duration of the last save or restore in milliseconds.
+
 	// -- Attracting Particles --
-	const int max_attractors = 10;
+	const int max_attractors = 4096;
 	int attractor_used = 3;
 	std::vector<glm::vec3> attraction_points;
 	float attraction_force = 9.8f;
 
+	// The attractors whose positions are edited in the UI (and saved in the checkpoints), the others are scattered by the seed.
+	const int max_edited_attractors = 10;
+	const float attractor_scatter_radius = 40.0f;
+
+	// The attractors of the multi-attractor scene can orbit the Y axis, each with its own speed (radians per second at 1).
+	bool animate_attractors = false;
+	float attractor_angular_speed = 0.5f;
+	std::vector<float> attractor_speeds;
+
+	// The positions of the current step, uploaded into the attractor buffer when they change.
+	std::vector<glm::vec3> animated_attraction_points;
+	std::vector<glm::vec4> attractor_upload;
+	GLuint attractor_buffer;
+	bool attractors_changed = true;
+
+	// -- Attractor Force Field --
+	// The summed directions towards the attractors baked into a 3D texture, so the step samples it once per particle
+	// instead of looping over all attractors. Once the attractors move, the field is rebaked a few slices per step.
+	bool use_force_field = false;
+
+	const char* FORCE_FIELD_RESOLUTION_NAMES[3] = { "32^3", "64^3", "128^3" };
+	const int FORCE_FIELD_RESOLUTIONS[3] = { 32, 64, 128 };
+	int force_field_resolution_index = 1;
+
+	// This must be the same as GROUP_SIZE in attractor_field.comp.
+	const int force_field_group_size = 4;
+
+	// The edge length of the cube covered by the field, centered at the origin.
+	float force_field_extent = 160.0f;
+	int force_field_slices_per_step = 8;
+
+	GLuint force_field_texture = 0;
+	int force_field_texture_resolution = 0;
+	int force_field_next_slice = 0;
+	int force_field_stale_slices = 0;
+
 	// -- N-Body Particles --
 	std::vector<glm::vec4> particle_positions[2];
 	std::vector<glm::vec4> particle_velocities;
@@ -84,15 +304,256 @@ protected:
 	float acceleration_factor = 0.2f;
 	float distance_threshold = 0.01f;
 
-	// This must be the same as 'layout (local_size_x = 256) in;' in nbody_(shared).comp
+	// This must be the same as 'layout (local_size_x = 256) in;' in the compute shaders, except for the direct N-Body
+	// kernels, whose workgroup size is a permutation (NBODY_WORKGROUP_SIZES).
 	const int local_size_x = 256;
 
-	float compute_fps_gpu;
+	const int NBODY_NAIVE_KERNEL = 0;
+	const int NBODY_SHARED_KERNEL = 1;
+	const int NBODY_BARNES_HUT_KERNEL = 2;
+
+	const char* NBODY_KERNEL_NAMES[3] = { "Naive", "Tiled (Shared Memory)", "Barnes-Hut" };
+
+	int nbody_kernel = NBODY_SHARED_KERNEL;
+
+	// This must be the same as CpuSimulation::GRAVITY_* and CpuSimulation::INTEGRATOR_*.
+	const int NBODY_GRAVITY_CUTOFF = 0;
+	const int NBODY_GRAVITY_PLUMMER = 1;
+
+	const char* NBODY_GRAVITY_NAMES[2] = { "Distance Cutoff", "Plummer Softening" };
+
+	const int NBODY_INTEGRATOR_TAYLOR = 0;
+	const int NBODY_INTEGRATOR_LEAPFROG = 1;
+
+	const char* NBODY_INTEGRATOR_NAMES[2] = { "Taylor (Explicit)", "Leapfrog (Kick-Drift)" };
+
+	int nbody_gravity_model = NBODY_GRAVITY_CUTOFF;
+	float nbody_softening = 0.1f; // The Plummer softening length.
+	int nbody_integrator = NBODY_INTEGRATOR_TAYLOR;
+
+	// The direct kernels can read the other bodies from a copy of the positions packed into half floats (nbody_pack.comp).
+	bool nbody_packed_positions = false;
+	GLuint nbody_packed_positions_buffer;
+
+	// -- Shader Permutations --
+	// The direct kernels are built with the workgroup size, the unroll factor of the tiled loop and the precision of the
+	// positions as #defines (injected by program_cache), so each combination is a separate program without runtime branches.
+	const int NBODY_WORKGROUP_SIZES[4] = { 64, 128, 256, 512 };
+	const char* NBODY_WORKGROUP_SIZE_NAMES[4] = { "64", "128", "256", "512" };
+	const int NBODY_UNROLL_FACTORS[3] = { 1, 4, 8 };
+	const char* NBODY_UNROLL_NAMES[3] = { "1", "4", "8" };
+
+	int nbody_workgroup_size_index = 2;
+	int nbody_unroll_index = 1;
+
+	// The multi-attractor update loops over a constant number of attractors (ATTRACTOR_COUNT) up to this count.
+	bool specialize_attractor_count = true;
+	const int max_specialized_attractors = 16;
+
+	// -- Autotuner --
+	// Measures all permutations of the current direct kernel and selects the fastest one. The result is remembered per
+	// kernel, gravity model, precision and particle count in shader_cache/ (per driver), and applied when they are selected again.
+	// One permutation is dispatched per frame and the times are read once the GPU has finished, so the frames never wait.
+	bool nbody_autotune = false; // Whether the permutations without a result are measured automatically.
+	bool nbody_autotune_requested = false;
+	const int nbody_autotune_steps = 5; // The timed dispatches of each permutation.
+	// The permutations are measured on at most this many particles, which keeps each frame of the measurement short.
+	// It is not a multiple of any workgroup size, so the last partial group is checked as well.
+	const int nbody_autotune_max_count = 65537;
+
+	PermutationTuner permutation_tuner;
+	std::string nbody_tuned_key; // The key of the applied result, the permutation is selected again when it changes.
+
+	// The measurement in progress, it is cancelled when the key changes or a benchmark starts.
+	bool nbody_autotune_active = false;
+	std::string nbody_autotune_key;
+	int nbody_autotune_kernel = 0;
+	int nbody_autotune_particle_count = 0;
+	int nbody_autotune_next = 0; // The next permutation to dispatch.
+	std::vector<glm::ivec2> nbody_autotune_permutations; // The workgroup size and unroll indices, the selected one first.
+	std::vector<std::unique_ptr<CachedShaderProgram>> nbody_autotune_programs;
+	std::vector<GLuint> nbody_autotune_queries;
+	GLuint nbody_autotune_velocities_buffer = 0; // The velocity of the last measured particle of each permutation.
+	GLsync nbody_autotune_fence = nullptr; // Signalled when the last permutation is done.
+
+	// The last measurement, the permutations whose results differ from the current one are rejected.
+	int nbody_autotune_count = 0; // The permutations measured.
+	int nbody_autotune_rejected = 0;
+	float nbody_autotune_best_time = 0.0f; // In milliseconds per step.
+	float nbody_autotune_default_time = 0.0f; // The time of the permutation selected before the measurement.
+
+	// -- N-Body Energy Drift --
+	// The total energy and momentum are measured on the GPU every few frames and compared with the first measurement
+	// after a reset (or a change of the model), which shows how accurate each kernel, precision and integrator is.
+	bool nbody_track_drift = false;
+	int nbody_drift_interval = 30; // In frames.
+	int nbody_drift_frame = 0;
+
+	GLuint nbody_energy_partials_buffer;
+	GLuint nbody_energy_totals_buffer;
+	AsyncReadback nbody_energy_readback{ sizeof(glm::vec4) * 2 };
+
+	// The measurements of an older generation (before the last reset of the baseline) are dropped.
+	int nbody_drift_generation = 0;
+	bool nbody_drift_baseline_valid = false;
+	float nbody_baseline_energy = 0.0f;
+	glm::vec3 nbody_baseline_momentum = glm::vec3(0.0f);
+	uint32_t nbody_baseline_step = 0;
+
+	float nbody_energy = 0.0f;
+	float nbody_energy_drift = 0.0f; // Relative to the baseline energy.
+	float nbody_momentum_drift = 0.0f; // The length of the change of the total momentum per body.
+	uint32_t nbody_drift_steps = 0; // The steps between the baseline and the last measurement.
+
+	// -- Barnes-Hut --
+	// The tree is a binary radix tree over the sorted Morton codes, each inner node splits its particles into the halves
+	// of its cube, so it is as deep as the particles are clustered. There are one fewer inner nodes than particles.
+	GLuint bh_bounds_buffer;
+	GLuint bh_particle_keys_buffer;
+	GLuint bh_particle_indices_buffer;
+	GLuint bh_sorted_positions_buffer;
+	GLuint bh_links_buffer;
+	GLuint bh_parents_buffer;
+	GLuint bh_visits_buffer;
+	GLuint bh_nodes_buffer;
+	GLuint bh_saved_velocities_buffer;
+
+	// The nodes with at most this many particles are summed directly instead of being opened.
+	const int bh_leaf_size = 8;
+
+	// The opening angle, smaller values are more accurate.
+	float bh_theta = 0.5f;
+
+	// The number of particles compared by the accuracy check, spread evenly over all particles. Only these are evaluated
+	// by both kernels, so the direct sum costs O(samples * N).
+	const int bh_accuracy_sample_count = 16384;
+	GLuint bh_sampled_accelerations_buffer; // The accelerations of the direct sum followed by those of Barnes-Hut.
+	GLuint bh_accuracy_queries[2];
+	bool bh_accuracy_check_requested = false;
+	float bh_mean_error = 0.0f;
+	float bh_max_error = 0.0f;
+	float bh_direct_time = 0.0f;
+	float bh_tree_time = 0.0f;
+
+	// -- Prefix Sum --
+	// This must be the same as BLOCK_SIZE in prefix_sum(_add).comp
+	const int scan_block_size = 512;
+
+	// The block sums of each recursion level of the scan.
+	std::vector<GLuint> scan_block_sums_buffers;
+
+	// -- Radix Sort --
+	// This must be the same as DIGIT_COUNT and DIGIT_BITS in radix_count.comp and radix_scatter.comp.
+	const int radix_digit_count = 16;
+	const int radix_digit_bits = 4;
+
+	// The keys written by sort_keys.comp, these must be the same as SORT_KEYS_* in sort_keys.comp.
+	const int SORT_KEYS_BOUNDS = 0;
+	const int SORT_KEYS_MORTON = 1;
+	const int SORT_KEYS_DEPTH = 2;
+
+	// The keys and the values (particle indices) of the particles, the other half of each pass and the per-group digit counts.
+	GLuint sort_keys_buffer;
+	GLuint sort_values_buffer;
+	GLuint sort_keys_alt_buffer;
+	GLuint sort_values_alt_buffer;
+	GLuint sort_digit_counts_buffer;
+
+	// The sort of random keys measured on the current number of particles.
+	bool sort_benchmark_requested = false;
+	bool sort_benchmark_valid = false; // Whether the keys were sorted correctly.
+	int sort_benchmark_count = 0;
+	float sort_time_32 = 0.0f; // The duration of sorting 32-bit keys in milliseconds.
+	float sort_time_30 = 0.0f; // The duration of sorting 30-bit keys (the Morton codes) in milliseconds.
+	GLuint sort_benchmark_queries[2]; // The duration of each sort, separate from the frame timers.
+
+	// -- Morton Reordering --
+	// The particles are periodically reordered along a Morton curve, so the particles close in space are close in memory.
+	bool morton_reordering = false;
+	int morton_reorder_interval = 256; // In simulation steps.
+
+	// -- Fluid (Spatial Hash) --
+	// The cells of an unbounded uniform grid are hashed into a power of two buckets (see CpuSimulation::get_hash_table_size),
+	// the particles are sorted by their bucket with a counting sort so that the neighbours are found in the 27 surrounding cells.
+	GLuint grid_cell_starts_buffer;
+	GLuint grid_particle_keys_buffer;
+	GLuint grid_sorted_particles_buffer;
+
+	// The range of the interactions (also the size of the grid cells) and the strengths of the forces.
+	float fluid_interaction_radius = 1.0f;
+	float fluid_repulsion = 4000.0f;
+	float fluid_cohesion = 400.0f;
+	float fluid_containment = 50.0f;
+
+	// The GPU times of the simulation steps and of the rendering, collected a few frames later without waiting.
+	GpuTimer compute_timer;
+	GpuTimer render_timer;
+	float compute_time_gpu = 0.0f; // The duration of the simulation steps of a recent frame in milliseconds.
+
+	// -- Profiling --
+	// The GPU sections of the stages, the CPU sections are recorded by PROFILE_SCOPE into Profiler::get().
+	GpuProfiler gpu_profiler;
+	bool show_frame_breakdown = false;
+	std::filesystem::path trace_path = "trace.json";
+
+	// The sections of the frame shown in the breakdown panel.
+	std::vector<ProfileEvent> frame_breakdown_events;
+
+	// -- Benchmark --
+	// Sweeps all scenes over the particle counts (and optionally the billboard modes) with one simulation step per frame,
+	// '--benchmark <file>' starts it at startup. The results are written as JSON if the file ends with '.json', as CSV otherwise.
+	BenchmarkSuite benchmark;
+	std::filesystem::path benchmark_path = "benchmark.csv";
+	int benchmark_warmup_frames = 16;
+	int benchmark_measured_frames = 128;
+	bool benchmark_billboards = false;
+
+	// The larger counts of a scene are skipped once its median frame takes longer (in milliseconds).
+	float benchmark_frame_limit = 250.0f;
+
+	// The settings restored when the sweep ends.
+	int benchmark_saved_display_mode = 0;
+	int benchmark_saved_particle_count = 0;
+	int benchmark_saved_billboard_mode = 0;
+
+	// The start of the CPU work of the current frame.
+	std::chrono::high_resolution_clock::time_point benchmark_frame_start;
+
+	// -- Simulation Timing --
+	// The simulation advances in fixed steps of 1000 / simulation_rate milliseconds, independently of the frame rate.
+	int simulation_rate = 240;
+
+	// The maximum number of steps per frame, the time the simulation cannot catch up with is dropped.
+	int max_substeps = 8;
+
+	// The frame time not yet consumed by the simulation steps (in milliseconds).
+	float simulation_accumulator = 0.0f;
+
+	// The time of the simulation (in milliseconds), used instead of the elapsed time by the update rules.
+	double simulation_time = 0.0;
+
+	// The number of steps taken in the last frame.
+	int simulation_steps = 0;
+
+	// The number of steps since the particles were reset, the counter of the random numbers of the respawns.
+	uint32_t simulation_step_index = 0;
 
 	// -- Particle Surface Estimator --
 	Mesh mesh;
-	GLuint mesh_position_buffer;
-	GLuint mesh_index_buffer;
+	// The flattened triangles and the alias table sampling them by area (see surface_estimator.comp).
+	GLuint mesh_triangle_buffer = 0;
+	GLuint mesh_alias_buffer = 0;
+
+	// The cached target point of each particle, recomputed when the mesh generation changes.
+	GLuint surface_target_buffer;
+	int mesh_generation = 0;
+
+	// Loads the models in the background, the new model is swapped in once its buffers are uploaded.
+	MeshLoader mesh_loader;
+	Mesh pending_mesh;
+	GLuint pending_mesh_triangle_buffer = 0;
+	GLuint pending_mesh_alias_buffer = 0;
+	GLsync pending_mesh_fence = nullptr;
 
 	const std::string GOLEM_MODEL = "models/golem.obj";
 	const std::string CUBE_MODEL = "models/cube.obj";
@@ -113,6 +574,9 @@ protected:
 
 	int current_model = SELECT_GOLEM_MODEL;
 
+	// This must be the same as the default 'attractor_force' in surface_estimator.comp.
+	const float surface_attraction_force = 9.81f;
+
 	int model_vertex_count = 0;
 	int model_index_count = 0;
 
@@ -123,8 +587,9 @@ protected:
 	const int DISPLAY_MULTI_ATTRACTOR_SCENE = 2;
 	const int DISPLAY_NBODY_SCENE = 3;
 	const int DISPLAY_PARTICLE_SURFACE_ESTIMATOR_SCENE = 4;
+	const int DISPLAY_FLUID_SCENE = 5;
 	
-	const char* DISPLAY_NAMES[5] = { "Sphere Pulsating", "Single Attractor", "Multi Attractor", "N-Body", "Particle-Surface Est."};
+	const char* DISPLAY_NAMES[6] = { "Sphere Pulsating", "Single Attractor", "Multi Attractor", "N-Body", "Particle-Surface Est.", "Fluid (Spatial Hash)"};
 
 	int display_mode = DISPLAY_PULSATING_SCENE;
 
@@ -161,27 +626,201 @@ public:
 	/** Resizes the full screen textures match the window. */
 	void resize_fullscreen_textures();
 
+	/** Returns by how much the particle target is smaller than the window along each axis */
+	int get_particle_resolution_divisor() const;
+
 	/** Resets the particles */
 	void reset_particles();
 
-	/** Updates the particles on CPU */
-	void update_particles_buffer();
+	/** Forgets the cached targets of the surface estimator on both backends, they are drawn again from the current seed */
+	void clear_surface_targets();
+
+	/** Generates the initial state of the given range of particles of the current scene directly in the GPU buffers (particle_init.comp) */
+	void initialize_particles_gpu(int first, int count);
+
+	/** Generates the initial state of the given range of particles of the current scene in the CPU arrays (ParticleInitializer) */
+	void initialize_particles_cpu(int first, int count);
+
+	/** Applies the desired particle count and uploads the particles, only the added ones if the simulated ones are kept */
+	void update_particles_buffer(bool keep_simulated = false);
 
 	// Update
 	void update(float delta) override;
 
-	/** Updates the particles on GPU */
-	void update_particles_gpu();
+	/** Updates the particles on GPU by the given number of fixed steps */
+	void update_particles_gpu(int step_count);
+
+	/** Returns the fixed time step in the units used by the shaders */
+	float get_simulation_step() const;
+
+	/** Returns the maximum number of particles the pulsating scene respawns per step (on both backends). */
+	int get_emission_count() const;
+
+	/** Dispatches the compute pass advancing the current scene by one fixed step */
+	void dispatch_simulation_step();
+
+	/** Rebuilds the lists of live and dead particles of the pulsating scene from their remaining lifetime */
+	void compact_particles();
 
-	/** Updates the selected model */
+	/** Dispatches one step of the given N-Body kernel (NBODY_*_KERNEL) from the read to the write positions. */
+	void dispatch_nbody_kernel(int kernel, float time_step);
+
+	/** Sets the uniforms of the N-Body kernel program and dispatches it for the first particles, the buffers (and the packed positions) must be ready. */
+	void run_nbody_program(CachedShaderProgram& program, int kernel, int workgroup_size, float time_step, int particle_count);
+
+	/** Sets the uniforms of the N-Body kernel program (and uses it) for the given number of particles. */
+	void set_nbody_uniforms(CachedShaderProgram& program, int kernel, float time_step, int particle_count);
+
+	/** Returns the workgroup size the given N-Body kernel is dispatched with. */
+	int get_nbody_workgroup_size(int kernel) const;
+
+	/** Returns the defines of the permutation of the given direct N-Body kernel. */
+	ShaderDefines get_nbody_defines(int kernel, int workgroup_size, int unroll) const;
+
+	/** Returns the defines of the multi-attractor update for the current number of attractors. */
+	ShaderDefines get_multi_attractor_defines() const;
+
+	/** Registers the permuted programs with the selected defines, returns whether any of them changed. */
+	bool add_permuted_programs();
+
+	/** Rebuilds the permuted programs whose permutation changed since they were built. */
+	void update_shader_permutations();
+
+	/** Returns the key of the autotuner results of the current N-Body kernel, options and particle count. */
+	std::string get_nbody_tuning_key() const;
+
+	/** Applies the remembered permutation of the current N-Body configuration, or measures it (automatically or on request). */
+	void select_nbody_permutation();
+
+	/** Builds all permutations of the current direct N-Body kernel and starts measuring them under the given key. */
+	void begin_nbody_autotune(const std::string& key);
+
+	/** Dispatches the next permutation, or selects the fastest one once the GPU has finished all of them. */
+	void continue_nbody_autotune();
+
+	/** Dispatches the given permutation on the measured particles, restoring their velocities afterwards. */
+	void measure_nbody_permutation(int permutation);
+
+	/** Reads the results of the finished measurement, applies the fastest permutation and remembers it. */
+	void finish_nbody_autotune();
+
+	/** Drops the programs, queries and buffer of the measurement, without applying anything. */
+	void release_nbody_autotune();
+
+	/** Measures the total energy and momentum every few frames and updates the drift from the results that arrived. */
+	void track_nbody_drift();
+
+	/** Takes the next measurement of the energy and momentum as the new baseline. */
+	void reset_nbody_drift();
+
+	/** Builds the Barnes-Hut tree from the current read positions. */
+	void build_barnes_hut_tree();
+
+	/** Compares the Barnes-Hut accelerations with the direct-sum kernel on the current state. */
+	void check_barnes_hut_accuracy();
+
+	/** Scatters the attractors beyond the edited ones and picks the orbit speeds of all of them from the seed. */
+	void scatter_attractors();
+
+	/** Moves the attractors to their positions at the current simulation time (DISPLAY_MULTI_ATTRACTOR_SCENE). */
+	void animate_attractor_points();
+
+	/** Uploads the moved attractors and marks the force field as stale. */
+	void upload_attractors();
+
+	/** Rebakes the stale slices of the force field, reallocating it first if its resolution changed. */
+	void refresh_force_field();
+
+	/** Sorts the particles into the buckets of the spatial hash grid (DISPLAY_FLUID_SCENE). */
+	void build_spatial_grid();
+
+	/** Allocates the scratch buffers for scanning up to the given number of elements. */
+	void prepare_scan_buffers(int max_count);
+
+	/** Replaces the unsigned integers in the buffer with their exclusive prefix sum. */
+	void exclusive_scan(GLuint buffer, int count, int level = 0);
+
+	/** Allocates the key, value and digit count buffers for sorting up to the given number of elements. */
+	void prepare_sort_buffers(int max_count);
+
+	/** Sorts the values by the lowest bits of their unsigned integer keys in place (stable, 4 bits per pass). */
+	void radix_sort(GLuint keys, GLuint values, int count, int key_bits);
+
+	/** Writes the keys of the given kind (SORT_KEYS_*) and the particle indices of the current scene into the sort buffers. */
+	void compute_sort_keys(int key_mode);
+
+	/** Moves the words [offset, offset + word_count) of each particle of the stream into the order of sort_values_buffer. */
+	void permute_particle_stream(GLuint stream, int stride, int offset, int word_count);
+
+	/** Reorders all particle streams of the current scene along the Morton curve of their positions (GPU backend). */
+	void reorder_particles();
+
+	/** Sorts the particles back to front for the alpha-blended smoke. */
+	void sort_particles_by_depth();
+
+	/** Measures the radix sort on random keys, as many as there are particles. */
+	void measure_sort_throughput();
+
+	/** Finds the particles of the current scene inside the view frustum, split into the quads and the distant points. */
+	void cull_particles();
+
+	/** Uploads the given range of the CPU particles into the buffers of the current layout */
+	void upload_particles_buffer(int first, int count);
+
+	/** Converts the particles on GPU into a different layout */
+	void set_particle_layout(int layout, bool half_precision);
+
+	/** Binds the particle buffer, or the given streams of the structure-of-arrays layout */
+	void bind_particle_streams(CachedShaderProgram& program, bool velocity, bool color, bool lifetime);
+
+	/** Returns the number of bytes each particle reads and writes per step and render in the current scene and layout */
+	int get_particle_traffic() const;
+
+	/** Updates the particles on CPU by the given number of fixed steps and uploads them for rendering */
+	void update_particles_cpu(int step_count);
+
+	/** Runs one step of the current scene on the CPU arrays */
+	void simulate_particles_cpu();
+
+	/** Reads the current particle state from GPU back into the CPU arrays */
+	void download_particles_buffer();
+
+	/** Compares one GPU compute step with one CPU step from the same state */
+	void check_gpu_parity();
+
+	/** Saves the particles of the current scene and the scene parameters into checkpoint_path */
+	bool save_checkpoint();
+
+	/** Restores the state saved by save_checkpoint, uploading the particles straight from the mapped file */
+	bool restore_checkpoint();
+
+	/** Renders the CPU and GPU sections of the newest complete frame as a tree of bars */
+	void render_frame_breakdown();
+
+	/** Starts the benchmark sweep with the current settings */
+	void start_benchmark();
+
+	/** Switches to the next case of the benchmark when the previous one is finished */
+	void begin_benchmark_frame();
+
+	/** Records the times of the frame for the benchmark, finishes it after the last case */
+	void end_benchmark_frame();
+
+	/** Writes the benchmark results and restores the settings from before the sweep */
+	void finish_benchmark();
+
+	/** Requests loading the selected model in the background */
 	void update_model();
 
+	/** Swaps in the requested model once it is loaded and uploaded, never waits */
+	void poll_model();
+
 	// Render Modes
 public:
 	/** Render Sphere Pulsating Simulation (DISPLAY_PULSATING_SCENE) */
 	void render_pulsating_simulation();
 
-	/** Render Attracting Particles Simulation (DISPLAY_SINGLE_ATTRACTOR_SCENE) */
+	/** Render Attracting Particles Simulation (DISPLAY_SINGLE_ATTRACTOR_SCENE, also DISPLAY_FLUID_SCENE) */
 	void render_attracting_simulation();
 
 	/** Render Attracting Particles Simulation (DISPLAY_MULTI_ATTRACTOR_SCENE) */
@@ -193,6 +832,24 @@ public:
 	/** Render Particle Surface Estimator (DISPLAY_PARTICLE_SURFACE_ESTIMATOR_SCENE) */
 	void render_surface_estimator();
 
+	/** Renders the distant particles found by the cull pass as single-pixel points */
+	void render_particle_points();
+
+	/** Upsamples the reduced-resolution particles onto the bound framebuffer */
+	void composite_particles();
+
+	/** Renders the particles of the current scene (without clearing the framebuffer) */
+	void render_scene();
+
+	/** Issues the draw call expanding the particles into quads with the current billboard mode, optionally with the arguments in GL_DRAW_INDIRECT_BUFFER */
+	void draw_particle_billboards(CachedShaderProgram& program, bool indirect = false);
+
+	/** Sets the blending, the particle texture and the opacity of the current blend mode */
+	void bind_particle_blending(CachedShaderProgram& program);
+
+	/** Measures the render time of the current scene with each billboard mode */
+	void compare_billboard_modes();
+
 public:
 	// Render
 	void render() override;
@@ -208,9 +865,4 @@ public:
 public:
 	// On Key Pressed Callback
 	void on_key_pressed(int key, int scancode, int action, int mods) override;
-
-public:
-	// Helper Functions
-	glm::vec3 random_inside_sphere(float radius);
-	void from_file(std::filesystem::path path, bool center_vertices);
 };
\ No newline at end of file
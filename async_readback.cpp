@@ -0,0 +1,47 @@
+#include "async_readback.hpp"
+#include <cstring>
+
+AsyncReadback::AsyncReadback(size_t size, int slot_count) : size(size), slot_fences(slot_count, nullptr) {
+	const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glCreateBuffers(1, &readback_buffer);
+	glNamedBufferStorage(readback_buffer, size * slot_count, nullptr, flags);
+	mapped_data = static_cast<const char*>(glMapNamedBufferRange(readback_buffer, 0, size * slot_count, flags));
+}
+
+AsyncReadback::~AsyncReadback() {
+	for (GLsync fence : slot_fences) {
+		if (fence != nullptr) glDeleteSync(fence);
+	}
+	glUnmapNamedBuffer(readback_buffer);
+	glDeleteBuffers(1, &readback_buffer);
+}
+
+void AsyncReadback::request(GLuint source, size_t offset) {
+	// All slots are in flight, the GPU is too far behind to wait for it here.
+	if (slot_fences[next] != nullptr) return;
+
+	glCopyNamedBufferSubData(source, readback_buffer, offset, next * size, size);
+	slot_fences[next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	next = (next + 1) % static_cast<int>(slot_fences.size());
+}
+
+bool AsyncReadback::poll(void* data) {
+	bool finished = false;
+
+	while (slot_fences[oldest] != nullptr) {
+		// A zero timeout only checks the fence.
+		const GLenum result = glClientWaitSync(slot_fences[oldest], 0, 0);
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) break;
+
+		// The coherent mapping makes the copied data visible once the fence has signaled.
+		std::memcpy(data, mapped_data + oldest * size, size);
+		finished = true;
+
+		glDeleteSync(slot_fences[oldest]);
+		slot_fences[oldest] = nullptr;
+		oldest = (oldest + 1) % static_cast<int>(slot_fences.size());
+	}
+
+	return finished;
+}
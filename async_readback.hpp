@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Reads small amounts of data (e.g., counters) back from GPU buffers without waiting for the GPU.
+ *
+ * Each request copies the data into the next slot of a persistently mapped ring and fences it; the data is
+ * used once the fence has signaled, frames later. If the ring is full, the request is dropped instead of waited for.
+ */
+class AsyncReadback {
+public:
+	/** Creates the ring for reading the given number of bytes, with the given number of requests in flight. */
+	explicit AsyncReadback(size_t size, int slot_count = 4);
+
+	/** Deletes the fences, unmaps and deletes the readback buffer. */
+	~AsyncReadback();
+
+	AsyncReadback(const AsyncReadback&) = delete;
+	AsyncReadback& operator=(const AsyncReadback&) = delete;
+
+	/** Copies the data at the given offset of the source buffer into the next free slot. */
+	void request(GLuint source, size_t offset);
+
+	/** Copies the newest finished data into the output, returns false if no request has finished since the last call. */
+	bool poll(void* data);
+
+protected:
+	GLuint readback_buffer = 0;
+	const char* mapped_data = nullptr;
+	size_t size;
+
+	// The fence after the copy into each slot (or null if the slot is free).
+	std::vector<GLsync> slot_fences;
+	int oldest = 0;
+	int next = 0;
+};
@@ -0,0 +1,174 @@
+#include "benchmark_suite.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+void BenchmarkSuite::start(const std::vector<int>& scenes, int min_count, int max_count, const std::vector<int>& billboard_modes,
+	int warmup_frames, int measured_frames, float frame_time_limit) {
+	cases.clear();
+	results.clear();
+
+	// The counts of each scene are in increasing order so that the frame time limit can skip the rest.
+	for (int scene : scenes) {
+		for (int count = min_count; count <= max_count; count *= 2) {
+			for (int billboard_mode : billboard_modes) {
+				cases.push_back({ scene, count, billboard_mode });
+			}
+		}
+	}
+	skipped.assign(cases.size(), false);
+
+	this->warmup_frames = warmup_frames;
+	this->measured_frames = std::max(measured_frames, 1);
+	this->frame_time_limit = frame_time_limit;
+
+	case_index = 0;
+	frame_index = 0;
+	case_started = false;
+	running = !cases.empty();
+}
+
+void BenchmarkSuite::stop() {
+	running = false;
+}
+
+bool BenchmarkSuite::begin_frame(BenchmarkCase& next_case) {
+	if (!running || case_started) return false;
+
+	case_started = true;
+	frame_index = 0;
+	cpu_frame_samples.clear();
+	compute_samples.clear();
+	render_samples.clear();
+
+	next_case = cases[case_index];
+	return true;
+}
+
+void BenchmarkSuite::end_frame(float cpu_frame_time, float compute_time, float render_time) {
+	if (!running || !case_started) return;
+
+	if (frame_index >= warmup_frames) {
+		cpu_frame_samples.push_back(cpu_frame_time);
+		compute_samples.push_back(compute_time);
+		render_samples.push_back(render_time);
+	}
+	frame_index++;
+
+	if (frame_index >= warmup_frames + measured_frames) {
+		finish_case();
+		advance();
+	}
+}
+
+void BenchmarkSuite::finish_case() {
+	const float fractions[3] = { 0.50f, 0.95f, 0.99f };
+
+	BenchmarkResult result;
+	result.benchmark_case = cases[case_index];
+	for (int i = 0; i < 3; i++) {
+		result.cpu_frame[i] = percentile(cpu_frame_samples, fractions[i]);
+		result.compute[i] = percentile(compute_samples, fractions[i]);
+		result.gpu_render[i] = percentile(render_samples, fractions[i]);
+	}
+	results.push_back(result);
+
+	// The larger counts of the scene would only be slower, they are skipped once a typical frame is over the limit.
+	const float frame_time = std::max({ result.cpu_frame[0], result.compute[0], result.gpu_render[0] });
+	if (frame_time_limit > 0.0f && frame_time > frame_time_limit) {
+		for (size_t i = case_index + 1; i < cases.size(); i++) {
+			if (cases[i].scene == result.benchmark_case.scene && cases[i].particle_count > result.benchmark_case.particle_count) {
+				skipped[i] = true;
+			}
+		}
+	}
+}
+
+void BenchmarkSuite::advance() {
+	case_started = false;
+
+	for (case_index++; case_index < static_cast<int>(cases.size()); case_index++) {
+		if (!skipped[case_index]) return;
+
+		BenchmarkResult result;
+		result.benchmark_case = cases[case_index];
+		result.skipped = true;
+		results.push_back(result);
+	}
+
+	running = false;
+}
+
+float BenchmarkSuite::percentile(std::vector<float> values, float fraction) {
+	if (values.empty()) return 0.0f;
+
+	// The nearest rank: the smallest value that is at least the given fraction of the values.
+	const size_t rank = static_cast<size_t>(std::ceil(fraction * static_cast<float>(values.size())));
+	const size_t index = std::min(std::max(rank, size_t(1)), values.size()) - 1;
+	std::nth_element(values.begin(), values.begin() + index, values.end());
+	return values[index];
+}
+
+bool BenchmarkSuite::write(const std::filesystem::path& path, const std::vector<std::string>& scene_names, const std::vector<std::string>& billboard_names,
+	const std::string& backend_name, const std::string& layout_name) const {
+	std::ofstream stream(path, std::ios::trunc);
+	if (!stream) return false;
+
+	const bool json = path.extension() == ".json";
+	const char* percentile_names[3] = { "p50", "p95", "p99" };
+
+	if (json) {
+		stream << "{\n";
+		stream << "  \"backend\": \"" << backend_name << "\",\n";
+		stream << "  \"layout\": \"" << layout_name << "\",\n";
+		stream << "  \"warmup_frames\": " << warmup_frames << ",\n";
+		stream << "  \"measured_frames\": " << measured_frames << ",\n";
+		stream << "  \"results\": [\n";
+	}
+	else {
+		stream << "scene,particle_count,billboards,backend,layout,skipped";
+		for (const char* series : { "cpu_frame", "compute", "gpu_render" }) {
+			for (const char* name : percentile_names) {
+				stream << "," << series << "_" << name << "_ms";
+			}
+		}
+		stream << "\n";
+	}
+
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchmarkResult& result = results[i];
+		const std::string& scene_name = scene_names[result.benchmark_case.scene];
+		const std::string& billboard_name = billboard_names[result.benchmark_case.billboard_mode];
+		const float* series[3] = { result.cpu_frame, result.compute, result.gpu_render };
+
+		if (json) {
+			stream << "    { \"scene\": \"" << scene_name << "\", \"particle_count\": " << result.benchmark_case.particle_count
+				<< ", \"billboards\": \"" << billboard_name << "\", \"skipped\": " << (result.skipped ? "true" : "false");
+			const char* series_names[3] = { "cpu_frame_ms", "compute_ms", "gpu_render_ms" };
+			for (int s = 0; s < 3; s++) {
+				stream << ", \"" << series_names[s] << "\": { ";
+				for (int p = 0; p < 3; p++) {
+					stream << "\"" << percentile_names[p] << "\": " << series[s][p] << (p < 2 ? ", " : " }");
+				}
+			}
+			stream << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+		}
+		else {
+			stream << scene_name << "," << result.benchmark_case.particle_count << "," << billboard_name << "," << backend_name << ","
+				<< layout_name << "," << (result.skipped ? 1 : 0);
+			for (int s = 0; s < 3; s++) {
+				for (int p = 0; p < 3; p++) {
+					stream << "," << series[s][p];
+				}
+			}
+			stream << "\n";
+		}
+	}
+
+	if (json) {
+		stream << "  ]\n";
+		stream << "}\n";
+	}
+
+	return static_cast<bool>(stream);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/** One configuration measured by the {@link BenchmarkSuite}. */
+struct BenchmarkCase {
+	int scene;
+	int particle_count;
+	int billboard_mode;
+};
+
+/** The measured times of one {@link BenchmarkCase} in milliseconds: the 50th, 95th and 99th percentile. */
+struct BenchmarkResult {
+	BenchmarkCase benchmark_case;
+	// Whether the case was not run because a smaller count of the same scene already exceeded the frame time limit.
+	bool skipped = false;
+	float cpu_frame[3] = { 0.0f, 0.0f, 0.0f };
+	float compute[3] = { 0.0f, 0.0f, 0.0f };
+	float gpu_render[3] = { 0.0f, 0.0f, 0.0f };
+};
+
+/**
+ * Sweeps the scenes, particle counts and billboard modes and collects the frame time percentiles of each combination.
+ *
+ * The suite only plans the cases and keeps the samples, the application drives it from its frame loop: {@link begin_frame}
+ * says when to switch to the next case, {@link end_frame} records the times of the frame. Each case runs a number of warmup
+ * frames that are not recorded (they also cover the frames the GPU timers lag behind) followed by the measured frames.
+ * Once a case of a scene exceeds the frame time limit, the larger particle counts of the scene are skipped, so the sweep
+ * records where each scene falls off its scaling curve without stalling on the quadratic ones.
+ */
+class BenchmarkSuite {
+public:
+	/** Plans every combination of the scenes, the power of two counts from min_count to max_count and the billboard modes, and starts the first one. */
+	void start(const std::vector<int>& scenes, int min_count, int max_count, const std::vector<int>& billboard_modes,
+		int warmup_frames, int measured_frames, float frame_time_limit);
+
+	/** Stops the sweep, the results of the finished cases are kept. */
+	void stop();
+
+	/** Returns whether the sweep has cases left. */
+	bool is_running() const { return running; }
+
+	/** Starts a frame, returns true (and the case) if the application has to switch to a new case before it. */
+	bool begin_frame(BenchmarkCase& next_case);
+
+	/** Records the times of the frame (in milliseconds) and moves to the next case when the current one has all its frames. */
+	void end_frame(float cpu_frame_time, float compute_time, float render_time);
+
+	/** Returns the results of the finished (and skipped) cases. */
+	const std::vector<BenchmarkResult>& get_results() const { return results; }
+
+	/** Returns the index of the current case. */
+	int get_case_index() const { return case_index; }
+
+	/** Returns the number of planned cases. */
+	int get_case_count() const { return static_cast<int>(cases.size()); }
+
+	/** Writes the results as JSON if the path ends with '.json' and as CSV otherwise, the names describe the scenes, billboard modes and the configuration. */
+	bool write(const std::filesystem::path& path, const std::vector<std::string>& scene_names, const std::vector<std::string>& billboard_names,
+		const std::string& backend_name, const std::string& layout_name) const;
+
+	/** Returns the given percentile (0 to 1) of the values by the nearest rank method. */
+	static float percentile(std::vector<float> values, float fraction);
+
+protected:
+	/** Computes the percentiles of the current case and marks the cases it rules out as skipped. */
+	void finish_case();
+
+	/** Moves to the next case that is not skipped, stops after the last one. */
+	void advance();
+
+protected:
+	std::vector<BenchmarkCase> cases;
+	std::vector<bool> skipped;
+	std::vector<BenchmarkResult> results;
+
+	int warmup_frames = 0;
+	int measured_frames = 0;
+	float frame_time_limit = 0.0f;
+
+	int case_index = 0;
+	int frame_index = 0;
+	bool case_started = false;
+	bool running = false;
+
+	// The samples of the measured frames of the current case.
+	std::vector<float> cpu_frame_samples;
+	std::vector<float> compute_samples;
+	std::vector<float> render_samples;
+};
@@ -0,0 +1,53 @@
+#include "checkpoint.hpp"
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+Checkpoint::Checkpoint(const std::filesystem::path& path) : file(path) {
+	if (file.get_data() == nullptr || file.get_size() < sizeof(CheckpointHeader)) return;
+
+	std::memcpy(&header, file.get_data(), sizeof(CheckpointHeader));
+	if (std::memcmp(header.magic, "PCKP", 4) != 0 || header.version != VERSION || header.header_size != sizeof(CheckpointHeader)) return;
+
+	for (int section = 0; section < CHECKPOINT_SECTION_COUNT; section++) {
+		if (header.section_offsets[section] > file.get_size() || header.section_sizes[section] > file.get_size() - header.section_offsets[section]) return;
+	}
+	valid = true;
+}
+
+bool Checkpoint::write(const std::filesystem::path& path, CheckpointHeader header, const void* const sections[CHECKPOINT_SECTION_COUNT],
+	const uint64_t section_sizes[CHECKPOINT_SECTION_COUNT]) {
+	std::memcpy(header.magic, "PCKP", 4);
+	header.version = VERSION;
+	header.header_size = sizeof(CheckpointHeader);
+
+	uint64_t offset = sizeof(CheckpointHeader);
+	for (int section = 0; section < CHECKPOINT_SECTION_COUNT; section++) {
+		offset = (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+		header.section_offsets[section] = offset;
+		header.section_sizes[section] = section_sizes[section];
+		offset += section_sizes[section];
+	}
+
+	// Writes into a temporary file first, so that a failed write never replaces a valid checkpoint.
+	std::filesystem::path temporary_path = path;
+	temporary_path += ".tmp";
+	{
+		std::ofstream stream(temporary_path, std::ios::binary | std::ios::trunc);
+		if (!stream) return false;
+
+		const std::vector<char> padding(SECTION_ALIGNMENT, 0);
+		stream.write(reinterpret_cast<const char*>(&header), sizeof(CheckpointHeader));
+		uint64_t position = sizeof(CheckpointHeader);
+		for (int section = 0; section < CHECKPOINT_SECTION_COUNT; section++) {
+			stream.write(padding.data(), header.section_offsets[section] - position);
+			stream.write(static_cast<const char*>(sections[section]), section_sizes[section]);
+			position = header.section_offsets[section] + section_sizes[section];
+		}
+		if (!stream) return false;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporary_path, path, error);
+	return !error;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "mapped_file.hpp"
+#include <cstdint>
+#include <filesystem>
+
+/** The sections of the particle data in a checkpoint. */
+enum CheckpointSection {
+	CHECKPOINT_PARTICLES = 0, // The particles (Particle) of the shader-simulated scenes.
+	CHECKPOINT_POSITIONS_0 = 1, // The first N-Body position buffer (vec4).
+	CHECKPOINT_POSITIONS_1 = 2, // The second N-Body position buffer (vec4).
+	CHECKPOINT_VELOCITIES = 3, // The N-Body velocities (vec4).
+	CHECKPOINT_SECTION_COUNT = 4
+};
+
+/** The header at the start of a checkpoint, with the scene parameters and the location of each section. */
+struct CheckpointHeader {
+	char magic[4]; // "PCKP"
+	uint32_t version;
+	uint32_t header_size; // sizeof(CheckpointHeader), guards against a different layout of the same version.
+
+	int32_t display_mode;
+	int32_t particle_count;
+	int32_t current_read; // The N-Body position buffer with the last written positions.
+	double simulation_time;
+	uint32_t random_seed;
+	uint32_t step_index; // The counter of the random numbers of the respawns.
+
+	int32_t attractor_used;
+	float attraction_force;
+	float attraction_points[10][3];
+
+	int32_t nbody_kernel;
+	float acceleration_factor;
+	float distance_threshold;
+	float bh_theta;
+	int32_t nbody_gravity_model;
+	float nbody_softening;
+	int32_t nbody_integrator;
+
+	float emission_limit;
+	int32_t current_model;
+
+	float fluid_interaction_radius;
+	float fluid_repulsion;
+	float fluid_cohesion;
+	float fluid_containment;
+
+	// The offset (page aligned) and the size of each section in bytes, empty sections are not used by the scene.
+	uint64_t section_offsets[CHECKPOINT_SECTION_COUNT];
+	uint64_t section_sizes[CHECKPOINT_SECTION_COUNT];
+};
+
+/**
+ * A versioned checkpoint of the whole simulation state, memory-mapped when it is restored.
+ *
+ * Each section starts at a page boundary, so the mapped sections can be handed directly to the buffer uploads
+ * without reading the file into memory first; the pages are loaded as the upload copies them.
+ */
+class Checkpoint {
+public:
+	/** The alignment of the sections in the file. */
+	static constexpr uint64_t SECTION_ALIGNMENT = 4096;
+
+	/** The current version of the format. */
+	static constexpr uint32_t VERSION = 3;
+
+	/** Maps the checkpoint, is_valid returns false if it cannot be read or is not a checkpoint of this version. */
+	explicit Checkpoint(const std::filesystem::path& path);
+
+	/** Returns whether the file is a complete checkpoint of the current version. */
+	bool is_valid() const { return valid; }
+
+	/** Returns the header with the scene parameters. */
+	const CheckpointHeader& get_header() const { return header; }
+
+	/** Returns the mapped data of the section. */
+	const void* get_section(CheckpointSection section) const { return file.get_data() + header.section_offsets[section]; }
+
+	/** Returns the size of the section in bytes. */
+	size_t get_section_size(CheckpointSection section) const { return static_cast<size_t>(header.section_sizes[section]); }
+
+	/** Writes the checkpoint, the header is completed with the magic, the version and the section locations. */
+	static bool write(const std::filesystem::path& path, CheckpointHeader header, const void* const sections[CHECKPOINT_SECTION_COUNT],
+		const uint64_t section_sizes[CHECKPOINT_SECTION_COUNT]);
+
+protected:
+	MappedFile file;
+	CheckpointHeader header{};
+	bool valid = false;
+};
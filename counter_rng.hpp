@@ -0,0 +1,73 @@
+#pragma once
+
+#include "particle.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+/**
+ * The counter-based random number generator shared by the C++ code and the shaders.
+ *
+ * Each draw hashes the particle index, a counter (e.g., the simulation step), the stream (what the numbers are used for)
+ * and the seed with the pcg4d permutation (Jarzynski and Olano, "Hash Functions for GPU Rendering"), so there is no
+ * state to carry: any particle can be generated independently and in any order, by any thread or SIMD lane, and the
+ * same seed always gives the same numbers. The integer hash is bit-exact on the CPU and the GPU, the conversion to
+ * floats keeps 24 bits so it is exact as well. The shaders contain copies of pcg4d and random_uniform, they must be
+ * the same as the functions here.
+ */
+class CounterRng {
+public:
+	/** The streams, i.e., the purposes of the random numbers (the same constants as RANDOM_STREAM_* in the shaders). */
+	static const uint32_t STREAM_POSITION = 0;
+	static const uint32_t STREAM_VELOCITY = 1;
+	static const uint32_t STREAM_COLOR = 2;
+	static const uint32_t STREAM_LIFETIME = 3;
+	static const uint32_t STREAM_EMIT = 4;
+	static const uint32_t STREAM_SURFACE = 5;
+	static const uint32_t STREAM_ROTATION = 6;
+	static const uint32_t STREAM_ATTRACTOR = 7;
+	static const uint32_t STREAM_SORT_KEYS = 8;
+
+	/** Permutes the four words, every output word depends on all input words. */
+	static glm::uvec4 pcg4d(glm::uvec4 v) {
+		v.x = v.x * 1664525u + 1013904223u;
+		v.y = v.y * 1664525u + 1013904223u;
+		v.z = v.z * 1664525u + 1013904223u;
+		v.w = v.w * 1664525u + 1013904223u;
+
+		v.x += v.y * v.w;
+		v.y += v.z * v.x;
+		v.z += v.x * v.y;
+		v.w += v.y * v.z;
+
+		v.x ^= v.x >> 16u;
+		v.y ^= v.y >> 16u;
+		v.z ^= v.z >> 16u;
+		v.w ^= v.w >> 16u;
+
+		v.x += v.y * v.w;
+		v.y += v.z * v.x;
+		v.z += v.x * v.y;
+		v.w += v.y * v.z;
+		return v;
+	}
+
+	/** Converts the upper 24 bits of the word into a float in [0, 1), exactly. */
+	static float to_unit_float(uint32_t word) {
+		return static_cast<float>(word >> 8u) * (1.0f / 16777216.0f);
+	}
+
+	/** Returns four uniform numbers in [0, 1) for the given particle, stream and counter. */
+	static glm::vec4 uniform(uint32_t seed, uint32_t index, uint32_t stream, uint32_t counter = 0) {
+		const glm::uvec4 words = pcg4d(glm::uvec4(index, counter, stream, seed));
+		return glm::vec4(to_unit_float(words.x), to_unit_float(words.y), to_unit_float(words.z), to_unit_float(words.w));
+	}
+
+	/** Maps three uniform numbers to a uniformly distributed point inside the sphere of the given radius. */
+	static glm::vec3 inside_sphere(float u, float v, float w, float radius) {
+		const float z = 2.0f * u - 1.0f;
+		const float phi = 6.28318530718f * v;
+		const float ring = std::sqrt(std::max(0.0f, 1.0f - z * z));
+		return glm::vec3(ring * std::cos(phi), ring * std::sin(phi), z) * (std::cbrt(w) * radius);
+	}
+};
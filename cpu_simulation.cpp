@@ -0,0 +1,602 @@
+#include "cpu_simulation.hpp"
+#include "counter_rng.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_SIMULATION_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define CPU_SIMULATION_X86 0
+#endif
+
+// GCC and Clang need the instruction set enabled per function, MSVC allows the intrinsics anywhere.
+#if defined(_MSC_VER)
+#define CPU_SIMULATION_TARGET(isa)
+#else
+#define CPU_SIMULATION_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace {
+	// The number of particles below which the update runs only on the calling thread.
+	constexpr int min_parallel_count = 4096;
+
+	// The streams are padded to a multiple of the widest SIMD register (16 floats).
+	constexpr int nbody_padding = 16;
+
+	// This must be the same as 'damping' in fluid_particle.comp.
+	constexpr float fluid_damping = 2.0f;
+
+	// The number of neighbours at which the fluid color saturates (see fluid_particle.comp).
+	constexpr float dense_neighbour_count = 32.0f;
+
+	CpuSimulation::SimdLevel detect_simd_level() {
+#if CPU_SIMULATION_X86
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		const bool os_saves_avx = (info[2] & (1 << 27)) != 0;
+		const bool fma = (info[2] & (1 << 12)) != 0;
+		__cpuidex(info, 7, 0);
+		const bool avx2 = (info[1] & (1 << 5)) != 0;
+		const bool avx512f = (info[1] & (1 << 16)) != 0;
+		const unsigned long long xcr0 = os_saves_avx ? _xgetbv(0) : 0;
+		if (avx512f && (xcr0 & 0xE6) == 0xE6) return CpuSimulation::SimdLevel::AVX512;
+		if (avx2 && fma && (xcr0 & 0x6) == 0x6) return CpuSimulation::SimdLevel::AVX2;
+#else
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f")) return CpuSimulation::SimdLevel::AVX512;
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return CpuSimulation::SimdLevel::AVX2;
+#endif
+#endif
+		return CpuSimulation::SimdLevel::Scalar;
+	}
+
+	// The summed acceleration acting on the position, without the acceleration factor (see nbody.comp).
+	glm::vec3 accumulate_nbody_scalar(const float* x, const float* y, const float* z, const float* mask, int count, glm::vec3 position, float distance_threshold) {
+		glm::vec3 acceleration(0.0f);
+		for (int j = 0; j < count; j++) {
+			const glm::vec3 dir(x[j] - position.x, y[j] - position.y, z[j] - position.z);
+			const float dist_sq = glm::dot(dir, dir);
+			if (dist_sq > distance_threshold) {
+				acceleration += mask[j] * dir / (dist_sq * std::sqrt(dist_sq));
+			}
+		}
+		return acceleration;
+	}
+
+	// The same as accumulate_nbody_scalar with Plummer softening instead of the cutoff.
+	glm::vec3 accumulate_plummer_scalar(const float* x, const float* y, const float* z, const float* mask, int count, glm::vec3 position, float softening_sq) {
+		glm::vec3 acceleration(0.0f);
+		for (int j = 0; j < count; j++) {
+			const glm::vec3 dir(x[j] - position.x, y[j] - position.y, z[j] - position.z);
+			const float inv_dist = 1.0f / std::sqrt(glm::dot(dir, dir) + softening_sq);
+			acceleration += mask[j] * dir * (inv_dist * inv_dist * inv_dist);
+		}
+		return acceleration;
+	}
+
+#if CPU_SIMULATION_X86
+	// CounterRng::pcg4d and CounterRng::to_unit_float of eight consecutive particles.
+	CPU_SIMULATION_TARGET("avx2,fma")
+	void uniform_avx2(uint32_t seed, uint32_t stream, uint32_t counter, uint32_t first, float* x, float* y, float* z, float* w) {
+		const __m256i multiplier = _mm256_set1_epi32(1664525);
+		const __m256i increment = _mm256_set1_epi32(1013904223);
+		const __m256 scale = _mm256_set1_ps(1.0f / 16777216.0f);
+		__m256i vx = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(first)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+		__m256i vy = _mm256_set1_epi32(static_cast<int>(counter));
+		__m256i vz = _mm256_set1_epi32(static_cast<int>(stream));
+		__m256i vw = _mm256_set1_epi32(static_cast<int>(seed));
+
+		vx = _mm256_add_epi32(_mm256_mullo_epi32(vx, multiplier), increment);
+		vy = _mm256_add_epi32(_mm256_mullo_epi32(vy, multiplier), increment);
+		vz = _mm256_add_epi32(_mm256_mullo_epi32(vz, multiplier), increment);
+		vw = _mm256_add_epi32(_mm256_mullo_epi32(vw, multiplier), increment);
+
+		vx = _mm256_add_epi32(vx, _mm256_mullo_epi32(vy, vw));
+		vy = _mm256_add_epi32(vy, _mm256_mullo_epi32(vz, vx));
+		vz = _mm256_add_epi32(vz, _mm256_mullo_epi32(vx, vy));
+		vw = _mm256_add_epi32(vw, _mm256_mullo_epi32(vy, vz));
+
+		vx = _mm256_xor_si256(vx, _mm256_srli_epi32(vx, 16));
+		vy = _mm256_xor_si256(vy, _mm256_srli_epi32(vy, 16));
+		vz = _mm256_xor_si256(vz, _mm256_srli_epi32(vz, 16));
+		vw = _mm256_xor_si256(vw, _mm256_srli_epi32(vw, 16));
+
+		vx = _mm256_add_epi32(vx, _mm256_mullo_epi32(vy, vw));
+		vy = _mm256_add_epi32(vy, _mm256_mullo_epi32(vz, vx));
+		vz = _mm256_add_epi32(vz, _mm256_mullo_epi32(vx, vy));
+		vw = _mm256_add_epi32(vw, _mm256_mullo_epi32(vy, vz));
+
+		// The upper 24 bits fit into a positive int, so the signed conversion is exact.
+		_mm256_storeu_ps(x, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(vx, 8)), scale));
+		_mm256_storeu_ps(y, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(vy, 8)), scale));
+		_mm256_storeu_ps(z, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(vz, 8)), scale));
+		_mm256_storeu_ps(w, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(vw, 8)), scale));
+	}
+
+	CPU_SIMULATION_TARGET("avx2,fma")
+	float horizontal_sum_avx2(__m256 value) {
+		__m128 sum = _mm_add_ps(_mm256_castps256_ps128(value), _mm256_extractf128_ps(value, 1));
+		sum = _mm_hadd_ps(sum, sum);
+		sum = _mm_hadd_ps(sum, sum);
+		return _mm_cvtss_f32(sum);
+	}
+
+	CPU_SIMULATION_TARGET("avx2,fma")
+	glm::vec3 accumulate_nbody_avx2(const float* x, const float* y, const float* z, const float* mask, int count, glm::vec3 position, float distance_threshold) {
+		const __m256 px = _mm256_set1_ps(position.x);
+		const __m256 py = _mm256_set1_ps(position.y);
+		const __m256 pz = _mm256_set1_ps(position.z);
+		const __m256 threshold = _mm256_set1_ps(distance_threshold);
+		const __m256 one = _mm256_set1_ps(1.0f);
+		__m256 ax = _mm256_setzero_ps();
+		__m256 ay = _mm256_setzero_ps();
+		__m256 az = _mm256_setzero_ps();
+
+		for (int j = 0; j < count; j += 8) {
+			const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + j), px);
+			const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + j), py);
+			const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + j), pz);
+			const __m256 dist_sq = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+
+			// The distance is clamped so that the masked out lanes never produce infinities.
+			const __m256 clamped = _mm256_max_ps(dist_sq, threshold);
+			__m256 scale = _mm256_div_ps(one, _mm256_mul_ps(clamped, _mm256_sqrt_ps(clamped)));
+			scale = _mm256_mul_ps(scale, _mm256_loadu_ps(mask + j));
+			scale = _mm256_and_ps(scale, _mm256_cmp_ps(dist_sq, threshold, _CMP_GT_OQ));
+
+			ax = _mm256_fmadd_ps(dx, scale, ax);
+			ay = _mm256_fmadd_ps(dy, scale, ay);
+			az = _mm256_fmadd_ps(dz, scale, az);
+		}
+		return glm::vec3(horizontal_sum_avx2(ax), horizontal_sum_avx2(ay), horizontal_sum_avx2(az));
+	}
+
+	CPU_SIMULATION_TARGET("avx2,fma")
+	glm::vec3 accumulate_plummer_avx2(const float* x, const float* y, const float* z, const float* mask, int count, glm::vec3 position, float softening_sq) {
+		const __m256 px = _mm256_set1_ps(position.x);
+		const __m256 py = _mm256_set1_ps(position.y);
+		const __m256 pz = _mm256_set1_ps(position.z);
+		const __m256 epsilon_sq = _mm256_set1_ps(softening_sq);
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 three_halves = _mm256_set1_ps(1.5f);
+		__m256 ax = _mm256_setzero_ps();
+		__m256 ay = _mm256_setzero_ps();
+		__m256 az = _mm256_setzero_ps();
+
+		for (int j = 0; j < count; j += 8) {
+			const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + j), px);
+			const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + j), py);
+			const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + j), pz);
+			const __m256 dist_sq = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dz, dz, epsilon_sq)));
+
+			// The 12-bit estimate of the inverse square root refined by one Newton-Raphson step, instead of a square root and a division.
+			__m256 inv_dist = _mm256_rsqrt_ps(dist_sq);
+			inv_dist = _mm256_mul_ps(inv_dist, _mm256_fnmadd_ps(_mm256_mul_ps(half, dist_sq), _mm256_mul_ps(inv_dist, inv_dist), three_halves));
+			const __m256 scale = _mm256_mul_ps(_mm256_mul_ps(inv_dist, _mm256_mul_ps(inv_dist, inv_dist)), _mm256_loadu_ps(mask + j));
+
+			ax = _mm256_fmadd_ps(dx, scale, ax);
+			ay = _mm256_fmadd_ps(dy, scale, ay);
+			az = _mm256_fmadd_ps(dz, scale, az);
+		}
+		return glm::vec3(horizontal_sum_avx2(ax), horizontal_sum_avx2(ay), horizontal_sum_avx2(az));
+	}
+
+	CPU_SIMULATION_TARGET("avx512f")
+	glm::vec3 accumulate_nbody_avx512(const float* x, const float* y, const float* z, const float* mask, int count, glm::vec3 position, float distance_threshold) {
+		const __m512 px = _mm512_set1_ps(position.x);
+		const __m512 py = _mm512_set1_ps(position.y);
+		const __m512 pz = _mm512_set1_ps(position.z);
+		const __m512 threshold = _mm512_set1_ps(distance_threshold);
+		const __m512 one = _mm512_set1_ps(1.0f);
+		__m512 ax = _mm512_setzero_ps();
+		__m512 ay = _mm512_setzero_ps();
+		__m512 az = _mm512_setzero_ps();
+
+		for (int j = 0; j < count; j += 16) {
+			const __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(x + j), px);
+			const __m512 dy = _mm512_sub_ps(_mm512_loadu_ps(y + j), py);
+			const __m512 dz = _mm512_sub_ps(_mm512_loadu_ps(z + j), pz);
+			const __m512 dist_sq = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz)));
+
+			// The distance is clamped so that the masked out lanes never produce infinities.
+			const __m512 clamped = _mm512_max_ps(dist_sq, threshold);
+			const __mmask16 active = _mm512_cmp_ps_mask(dist_sq, threshold, _CMP_GT_OQ);
+			__m512 scale = _mm512_div_ps(one, _mm512_mul_ps(clamped, _mm512_sqrt_ps(clamped)));
+			scale = _mm512_maskz_mul_ps(active, scale, _mm512_loadu_ps(mask + j));
+
+			ax = _mm512_fmadd_ps(dx, scale, ax);
+			ay = _mm512_fmadd_ps(dy, scale, ay);
+			az = _mm512_fmadd_ps(dz, scale, az);
+		}
+		return glm::vec3(_mm512_reduce_add_ps(ax), _mm512_reduce_add_ps(ay), _mm512_reduce_add_ps(az));
+	}
+
+	CPU_SIMULATION_TARGET("avx512f")
+	glm::vec3 accumulate_plummer_avx512(const float* x, const float* y, const float* z, const float* mask, int count, glm::vec3 position, float softening_sq) {
+		const __m512 px = _mm512_set1_ps(position.x);
+		const __m512 py = _mm512_set1_ps(position.y);
+		const __m512 pz = _mm512_set1_ps(position.z);
+		const __m512 epsilon_sq = _mm512_set1_ps(softening_sq);
+		const __m512 half = _mm512_set1_ps(0.5f);
+		const __m512 three_halves = _mm512_set1_ps(1.5f);
+		__m512 ax = _mm512_setzero_ps();
+		__m512 ay = _mm512_setzero_ps();
+		__m512 az = _mm512_setzero_ps();
+
+		for (int j = 0; j < count; j += 16) {
+			const __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(x + j), px);
+			const __m512 dy = _mm512_sub_ps(_mm512_loadu_ps(y + j), py);
+			const __m512 dz = _mm512_sub_ps(_mm512_loadu_ps(z + j), pz);
+			const __m512 dist_sq = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_fmadd_ps(dz, dz, epsilon_sq)));
+
+			// The 14-bit estimate of the inverse square root refined by one Newton-Raphson step.
+			__m512 inv_dist = _mm512_rsqrt14_ps(dist_sq);
+			inv_dist = _mm512_mul_ps(inv_dist, _mm512_fnmadd_ps(_mm512_mul_ps(half, dist_sq), _mm512_mul_ps(inv_dist, inv_dist), three_halves));
+			const __m512 scale = _mm512_mul_ps(_mm512_mul_ps(inv_dist, _mm512_mul_ps(inv_dist, inv_dist)), _mm512_loadu_ps(mask + j));
+
+			ax = _mm512_fmadd_ps(dx, scale, ax);
+			ay = _mm512_fmadd_ps(dy, scale, ay);
+			az = _mm512_fmadd_ps(dz, scale, az);
+		}
+		return glm::vec3(_mm512_reduce_add_ps(ax), _mm512_reduce_add_ps(ay), _mm512_reduce_add_ps(az));
+	}
+#endif
+}
+
+CpuSimulation::CpuSimulation(unsigned thread_count) {
+	simd_level = detect_simd_level();
+
+	if (thread_count == 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	// The calling thread works as well, so one thread less is needed.
+	for (unsigned i = 0; i + 1 < thread_count; i++) {
+		workers.emplace_back(&CpuSimulation::worker_loop, this, i);
+	}
+}
+
+CpuSimulation::~CpuSimulation() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	work_available.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+const char* CpuSimulation::get_simd_name() const {
+	switch (simd_level) {
+	case SimdLevel::AVX512:
+		return "AVX-512";
+	case SimdLevel::AVX2:
+		return "AVX2";
+	default:
+		return "Scalar";
+	}
+}
+
+void CpuSimulation::uniform_block(uint32_t seed, uint32_t stream, uint32_t counter, int first, int count, float* x, float* y, float* z, float* w) const {
+	int i = 0;
+#if CPU_SIMULATION_X86
+	if (simd_level != SimdLevel::Scalar) {
+		for (; i + 8 <= count; i += 8) {
+			uniform_avx2(seed, stream, counter, static_cast<uint32_t>(first + i), x + i, y + i, z + i, w + i);
+		}
+	}
+#endif
+	// The remainder (and CPUs without AVX2).
+	for (; i < count; i++) {
+		const glm::vec4 random = CounterRng::uniform(seed, first + i, stream, counter);
+		x[i] = random.x;
+		y[i] = random.y;
+		z[i] = random.z;
+		w[i] = random.w;
+	}
+}
+
+void CpuSimulation::clear_surface_targets() {
+	std::fill(surface_targets.begin(), surface_targets.end(), glm::vec4(0.0f));
+}
+
+int CpuSimulation::get_hash_table_size(int count) {
+	int table_size = 1;
+	while (table_size < count) table_size <<= 1;
+	return table_size;
+}
+
+uint32_t CpuSimulation::hash_cell(glm::ivec3 cell, int table_size) {
+	return ((static_cast<uint32_t>(cell.x) * 73856093u) ^ (static_cast<uint32_t>(cell.y) * 19349663u) ^ (static_cast<uint32_t>(cell.z) * 83492791u))
+		& static_cast<uint32_t>(table_size - 1);
+}
+
+void CpuSimulation::parallel_for(int count, const std::function<void(int, int)>& body) {
+	const int64_t range_count = static_cast<int64_t>(workers.size()) + 1;
+	if (workers.empty() || count < min_parallel_count) {
+		body(0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &body;
+		job_count = count;
+		pending_workers = static_cast<unsigned>(workers.size());
+		job_generation++;
+	}
+	work_available.notify_all();
+
+	// The calling thread takes the first range.
+	body(0, static_cast<int>(count / range_count));
+
+	std::unique_lock<std::mutex> lock(mutex);
+	work_done.wait(lock, [this] { return pending_workers == 0; });
+	job = nullptr;
+}
+
+void CpuSimulation::worker_loop(unsigned worker_index) {
+	uint64_t seen_generation = 0;
+	while (true) {
+		const std::function<void(int, int)>* current_job;
+		int count;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			work_available.wait(lock, [&] { return stopping || job_generation != seen_generation; });
+			if (stopping) return;
+			seen_generation = job_generation;
+			current_job = job;
+			count = job_count;
+		}
+
+		const int64_t range_count = static_cast<int64_t>(workers.size()) + 1;
+		const int64_t range = worker_index + 1;
+		(*current_job)(static_cast<int>(count * range / range_count), static_cast<int>(count * (range + 1) / range_count));
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--pending_workers == 0) {
+			work_done.notify_one();
+		}
+	}
+}
+
+void CpuSimulation::update_pulsating(Particle* particles, int count, float time, float delta, uint32_t seed, uint32_t step, int emission_count) {
+	// The expired particles before this index are respawned, it stops after the first 'emission_count' of them.
+	int emission_end = count;
+	if (emission_count < count) {
+		int expired = 0;
+		for (emission_end = 0; emission_end < count && expired < emission_count; emission_end++) {
+			if (particles[emission_end].remaining < 0) expired++;
+		}
+	}
+
+	parallel_for(count, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			Particle& particle = particles[i];
+
+			if (particle.remaining < 0 && i < emission_end) {
+				// The numbers of each respawn depend on the step, so a particle never repeats its previous life.
+				const glm::vec4 emit = CounterRng::uniform(seed, i, CounterRng::STREAM_EMIT, step);
+				const glm::vec4 color = CounterRng::uniform(seed, i, CounterRng::STREAM_COLOR, step);
+				const glm::vec3 rand_dir = CounterRng::inside_sphere(emit.x, emit.y, 1.0f, 1.0f);
+
+				// Random inside sphere
+				const float radius = (emit.z * (2.5f - 1.5f) + 1.5f) * std::sin(time * 0.0001f) + (emit.w * (7.5f - 5.5f) + 5.5f);
+				particle.position = glm::vec4(rand_dir * radius, 1.0f);
+				particle.velocity = rand_dir * 3.0f;
+				particle.color = glm::vec3(color.x, color.y, color.z);
+				particle.lifetime = color.w * (5.0f - 0.5f) + 0.5f;
+				particle.remaining = particle.lifetime;
+			}
+
+			particle.remaining -= delta;
+			particle.position += glm::vec4(particle.velocity, 0.0f) * delta;
+		}
+	});
+}
+
+void CpuSimulation::update_attracting(Particle* particles, int count, float delta, glm::vec3 attractor, float force, uint32_t seed) {
+	update_multi_attracting(particles, count, delta, &attractor, 1, force, seed);
+}
+
+void CpuSimulation::update_multi_attracting(Particle* particles, int count, float delta, const glm::vec3* attractors, int attractor_count, float force, uint32_t seed) {
+	parallel_for(count, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			Particle& particle = particles[i];
+
+			if (glm::length(particle.color) == 0) {
+				const glm::vec4 color = CounterRng::uniform(seed, i, CounterRng::STREAM_COLOR);
+				particle.color = glm::vec3(color.x, color.y, color.z);
+			}
+
+			// Calculate the total force from all active attractors
+			glm::vec3 total_force(0.0f);
+			for (int a = 0; a < attractor_count; a++) {
+				total_force += glm::normalize(attractors[a] - glm::vec3(particle.position)) * force;
+			}
+
+			particle.position += glm::vec4(particle.velocity, 0.0f) * delta + 0.5f * glm::vec4(total_force, 0.0f) * delta * delta;
+			particle.velocity += total_force * delta;
+		}
+	});
+}
+
+void CpuSimulation::update_nbody(const glm::vec4* positions_read, glm::vec4* positions_write, glm::vec4* velocities, int count, float delta,
+	float acceleration_factor, float distance_threshold, int gravity_model, float softening, int integrator) {
+	const bool plummer = gravity_model == GRAVITY_PLUMMER;
+	const float softening_sq = softening * softening;
+
+	// Transposes the positions, the padding is masked out.
+	const int padded_count = (count + nbody_padding - 1) / nbody_padding * nbody_padding;
+	nbody_x.assign(padded_count, 0.0f);
+	nbody_y.assign(padded_count, 0.0f);
+	nbody_z.assign(padded_count, 0.0f);
+	nbody_mask.assign(padded_count, 0.0f);
+	for (int i = 0; i < count; i++) {
+		nbody_x[i] = positions_read[i].x;
+		nbody_y[i] = positions_read[i].y;
+		nbody_z[i] = positions_read[i].z;
+		nbody_mask[i] = 1.0f;
+	}
+
+	parallel_for(count, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			glm::vec3 position(positions_read[i]);
+			glm::vec3 velocity(velocities[i]);
+
+			glm::vec3 acceleration;
+#if CPU_SIMULATION_X86
+			if (simd_level == SimdLevel::AVX512) {
+				acceleration = plummer
+					? accumulate_plummer_avx512(nbody_x.data(), nbody_y.data(), nbody_z.data(), nbody_mask.data(), padded_count, position, softening_sq)
+					: accumulate_nbody_avx512(nbody_x.data(), nbody_y.data(), nbody_z.data(), nbody_mask.data(), padded_count, position, distance_threshold);
+			}
+			else if (simd_level == SimdLevel::AVX2) {
+				acceleration = plummer
+					? accumulate_plummer_avx2(nbody_x.data(), nbody_y.data(), nbody_z.data(), nbody_mask.data(), padded_count, position, softening_sq)
+					: accumulate_nbody_avx2(nbody_x.data(), nbody_y.data(), nbody_z.data(), nbody_mask.data(), padded_count, position, distance_threshold);
+			}
+			else
+#endif
+			{
+				acceleration = plummer
+					? accumulate_plummer_scalar(nbody_x.data(), nbody_y.data(), nbody_z.data(), nbody_mask.data(), count, position, softening_sq)
+					: accumulate_nbody_scalar(nbody_x.data(), nbody_y.data(), nbody_z.data(), nbody_mask.data(), count, position, distance_threshold);
+			}
+
+			acceleration *= acceleration_factor;
+
+			if (integrator == INTEGRATOR_LEAPFROG) {
+				// Kick-drift: the stored velocities are half a step behind the positions (see nbody.comp).
+				velocity += acceleration * delta;
+				position += velocity * delta;
+			}
+			else {
+				position += velocity * delta + 0.5f * acceleration * delta * delta;
+				velocity += acceleration * delta;
+			}
+
+			positions_write[i] = glm::vec4(position, 1.0f);
+			velocities[i] = glm::vec4(velocity, 0.0f);
+		}
+	});
+}
+
+void CpuSimulation::update_surface_estimator(Particle* particles, int count, float delta, const Mesh& mesh, int mesh_generation, float force, uint32_t seed) {
+	const int triangle_count = static_cast<int>(mesh.alias_table.size());
+	if (triangle_count == 0) return;
+
+	if (surface_targets.size() < static_cast<size_t>(count)) {
+		surface_targets.resize(count, glm::vec4(0.0f));
+	}
+	const float generation = static_cast<float>(mesh_generation);
+
+	parallel_for(count, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			Particle& particle = particles[i];
+
+			// The same cached random point as in get_random_position_on_triangle, chosen with the alias table.
+			glm::vec4& target = surface_targets[i];
+			if (target.w != generation) {
+				const glm::vec4 random = CounterRng::uniform(seed, i, CounterRng::STREAM_SURFACE);
+				const int slot = std::min(static_cast<int>(random.x * triangle_count), triangle_count - 1);
+				const AliasEntry& entry = mesh.alias_table[slot];
+				const int triangle_idx = (random.y < entry.probability) ? slot : entry.alias;
+				const glm::vec3 a(mesh.triangles[triangle_idx * 3]);
+				const glm::vec3 b(mesh.triangles[triangle_idx * 3 + 1]);
+				const glm::vec3 c(mesh.triangles[triangle_idx * 3 + 2]);
+				const float r1 = std::sqrt(random.z);
+				const float r2 = random.w;
+				target = glm::vec4((1.0f - r1) * a + (r1 * (1.0f - r2)) * b + (r1 * r2) * c, generation);
+			}
+			const glm::vec3 random_dest(target);
+
+			if (glm::length(glm::vec3(particle.position) - random_dest) > 0.05f) {
+				const glm::vec3 dir_to_attractor = glm::normalize(random_dest - glm::vec3(particle.position)) * force;
+
+				particle.position += glm::vec4(particle.velocity, 0.0f) * delta + 0.5f * glm::vec4(dir_to_attractor, 0.0f) * delta * delta;
+				particle.velocity += dir_to_attractor * delta;
+			}
+			else {
+				particle.position = glm::vec4(random_dest, 1.0f);
+				particle.velocity = glm::vec3(0.0f);
+			}
+		}
+	});
+}
+
+void CpuSimulation::update_fluid(Particle* particles, int count, float delta, float interaction_radius, float repulsion, float cohesion, float containment) {
+	const int table_size = get_hash_table_size(count);
+
+	// Counting sort of the particles by their bucket, the same passes as grid_count.comp, the scan and grid_scatter.comp.
+	grid_buckets.resize(count);
+	grid_cell_starts.assign(table_size + 1, 0u);
+	grid_sorted_particles.resize(count);
+	parallel_for(count, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			grid_buckets[i] = hash_cell(glm::ivec3(glm::floor(glm::vec3(particles[i].position) / interaction_radius)), table_size);
+		}
+	});
+	for (int i = 0; i < count; i++) {
+		grid_cell_starts[grid_buckets[i] + 1]++;
+	}
+	for (int b = 0; b < table_size; b++) {
+		grid_cell_starts[b + 1] += grid_cell_starts[b];
+	}
+	{
+		std::vector<uint32_t> next(grid_cell_starts.begin(), grid_cell_starts.end() - 1);
+		for (int i = 0; i < count; i++) {
+			// The index is stored in 'w' exactly, the counts stay far below 2^24.
+			grid_sorted_particles[next[grid_buckets[i]]++] = glm::vec4(glm::vec3(particles[i].position), static_cast<float>(i));
+		}
+	}
+
+	parallel_for(count, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			Particle& particle = particles[i];
+			const glm::vec3 position(particle.position);
+			const glm::ivec3 cell(glm::floor(position / interaction_radius));
+
+			// Only the particles in the 27 cells around the particle can be in range.
+			glm::vec3 acceleration(0.0f);
+			int neighbour_count = 0;
+			for (int z = -1; z <= 1; z++) {
+				for (int y = -1; y <= 1; y++) {
+					for (int x = -1; x <= 1; x++) {
+						const glm::ivec3 neighbour_cell = cell + glm::ivec3(x, y, z);
+						const uint32_t bucket = hash_cell(neighbour_cell, table_size);
+						for (uint32_t k = grid_cell_starts[bucket]; k < grid_cell_starts[bucket + 1]; k++) {
+							const glm::vec4& other = grid_sorted_particles[k];
+
+							// Skips the particles of other cells sharing the bucket and the particle itself.
+							if (glm::ivec3(glm::floor(glm::vec3(other) / interaction_radius)) != neighbour_cell || static_cast<int>(other.w) == i) continue;
+
+							const glm::vec3 offset = glm::vec3(other) - position;
+							const float dist = glm::length(offset);
+							if (dist >= interaction_radius || dist == 0.0f) continue;
+
+							const float q = dist / interaction_radius;
+							acceleration += (offset / dist) * (cohesion * q * (1.0f - q) - repulsion * (1.0f - q) * (1.0f - q));
+							neighbour_count++;
+						}
+					}
+				}
+			}
+
+			acceleration -= position * containment / std::max(glm::length(position), 1.0f);
+			acceleration -= particle.velocity * fluid_damping;
+
+			particle.position += glm::vec4(particle.velocity, 0.0f) * delta + 0.5f * glm::vec4(acceleration, 0.0f) * delta * delta;
+			particle.velocity += acceleration * delta;
+
+			const float density = std::min(static_cast<float>(neighbour_count) / dense_neighbour_count, 1.0f);
+			particle.color = glm::mix(glm::vec3(0.1f, 0.3f, 1.0f), glm::vec3(1.0f), density);
+		}
+	});
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "particle.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * The CPU implementation of the particle update rules of all scenes.
+ *
+ * The rules mirror the compute shaders (including their random numbers, see CounterRng), so the results can be used
+ * as a deterministic reference for the GPU and for simulation without any OpenGL context. The work is split across
+ * a pool of worker threads and the all-pairs N-Body interactions use AVX2 or AVX-512 kernels when the CPU supports them.
+ */
+class CpuSimulation {
+public:
+	/** The instruction sets the N-Body kernel can use. */
+	enum class SimdLevel { Scalar, AVX2, AVX512 };
+
+	/** The N-Body gravity models: pairs closer than the distance threshold are ignored, or all pairs are softened (Plummer). */
+	static const int GRAVITY_CUTOFF = 0;
+	static const int GRAVITY_PLUMMER = 1;
+
+	/** The N-Body integrators: a second-order Taylor step of the positions, or kick-drift leapfrog (half-step velocities). */
+	static const int INTEGRATOR_TAYLOR = 0;
+	static const int INTEGRATOR_LEAPFROG = 1;
+
+	/** Creates the simulation with the given number of threads, 0 uses all hardware threads. */
+	explicit CpuSimulation(unsigned thread_count = 0);
+
+	/** Stops and joins the worker threads. */
+	~CpuSimulation();
+
+	CpuSimulation(const CpuSimulation&) = delete;
+	CpuSimulation& operator=(const CpuSimulation&) = delete;
+
+	/**
+	 * Sphere Pulsating: respawns the expired particles with the numbers of the given step and moves them by their velocity (pulsating_emit.comp, pulsating_particle.comp).
+	 * At most 'emission_count' particles are respawned, the first expired ones by index, as from the dead list of particle_compact.comp.
+	 */
+	void update_pulsating(Particle* particles, int count, float time, float delta, uint32_t seed, uint32_t step, int emission_count);
+
+	/** Single Attractor: accelerates the particles towards the attractor (attracting_particle.comp). */
+	void update_attracting(Particle* particles, int count, float delta, glm::vec3 attractor, float force, uint32_t seed);
+
+	/** Multi Attractor: accelerates the particles towards all attractors (multi_attracting_particle.comp). */
+	void update_multi_attracting(Particle* particles, int count, float delta, const glm::vec3* attractors, int attractor_count, float force, uint32_t seed);
+
+	/** N-Body: integrates the all-pairs gravity from the read positions into the write positions (nbody.comp). */
+	void update_nbody(const glm::vec4* positions_read, glm::vec4* positions_write, glm::vec4* velocities, int count, float delta,
+		float acceleration_factor, float distance_threshold, int gravity_model = GRAVITY_CUTOFF, float softening = 0.0f, int integrator = INTEGRATOR_TAYLOR);
+
+	/** Particle-Surface Estimator: moves the particles towards their random point on the mesh (surface_estimator.comp), the points are cached per mesh generation. */
+	void update_surface_estimator(Particle* particles, int count, float delta, const Mesh& mesh, int mesh_generation, float force, uint32_t seed);
+
+	/** Forgets the cached points of the surface estimator, e.g., after a reset with another seed. */
+	void clear_surface_targets();
+
+	/** Fluid: repulsion and cohesion between the particles in range, found through a spatial hash grid (grid_count.comp, grid_scatter.comp, fluid_particle.comp). */
+	void update_fluid(Particle* particles, int count, float delta, float interaction_radius, float repulsion, float cohesion, float containment);
+
+	/** Returns the number of threads working on each update (including the calling one). */
+	unsigned get_thread_count() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+	/** Returns the instruction set used by the N-Body kernel. */
+	SimdLevel get_simd_level() const { return simd_level; }
+
+	/** Returns the human readable name of the instruction set used by the N-Body kernel. */
+	const char* get_simd_name() const;
+
+	/** Splits [0, count) into one contiguous range per thread of the pool and runs the body on all of them (also used by ParticleInitializer). */
+	void parallel_for(int count, const std::function<void(int, int)>& body);
+
+	/**
+	 * Draws CounterRng::uniform of the given stream and counter for the particles [first, first + count) into one array per component.
+	 * With AVX2 (or AVX-512), eight particles are hashed at once, the numbers are bit-identical to the scalar ones.
+	 */
+	void uniform_block(uint32_t seed, uint32_t stream, uint32_t counter, int first, int count, float* x, float* y, float* z, float* w) const;
+
+	/** Returns the number of buckets of the spatial hash for the given number of particles (the next power of two). */
+	static int get_hash_table_size(int count);
+
+	/** Returns the bucket of the grid cell in a spatial hash with the given (power of two) number of buckets, the same as in the shaders. */
+	static uint32_t hash_cell(glm::ivec3 cell, int table_size);
+
+protected:
+	/** The loop of each worker thread. */
+	void worker_loop(unsigned worker_index);
+
+protected:
+	SimdLevel simd_level = SimdLevel::Scalar;
+
+	// The positions of the N-Body particles split into separate (padded) streams for the SIMD kernels.
+	std::vector<float> nbody_x;
+	std::vector<float> nbody_y;
+	std::vector<float> nbody_z;
+	std::vector<float> nbody_mask;
+
+	// The spatial hash grid of the fluid: the first sorted particle of each bucket, the bucket of each particle and the sorted particles.
+	std::vector<uint32_t> grid_cell_starts;
+	std::vector<uint32_t> grid_buckets;
+	std::vector<glm::vec4> grid_sorted_particles;
+
+	// The target of each particle of the surface estimator, 'w' is the mesh generation it was computed for.
+	std::vector<glm::vec4> surface_targets;
+
+	// The thread pool.
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable work_available;
+	std::condition_variable work_done;
+	const std::function<void(int, int)>* job = nullptr;
+	int job_count = 0;
+	uint64_t job_generation = 0;
+	unsigned pending_workers = 0;
+	bool stopping = false;
+};
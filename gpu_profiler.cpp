@@ -0,0 +1,94 @@
+#include "gpu_profiler.hpp"
+
+GpuProfiler::GpuProfiler(int max_pending_sections) : max_pending_sections(max_pending_sections) {}
+
+GpuProfiler::~GpuProfiler() {
+	glDeleteQueries(static_cast<GLsizei>(all_queries.size()), all_queries.data());
+}
+
+void GpuProfiler::begin_frame() {
+	collect();
+
+	// Reading GL_TIMESTAMP returns the GPU time once the commands issued so far have reached the GPU, it does not wait for them to finish.
+	GLint64 gpu_time = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpu_time);
+	clock_offset = Profiler::now() - gpu_time;
+}
+
+void GpuProfiler::begin(const char* name) {
+	if (!Profiler::get().is_enabled() || static_cast<int>(pending.size()) >= max_pending_sections) {
+		if (Profiler::get().is_enabled()) skipped_count++;
+		open_sections.push_back(nullptr);
+		return;
+	}
+
+	Section section;
+	section.name = name;
+	section.start_query = acquire_query();
+	section.end_query = acquire_query();
+	section.frame = Profiler::get().get_frame();
+	section.depth = static_cast<int>(open_sections.size());
+	section.clock_offset = clock_offset;
+	section.ended = false;
+	glQueryCounter(section.start_query, GL_TIMESTAMP);
+
+	pending.push_back(section);
+	open_sections.push_back(&pending.back());
+}
+
+void GpuProfiler::end() {
+	if (open_sections.empty()) return;
+
+	Section* section = open_sections.back();
+	open_sections.pop_back();
+	if (section == nullptr) return;
+
+	glQueryCounter(section->end_query, GL_TIMESTAMP);
+	section->ended = true;
+}
+
+void GpuProfiler::collect() {
+	while (!pending.empty() && pending.front().ended) {
+		const Section& section = pending.front();
+
+		// The end of a section is written after its start, so its availability covers both.
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(section.end_query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available == GL_FALSE) break;
+
+		GLuint64 start_time;
+		GLuint64 end_time;
+		glGetQueryObjectui64v(section.start_query, GL_QUERY_RESULT, &start_time);
+		glGetQueryObjectui64v(section.end_query, GL_QUERY_RESULT, &end_time);
+
+		ProfileEvent event;
+		event.name = section.name;
+		event.start = static_cast<int64_t>(start_time) + section.clock_offset;
+		event.duration = static_cast<int64_t>(end_time - start_time);
+		event.frame = section.frame;
+		event.depth = section.depth;
+		event.thread = Profiler::GPU_THREAD;
+		Profiler::get().record(event);
+
+		free_queries.push_back(section.start_query);
+		free_queries.push_back(section.end_query);
+		pending.pop_front();
+	}
+
+	// The frames before the oldest section in flight are complete.
+	const uint64_t frame = pending.empty() ? Profiler::get().get_frame() : pending.front().frame;
+	resolved_frame = (frame > 0) ? frame - 1 : 0;
+}
+
+GLuint GpuProfiler::acquire_query() {
+	if (free_queries.empty()) {
+		GLuint query;
+		glCreateQueries(GL_TIMESTAMP, 1, &query);
+		all_queries.push_back(query);
+		return query;
+	}
+
+	const GLuint query = free_queries.back();
+	free_queries.pop_back();
+	return query;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "profiler.hpp"
+#include <glad/glad.h>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+/**
+ * Records the GPU time of nested sections of commands into the {@link Profiler} without waiting for the GPU.
+ *
+ * Each section places a GL_TIMESTAMP query before and after its commands (unlike GL_TIME_ELAPSED, timestamps may nest
+ * and overlap the GpuTimers). The results are collected in the order the sections were issued once they are available,
+ * frames later, and converted to the CPU clock with the offset measured at the start of the frame. If too many sections
+ * are in flight, the new ones are not measured rather than waited for.
+ */
+class GpuProfiler {
+public:
+	/** Creates the profiler with at most the given number of sections in flight. */
+	explicit GpuProfiler(int max_pending_sections = 1024);
+
+	/** Deletes the query objects. */
+	~GpuProfiler();
+
+	GpuProfiler(const GpuProfiler&) = delete;
+	GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+	/** Collects the finished sections and measures the offset between the GPU and the CPU clock, called once per frame. */
+	void begin_frame();
+
+	/** Starts a section with the given name (which must outlive the profiler, see ProfileEvent). */
+	void begin(const char* name);
+
+	/** Ends the innermost section started by {@link begin}. */
+	void end();
+
+	/** Returns the newest frame whose sections have all been collected. */
+	uint64_t get_resolved_frame() const { return resolved_frame; }
+
+	/** Returns the number of sections not measured because too many were in flight. */
+	int get_skipped_count() const { return skipped_count; }
+
+protected:
+	/** Records the finished sections in the order they were issued. */
+	void collect();
+
+	/** Returns a free query object, creating one if there is none. */
+	GLuint acquire_query();
+
+protected:
+	struct Section {
+		const char* name;
+		GLuint start_query;
+		GLuint end_query;
+		uint64_t frame;
+		int depth;
+		// The difference between the CPU and the GPU clock (in nanoseconds) when the section was issued.
+		int64_t clock_offset;
+		bool ended;
+	};
+
+	int max_pending_sections;
+	std::deque<Section> pending;
+
+	// The open sections, nullptr for those that are not measured (deque elements keep their addresses on push_back).
+	std::vector<Section*> open_sections;
+
+	std::vector<GLuint> free_queries;
+	std::vector<GLuint> all_queries;
+
+	int64_t clock_offset = 0;
+	uint64_t resolved_frame = 0;
+	int skipped_count = 0;
+};
+
+/** Records the GPU time of the commands issued in the enclosing scope into the {@link GpuProfiler}. */
+class GpuProfileScope {
+public:
+	GpuProfileScope(GpuProfiler& profiler, const char* name) : profiler(profiler) { profiler.begin(name); }
+	~GpuProfileScope() { profiler.end(); }
+
+	GpuProfileScope(const GpuProfileScope&) = delete;
+	GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+
+protected:
+	GpuProfiler& profiler;
+};
+
+/** Times the rest of the enclosing scope on the CPU and the commands it issues on the GPU under the given name. */
+#define PROFILE_GPU_SCOPE(gpu_profiler, name) \
+	PROFILE_SCOPE(name); \
+	GpuProfileScope PROFILE_CONCATENATE(gpu_profile_scope_, __LINE__)(gpu_profiler, name)
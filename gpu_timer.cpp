@@ -0,0 +1,47 @@
+#include "gpu_timer.hpp"
+
+GpuTimer::GpuTimer(int query_count) : queries(query_count), pending(query_count, false) {
+	glCreateQueries(GL_TIME_ELAPSED, query_count, queries.data());
+}
+
+GpuTimer::~GpuTimer() {
+	glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+}
+
+void GpuTimer::begin() {
+	collect();
+
+	// The ring is full, the GPU is too far behind to wait for it here.
+	if (pending[next]) {
+		skipped_count++;
+		return;
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+	active = true;
+}
+
+void GpuTimer::end() {
+	if (!active) return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	active = false;
+
+	pending[next] = true;
+	next = (next + 1) % static_cast<int>(queries.size());
+}
+
+void GpuTimer::collect() {
+	while (pending[oldest]) {
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available == GL_FALSE) return;
+
+		GLuint64 elapsed_time;
+		glGetQueryObjectui64v(queries[oldest], GL_QUERY_RESULT, &elapsed_time);
+		last_time = static_cast<float>(elapsed_time) * 1e-6f;
+
+		pending[oldest] = false;
+		oldest = (oldest + 1) % static_cast<int>(queries.size());
+	}
+}
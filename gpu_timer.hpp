@@ -0,0 +1,52 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <vector>
+
+/**
+ * Measures the GPU time of a section of commands without waiting for the GPU.
+ *
+ * Each measurement uses the next query object of a ring and its result is collected frames later, once
+ * GL_QUERY_RESULT_AVAILABLE says so, so the CPU keeps submitting while the GPU executes. If all queries of the ring
+ * are still in flight, the section is not measured rather than waited for. Only one GL_TIME_ELAPSED query can be
+ * active at a time, so the measured sections of different timers must not overlap.
+ */
+class GpuTimer {
+public:
+	/** Creates the timer with the given number of queries, i.e., how many frames the results may lag behind. */
+	explicit GpuTimer(int query_count = 4);
+
+	/** Deletes the query objects. */
+	~GpuTimer();
+
+	GpuTimer(const GpuTimer&) = delete;
+	GpuTimer& operator=(const GpuTimer&) = delete;
+
+	/** Collects the finished measurements and starts a new one (if a query is free). */
+	void begin();
+
+	/** Ends the measurement started by {@link begin}. */
+	void end();
+
+	/** Returns the last collected time in milliseconds. */
+	float get_time() const { return last_time; }
+
+	/** Returns the number of measurements skipped because all queries were in flight. */
+	int get_skipped_count() const { return skipped_count; }
+
+protected:
+	/** Reads the results of the oldest queries that are available, in the order they were issued. */
+	void collect();
+
+protected:
+	std::vector<GLuint> queries;
+	std::vector<bool> pending;
+
+	// The oldest query in flight and the query used by the next measurement.
+	int oldest = 0;
+	int next = 0;
+	bool active = false;
+
+	float last_time = 0.0f;
+	int skipped_count = 0;
+};
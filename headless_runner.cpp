@@ -0,0 +1,271 @@
+#include "headless_runner.hpp"
+#include "mesh_loader.hpp"
+#include "particle_initializer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+namespace {
+	// The default scene parameters, these must be the same as in application.hpp.
+	const float attraction_force = 9.8f;
+	const float acceleration_factor = 0.2f;
+	const float distance_threshold = 0.01f;
+	const float surface_attraction_force = 9.81f;
+	const float fluid_interaction_radius = 1.0f;
+	const float fluid_repulsion = 4000.0f;
+	const float fluid_cohesion = 400.0f;
+	const float fluid_containment = 50.0f;
+
+	// FNV-1a of the snapshot, the verification compares the decoded snapshots with the written ones bit by bit.
+	uint64_t hash_snapshot(const float* snapshot, size_t count) {
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(snapshot);
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < sizeof(float) * count; i++) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+}
+
+bool HeadlessRunner::is_requested(const std::vector<std::string>& arguments) {
+	for (const std::string& argument : arguments) {
+		if (argument == "--headless") return true;
+	}
+	return false;
+}
+
+HeadlessRunner::HeadlessRunner(const std::vector<std::string>& arguments) {
+	// The first argument is the executable.
+	for (size_t i = 1; i < arguments.size(); i++) {
+		const std::string& argument = arguments[i];
+		if (argument == "--headless") continue;
+		if (argument == "--verify") {
+			verify = true;
+			continue;
+		}
+
+		if (i + 1 >= arguments.size()) {
+			std::cerr << "Missing value of " << argument << std::endl;
+			valid = false;
+			break;
+		}
+		const std::string& value = arguments[++i];
+
+		try {
+			if (argument == "--scene") {
+				scene = -1;
+				for (int s = 0; s < 6; s++) {
+					if (value == SCENE_NAMES[s] || value == std::to_string(s)) scene = s;
+				}
+				if (scene < 0) throw std::invalid_argument(value);
+			}
+			else if (argument == "--count") particle_count = std::stoi(value);
+			else if (argument == "--steps") step_count = std::stoll(value);
+			else if (argument == "--dt") step_duration = std::stof(value);
+			else if (argument == "--output") output_path = value;
+			else if (argument == "--snapshot-interval") snapshot_interval = std::stoi(value);
+			else if (argument == "--model") model_path = value;
+			else if (argument == "--threads") thread_count = static_cast<unsigned>(std::stoul(value));
+			else if (argument == "--seed") seed = static_cast<uint32_t>(std::stoul(value));
+			else if (argument == "--emission-limit") emission_limit = std::stof(value);
+			else {
+				std::cerr << "Unknown argument " << argument << std::endl;
+				valid = false;
+			}
+		}
+		catch (const std::exception&) {
+			std::cerr << "Invalid value of " << argument << ": " << value << std::endl;
+			valid = false;
+		}
+	}
+
+	if (particle_count <= 0 || step_count < 0 || step_duration <= 0.0f || snapshot_interval <= 0 || emission_limit < 0.0f || emission_limit > 1.0f) {
+		valid = false;
+	}
+}
+
+void HeadlessRunner::print_usage() const {
+	std::cerr << "Usage: --headless --scene <index or name> --count <particles> --steps <steps> --dt <milliseconds>" << std::endl;
+	std::cerr << "       [--output <file>] [--snapshot-interval <steps>] [--model <obj file>] [--threads <count>] [--seed <n>]" << std::endl;
+	std::cerr << "       [--emission-limit <fraction>] [--verify]" << std::endl;
+	std::cerr << "Scenes:";
+	for (int s = 0; s < 6; s++) {
+		std::cerr << " " << s << " (" << SCENE_NAMES[s] << ")";
+	}
+	std::cerr << std::endl;
+}
+
+bool HeadlessRunner::initialize(CpuSimulation& simulation) {
+	if (scene == SCENE_NBODY) {
+		positions[0].resize(particle_count);
+		positions[1].resize(particle_count);
+		velocities.resize(particle_count);
+		ParticleInitializer::initialize_nbody(simulation, positions[0].data(), velocities.data(), particle_count, seed);
+		positions[1] = positions[0];
+		return true;
+	}
+
+	particles.assign(particle_count, Particle{});
+	if (scene == SCENE_PULSATING) {
+		ParticleInitializer::initialize_pulsating(simulation, particles.data(), particle_count, seed);
+	}
+	else if (scene == SCENE_SINGLE_ATTRACTOR || scene == SCENE_MULTI_ATTRACTOR) {
+		ParticleInitializer::initialize_attracting(simulation, particles.data(), particle_count, seed);
+	}
+	else if (scene == SCENE_FLUID) {
+		ParticleInitializer::initialize_fluid(simulation, particles.data(), particle_count, seed);
+	}
+	else if (scene == SCENE_PARTICLE_SURFACE_ESTIMATOR) {
+		ParticleInitializer::initialize_surface_estimator(simulation, particles.data(), particle_count, seed);
+
+		std::filesystem::path cache_path = model_path;
+		cache_path.replace_extension(".pmesh");
+		if (!MeshLoader::read_cache(cache_path, model_path, mesh)) {
+			if (!MeshLoader::parse_obj(model_path, mesh, std::max(1u, std::thread::hardware_concurrency()))) {
+				std::cerr << "Cannot load the model " << model_path.generic_string() << std::endl;
+				return false;
+			}
+			MeshLoader::write_cache(cache_path, model_path, mesh);
+		}
+		MeshLoader::build_surface_sampling(mesh);
+	}
+	return true;
+}
+
+void HeadlessRunner::step(CpuSimulation& simulation) {
+	// The same as Application::simulate_particles_cpu, in the units of Application::get_simulation_step.
+	simulation_time += step_duration;
+	step_index++;
+	const float time = static_cast<float>(simulation_time);
+	const float delta = step_duration * 0.0001f;
+
+	if (scene == SCENE_PULSATING) {
+		const int emission_count = static_cast<int>(std::ceil(emission_limit * particle_count));
+		simulation.update_pulsating(particles.data(), particle_count, time, delta, seed, step_index, emission_count);
+	}
+	else if (scene == SCENE_SINGLE_ATTRACTOR) {
+		simulation.update_attracting(particles.data(), particle_count, delta, attraction_points[0], attraction_force, seed);
+	}
+	else if (scene == SCENE_MULTI_ATTRACTOR) {
+		simulation.update_multi_attracting(particles.data(), particle_count, delta, attraction_points.data(), static_cast<int>(attraction_points.size()), attraction_force, seed);
+	}
+	else if (scene == SCENE_NBODY) {
+		simulation.update_nbody(positions[current_read].data(), positions[1 - current_read].data(), velocities.data(), particle_count, delta,
+			acceleration_factor, distance_threshold);
+		current_read = 1 - current_read;
+	}
+	else if (scene == SCENE_PARTICLE_SURFACE_ESTIMATOR) {
+		simulation.update_surface_estimator(particles.data(), particle_count, delta, mesh, 1, surface_attraction_force, seed);
+	}
+	else if (scene == SCENE_FLUID) {
+		simulation.update_fluid(particles.data(), particle_count, delta, fluid_interaction_radius, fluid_repulsion, fluid_cohesion, fluid_containment);
+	}
+}
+
+void HeadlessRunner::copy_snapshot(float* snapshot) const {
+	for (int i = 0; i < particle_count; i++) {
+		const glm::vec3 position = (scene == SCENE_NBODY) ? glm::vec3(positions[current_read][i]) : glm::vec3(particles[i].position);
+		const glm::vec3 velocity = (scene == SCENE_NBODY) ? glm::vec3(velocities[i]) : particles[i].velocity;
+		float* values = snapshot + snapshot_components * i;
+		values[0] = position.x;
+		values[1] = position.y;
+		values[2] = position.z;
+		values[3] = velocity.x;
+		values[4] = velocity.y;
+		values[5] = velocity.z;
+	}
+}
+
+void HeadlessRunner::write_snapshot(TrajectoryWriter& writer, uint64_t step) {
+	float* snapshot = writer.begin_snapshot();
+	copy_snapshot(snapshot);
+	if (verify) {
+		written_steps.push_back(step);
+		written_hashes.push_back(hash_snapshot(snapshot, snapshot_components * static_cast<size_t>(particle_count)));
+	}
+	writer.end_snapshot(step);
+}
+
+bool HeadlessRunner::verify_trajectory() const {
+	TrajectoryReader reader(output_path);
+	if (!reader.is_open() || reader.get_header().particle_count != static_cast<uint32_t>(particle_count) || reader.get_header().components != snapshot_components) {
+		std::cerr << "Cannot read the trajectory " << output_path.generic_string() << std::endl;
+		return false;
+	}
+
+	std::vector<float> snapshot;
+	uint64_t step = 0;
+	size_t index = 0;
+	while (reader.read_snapshot(step, snapshot)) {
+		if (index >= written_steps.size() || step != written_steps[index] || hash_snapshot(snapshot.data(), snapshot.size()) != written_hashes[index]) {
+			std::cerr << "Snapshot " << index << " (step " << step << ") does not match the written one." << std::endl;
+			return false;
+		}
+		index++;
+	}
+	if (index != written_steps.size()) {
+		std::cerr << "Only " << index << " of " << written_steps.size() << " snapshots could be read back." << std::endl;
+		return false;
+	}
+
+	std::cout << "Verified " << index << " snapshots." << std::endl;
+	return true;
+}
+
+int HeadlessRunner::run() {
+	if (!valid) {
+		print_usage();
+		return 1;
+	}
+
+	std::cout << "---" << std::endl;
+	std::cout << "Headless " << SCENE_NAMES[scene] << ": " << particle_count << " particles, " << step_count << " steps of " << step_duration << " ms" << std::endl;
+
+	// The pool of the simulation also generates the initial state.
+	CpuSimulation simulation(thread_count);
+	std::cout << "CPU: " << simulation.get_thread_count() << " threads, " << simulation.get_simd_name() << std::endl;
+
+	if (!initialize(simulation)) return 1;
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	std::chrono::high_resolution_clock::time_point simulated;
+	float wait_time = 0.0f;
+	uint64_t raw_bytes = 0;
+	{
+		TrajectoryWriter writer(output_path, static_cast<uint32_t>(scene), static_cast<uint32_t>(particle_count), snapshot_components, step_duration,
+			static_cast<uint32_t>(snapshot_interval));
+		if (!writer.is_open()) {
+			std::cerr << "Cannot create the trajectory " << output_path.generic_string() << std::endl;
+			return 1;
+		}
+
+		// The initial state is the first snapshot, the last step is always stored.
+		write_snapshot(writer, 0);
+		for (int64_t s = 1; s <= step_count; s++) {
+			step(simulation);
+			if (s % snapshot_interval == 0 || s == step_count) {
+				write_snapshot(writer, static_cast<uint64_t>(s));
+			}
+		}
+
+		simulated = std::chrono::high_resolution_clock::now();
+		wait_time = writer.get_wait_time();
+		raw_bytes = writer.get_raw_bytes();
+
+		// The destructor waits for the I/O thread to write the remaining snapshots.
+	}
+	const auto end = std::chrono::high_resolution_clock::now();
+
+	std::error_code error;
+	const uintmax_t file_size = std::filesystem::file_size(output_path, error);
+
+	std::cout << "Simulated in " << std::chrono::duration<float, std::milli>(simulated - start).count() << " ms ("
+		<< wait_time << " ms waiting for the I/O thread), written in " << std::chrono::duration<float, std::milli>(end - start).count() << " ms." << std::endl;
+	std::cout << "Trajectory " << output_path.generic_string() << ": " << file_size << " bytes (" << raw_bytes << " bytes uncompressed)." << std::endl;
+
+	if (verify && !verify_trajectory()) return 1;
+	return 0;
+}
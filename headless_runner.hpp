@@ -0,0 +1,98 @@
+#pragma once
+
+#include "cpu_simulation.hpp"
+#include "particle.hpp"
+#include "trajectory_writer.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * Runs a scene without any window or OpenGL context and streams its trajectory to disk.
+ *
+ * Selected by '--headless' in the command line arguments, the scene is simulated by the CPU backend (CpuSimulation)
+ * with the same update rules as the compute shaders, so batch runs work on build nodes without a GPU. The snapshots
+ * (positions and velocities) are written by a TrajectoryWriter on its own thread. With '--verify', the written file
+ * is read back by a TrajectoryReader and each decoded snapshot is compared with a hash of the one that was written.
+ *
+ * Arguments: --headless --scene <index or name> --count <particles> --steps <steps> --dt <milliseconds>
+ *            [--output <file>] [--snapshot-interval <steps>] [--model <obj file>] [--threads <count>] [--seed <n>]
+ *            [--emission-limit <fraction>] [--verify]
+ */
+class HeadlessRunner {
+public:
+	/** Returns whether the arguments request the headless mode. */
+	static bool is_requested(const std::vector<std::string>& arguments);
+
+	/** Parses the arguments, see the class description. */
+	explicit HeadlessRunner(const std::vector<std::string>& arguments);
+
+	/** Runs the simulation, returns the exit code of the process. */
+	int run();
+
+protected:
+	/** Prints the accepted arguments. */
+	void print_usage() const;
+
+	/** Generates the initial state of the scene, returns false if it cannot (e.g., the model is missing). */
+	bool initialize(CpuSimulation& simulation);
+
+	/** Advances the scene by one step. */
+	void step(CpuSimulation& simulation);
+
+	/** Copies the positions and velocities into the snapshot (6 floats per particle). */
+	void copy_snapshot(float* snapshot) const;
+
+	/** Copies the snapshot into the staging buffer of the writer and remembers its step and hash for the verification. */
+	void write_snapshot(TrajectoryWriter& writer, uint64_t step);
+
+	/** Reads the written trajectory back and compares its snapshots with the written ones, returns whether they match. */
+	bool verify_trajectory() const;
+
+protected:
+	/** The scenes, these must be the same as DISPLAY_* in application.hpp. */
+	const int SCENE_PULSATING = 0;
+	const int SCENE_SINGLE_ATTRACTOR = 1;
+	const int SCENE_MULTI_ATTRACTOR = 2;
+	const int SCENE_NBODY = 3;
+	const int SCENE_PARTICLE_SURFACE_ESTIMATOR = 4;
+	const int SCENE_FLUID = 5;
+
+	const char* SCENE_NAMES[6] = { "pulsating", "single-attractor", "multi-attractor", "nbody", "surface-estimator", "fluid" };
+
+	// The floats per particle in each snapshot (position and velocity).
+	const uint32_t snapshot_components = 6;
+
+	// The parsed arguments.
+	bool valid = true;
+	int scene = 0;
+	int particle_count = 4096;
+	int64_t step_count = 1000;
+	float step_duration = 1000.0f / 240.0f; // In milliseconds, the same as the default simulation rate.
+	std::filesystem::path output_path = "trajectory.ptraj";
+	int snapshot_interval = 1;
+	std::filesystem::path model_path = "models/golem.obj";
+	unsigned thread_count = 0;
+
+	// The seed of the initial state and of the respawns, the same seed gives the same trajectory.
+	uint32_t seed = 1;
+
+	// The fraction of the particles the pulsating scene respawns per step at most, the same as Application::emission_limit.
+	float emission_limit = 1.0f;
+
+	// Whether the written trajectory is read back and checked, with the step and the hash of each written snapshot.
+	bool verify = false;
+	std::vector<uint64_t> written_steps;
+	std::vector<uint64_t> written_hashes;
+
+	// The state of the simulation, the same as in Application (with the default scene parameters).
+	std::vector<Particle> particles;
+	std::vector<glm::vec4> positions[2];
+	std::vector<glm::vec4> velocities;
+	int current_read = 0;
+	double simulation_time = 0.0;
+	uint32_t step_index = 0;
+	Mesh mesh;
+	std::vector<glm::vec3> attraction_points = std::vector<glm::vec3>(3, glm::vec3(0.0f));
+};
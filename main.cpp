@@ -4,6 +4,7 @@
 #include <vector>
 #include "application.hpp"
 #include "gui_manager.h"
+#include "headless_runner.hpp"
 
 int main(int argc, char** argv) {
     constexpr int initial_width = 1280;
@@ -11,6 +12,11 @@ int main(int argc, char** argv) {
 
     std::vector<std::string> arguments(argv, argv + argc);
 
+    // Batch runs simulate on the CPU without creating any window or OpenGL context.
+    if (HeadlessRunner::is_requested(arguments)) {
+        return HeadlessRunner(arguments).run();
+    }
+
     ImGuiManager manager;
     manager.init(initial_width, initial_height, "Particle Simulation", 4, 5);
     if (!manager.is_fail())
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+/**
+ * A read-only memory mapping of a whole file.
+ *
+ * The pages are loaded by the operating system on first access, so the data can be copied (e.g., into a GPU upload)
+ * straight from the file without reading it into an intermediate buffer first.
+ */
+class MappedFile {
+public:
+	/** Maps the file, get_data returns null if it cannot be opened or is empty. */
+	explicit MappedFile(const std::filesystem::path& path);
+
+	/** Unmaps and closes the file. */
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/** Returns the mapped contents of the file (or null if it is not mapped). */
+	const char* get_data() const { return data; }
+
+	/** Returns the size of the file in bytes. */
+	size_t get_size() const { return size; }
+
+protected:
+	const char* data = nullptr;
+	size_t size = 0;
+
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int descriptor = -1;
+#endif
+};
@@ -0,0 +1,332 @@
+#include "mesh_loader.hpp"
+#include "mapped_file.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace {
+	// The header of the binary cache, followed by the positions (vec4) and the indices (int).
+	struct PmeshHeader {
+		char magic[4];
+		uint32_t version;
+		uint64_t source_size;
+		int64_t source_time;
+		uint32_t vertex_count;
+		uint32_t index_count;
+	};
+
+	const char PMESH_MAGIC[4] = { 'P', 'M', 'S', 'H' };
+	const uint32_t PMESH_VERSION = 1;
+
+	/** The part of an OBJ file parsed by one thread. */
+	struct ObjChunk {
+		std::vector<glm::vec4> positions;
+		std::vector<int> indices;
+
+		// The indices that are relative (negative) and the number of positions of the chunk before them.
+		std::vector<std::pair<size_t, int>> relative_indices;
+	};
+
+	bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	// Parses the next number of the line, the mapped file is not null-terminated so nothing may read past 'line_end'.
+	// Returns false (leaving the value and the position) if there is no number before the end of the line.
+	template <typename T>
+	bool parse_number(const char*& c, const char* line_end, T& value) {
+		while (c < line_end && is_space(*c)) c++;
+		const char* start = (c < line_end && *c == '+') ? c + 1 : c;
+		const std::from_chars_result result = std::from_chars(start, line_end, value);
+		if (result.ec != std::errc() || result.ptr == start) return false;
+		c = result.ptr;
+		return true;
+	}
+
+	void parse_obj_chunk(const char* begin, const char* end, ObjChunk& chunk) {
+		std::vector<int> face;
+
+		const char* line = begin;
+		while (line < end) {
+			const char* line_end = static_cast<const char*>(std::memchr(line, '\n', end - line));
+			if (line_end == nullptr) line_end = end;
+
+			const char* c = line;
+			while (c < line_end && is_space(*c)) c++;
+
+			if (line_end - c > 2 && c[0] == 'v' && is_space(c[1])) {
+				// The missing coordinates of a short line are zero.
+				c++;
+				glm::vec4 position = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+				for (int axis = 0; axis < 3 && parse_number(c, line_end, position[axis]); axis++) {}
+				chunk.positions.push_back(position);
+			}
+			else if (line_end - c > 2 && c[0] == 'f' && is_space(c[1])) {
+				// Each vertex is 'v', 'v/vt', 'v//vn' or 'v/vt/vn', only 'v' is used.
+				face.clear();
+				c++;
+				while (c < line_end) {
+					int index = 0;
+					if (!parse_number(c, line_end, index)) break;
+					face.push_back(index);
+					while (c < line_end && !is_space(*c)) c++;
+				}
+
+				// Triangulates the polygon as a fan.
+				for (size_t i = 2; i < face.size(); i++) {
+					for (int index : { face[0], face[i - 1], face[i] }) {
+						if (index < 0) {
+							chunk.relative_indices.push_back({ chunk.indices.size(), static_cast<int>(chunk.positions.size()) });
+						}
+						chunk.indices.push_back(index);
+					}
+				}
+			}
+
+			line = line_end + 1;
+		}
+	}
+
+	int64_t get_source_time(const std::filesystem::path& path) {
+		return static_cast<int64_t>(std::filesystem::last_write_time(path).time_since_epoch().count());
+	}
+}
+
+MeshLoader::MeshLoader() {
+	worker = std::thread(&MeshLoader::worker_loop, this);
+}
+
+MeshLoader::~MeshLoader() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	request_available.notify_one();
+	worker.join();
+}
+
+void MeshLoader::load(const std::filesystem::path& path) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		requested_path = path;
+		requested_generation++;
+	}
+	request_available.notify_one();
+}
+
+bool MeshLoader::poll(Mesh& mesh) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!loaded || loaded_generation != requested_generation) return false;
+
+	mesh = std::move(loaded_mesh);
+	last_load_info = loaded_info;
+	loaded = false;
+	return true;
+}
+
+void MeshLoader::worker_loop() {
+	Profiler::get().set_thread_name("Mesh Loader");
+	uint64_t generation = 0;
+
+	while (true) {
+		std::filesystem::path path;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			request_available.wait(lock, [&] { return stopping || requested_generation != generation; });
+			if (stopping) return;
+			generation = requested_generation;
+			path = requested_path;
+		}
+
+		PROFILE_SCOPE("Model Load");
+		const auto start = std::chrono::high_resolution_clock::now();
+
+		std::filesystem::path cache_path = path;
+		cache_path.replace_extension(".pmesh");
+
+		Mesh mesh;
+		std::string info;
+		if (read_cache(cache_path, path, mesh)) {
+			info = "cache";
+		}
+		else if (parse_obj(path, mesh, std::max(1u, std::thread::hardware_concurrency()))) {
+			info = "parsed";
+			if (!write_cache(cache_path, path, mesh)) {
+				std::cerr << "MeshLoader: Cannot write the cache " << cache_path.generic_string() << std::endl;
+			}
+		}
+		else {
+			std::cerr << "MeshLoader: Cannot load " << path.generic_string() << std::endl;
+			continue;
+		}
+
+		build_surface_sampling(mesh);
+
+		const auto end = std::chrono::high_resolution_clock::now();
+		info.append(" in ").append(std::to_string(std::chrono::duration<float, std::milli>(end - start).count())).append(" ms");
+
+		std::lock_guard<std::mutex> lock(mutex);
+		loaded_mesh = std::move(mesh);
+		loaded_info = info;
+		loaded_generation = generation;
+		loaded = true;
+	}
+}
+
+bool MeshLoader::parse_obj(const std::filesystem::path& path, Mesh& mesh, unsigned thread_count) {
+	const MappedFile file(path);
+	if (file.get_data() == nullptr) return false;
+
+	// Splits the text into chunks at line boundaries.
+	const size_t chunk_count = std::max<size_t>(1, std::min<size_t>(thread_count, file.get_size() / 65536 + 1));
+	std::vector<const char*> bounds(chunk_count + 1);
+	bounds[0] = file.get_data();
+	bounds[chunk_count] = file.get_data() + file.get_size();
+	for (size_t i = 1; i < chunk_count; i++) {
+		const char* bound = std::max(bounds[i - 1], file.get_data() + file.get_size() * i / chunk_count);
+		const char* line_end = static_cast<const char*>(std::memchr(bound, '\n', file.get_data() + file.get_size() - bound));
+		bounds[i] = (line_end != nullptr) ? line_end + 1 : file.get_data() + file.get_size();
+	}
+
+	std::vector<ObjChunk> chunks(chunk_count);
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < chunk_count; i++) {
+		threads.emplace_back(parse_obj_chunk, bounds[i], bounds[i + 1], std::ref(chunks[i]));
+	}
+	parse_obj_chunk(bounds[0], bounds[1], chunks[0]);
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	// Concatenates the chunks, the indices are 1-based, or relative to the positions read so far if negative.
+	size_t position_count = 0;
+	size_t index_count = 0;
+	for (const ObjChunk& chunk : chunks) {
+		position_count += chunk.positions.size();
+		index_count += chunk.indices.size();
+	}
+	mesh.positions.clear();
+	mesh.indices.clear();
+	mesh.positions.reserve(position_count);
+	mesh.indices.reserve(index_count);
+
+	for (ObjChunk& chunk : chunks) {
+		const int preceding_positions = static_cast<int>(mesh.positions.size());
+		for (int& index : chunk.indices) {
+			if (index > 0) index -= 1;
+		}
+		for (const auto& [position, chunk_positions] : chunk.relative_indices) {
+			chunk.indices[position] += preceding_positions + chunk_positions;
+		}
+		mesh.positions.insert(mesh.positions.end(), chunk.positions.begin(), chunk.positions.end());
+		mesh.indices.insert(mesh.indices.end(), chunk.indices.begin(), chunk.indices.end());
+	}
+
+	// Drops the triangles referencing missing positions.
+	const int vertex_count = static_cast<int>(mesh.positions.size());
+	size_t valid_count = 0;
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		const int a = mesh.indices[i], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+		if (a < 0 || b < 0 || c < 0 || a >= vertex_count || b >= vertex_count || c >= vertex_count) continue;
+		mesh.indices[valid_count++] = a;
+		mesh.indices[valid_count++] = b;
+		mesh.indices[valid_count++] = c;
+	}
+	mesh.indices.resize(valid_count);
+
+	return !mesh.positions.empty();
+}
+
+void MeshLoader::build_surface_sampling(Mesh& mesh) {
+	const size_t triangle_count = mesh.indices.size() / 3;
+	mesh.triangles.resize(3 * triangle_count);
+	mesh.alias_table.resize(triangle_count);
+	if (triangle_count == 0) return;
+
+	std::vector<double> areas(triangle_count);
+	double total_area = 0.0;
+	for (size_t i = 0; i < triangle_count; i++) {
+		const glm::vec4 a = mesh.positions[mesh.indices[3 * i]];
+		const glm::vec4 b = mesh.positions[mesh.indices[3 * i + 1]];
+		const glm::vec4 c = mesh.positions[mesh.indices[3 * i + 2]];
+		mesh.triangles[3 * i] = a;
+		mesh.triangles[3 * i + 1] = b;
+		mesh.triangles[3 * i + 2] = c;
+		areas[i] = 0.5 * glm::length(glm::cross(glm::vec3(b - a), glm::vec3(c - a)));
+		total_area += areas[i];
+	}
+
+	// Vose's alias method: each slot keeps its triangle with the given probability and takes the alias otherwise.
+	std::vector<double> scaled(triangle_count);
+	std::vector<int> small;
+	std::vector<int> large;
+	for (size_t i = 0; i < triangle_count; i++) {
+		scaled[i] = (total_area > 0.0) ? areas[i] * triangle_count / total_area : 1.0;
+		(scaled[i] < 1.0 ? small : large).push_back(static_cast<int>(i));
+	}
+	while (!small.empty() && !large.empty()) {
+		const int less = small.back();
+		small.pop_back();
+		const int more = large.back();
+		mesh.alias_table[less] = { static_cast<float>(scaled[less]), more };
+		scaled[more] -= 1.0 - scaled[less];
+		if (scaled[more] < 1.0) {
+			large.pop_back();
+			small.push_back(more);
+		}
+	}
+	// The rest is (up to rounding) exactly one.
+	for (int i : large) mesh.alias_table[i] = { 1.0f, i };
+	for (int i : small) mesh.alias_table[i] = { 1.0f, i };
+}
+
+bool MeshLoader::read_cache(const std::filesystem::path& cache_path, const std::filesystem::path& source_path, Mesh& mesh) {
+	std::error_code error;
+	if (!std::filesystem::exists(cache_path, error) || !std::filesystem::exists(source_path, error)) return false;
+
+	const MappedFile file(cache_path);
+	if (file.get_data() == nullptr || file.get_size() < sizeof(PmeshHeader)) return false;
+
+	PmeshHeader header;
+	std::memcpy(&header, file.get_data(), sizeof(PmeshHeader));
+	if (std::memcmp(header.magic, PMESH_MAGIC, sizeof(PMESH_MAGIC)) != 0 || header.version != PMESH_VERSION) return false;
+	if (header.source_size != std::filesystem::file_size(source_path, error) || header.source_time != get_source_time(source_path)) return false;
+
+	const size_t position_size = sizeof(glm::vec4) * header.vertex_count;
+	const size_t index_size = sizeof(int) * header.index_count;
+	if (file.get_size() != sizeof(PmeshHeader) + position_size + index_size) return false;
+
+	mesh.positions.resize(header.vertex_count);
+	mesh.indices.resize(header.index_count);
+	std::memcpy(mesh.positions.data(), file.get_data() + sizeof(PmeshHeader), position_size);
+	std::memcpy(mesh.indices.data(), file.get_data() + sizeof(PmeshHeader) + position_size, index_size);
+	return true;
+}
+
+bool MeshLoader::write_cache(const std::filesystem::path& cache_path, const std::filesystem::path& source_path, const Mesh& mesh) {
+	std::error_code error;
+	PmeshHeader header;
+	std::memcpy(header.magic, PMESH_MAGIC, sizeof(PMESH_MAGIC));
+	header.version = PMESH_VERSION;
+	header.source_size = std::filesystem::file_size(source_path, error);
+	header.source_time = get_source_time(source_path);
+	header.vertex_count = static_cast<uint32_t>(mesh.positions.size());
+	header.index_count = static_cast<uint32_t>(mesh.indices.size());
+
+	// Writes into a temporary file first, so that a concurrent reader never sees a partial cache.
+	std::filesystem::path temporary_path = cache_path;
+	temporary_path += ".tmp";
+	{
+		std::ofstream stream(temporary_path, std::ios::binary | std::ios::trunc);
+		if (!stream) return false;
+		stream.write(reinterpret_cast<const char*>(&header), sizeof(PmeshHeader));
+		stream.write(reinterpret_cast<const char*>(mesh.positions.data()), sizeof(glm::vec4) * mesh.positions.size());
+		stream.write(reinterpret_cast<const char*>(mesh.indices.data()), sizeof(int) * mesh.indices.size());
+		if (!stream) return false;
+	}
+	std::filesystem::rename(temporary_path, cache_path, error);
+	return !error;
+}
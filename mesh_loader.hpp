@@ -0,0 +1,73 @@
+#pragma once
+
+#include "particle.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Loads the meshes of the surface estimator on a background thread.
+ *
+ * Wavefront OBJ files are parsed by several threads at once (positions and faces only, the rest is ignored).
+ * The result is stored next to the model as a compact binary cache (.pmesh), which later loads memory-map instead
+ * of parsing the text again, as long as the source file has not changed. The tables for sampling the surface are
+ * built on the same thread. The caller polls for the finished mesh,
+ * so nothing blocks the render loop.
+ */
+class MeshLoader {
+public:
+	/** Starts the background thread. */
+	MeshLoader();
+
+	/** Stops and joins the background thread (a load in progress is finished first). */
+	~MeshLoader();
+
+	MeshLoader(const MeshLoader&) = delete;
+	MeshLoader& operator=(const MeshLoader&) = delete;
+
+	/** Requests loading the mesh, replacing the previous request if it has not finished yet. */
+	void load(const std::filesystem::path& path);
+
+	/** Moves the mesh of the last request into the output if it is loaded, returns false otherwise. */
+	bool poll(Mesh& mesh);
+
+	/** Returns a description of how the last polled mesh was loaded (from the cache or parsed, and how long it took). */
+	const std::string& get_last_load_info() const { return last_load_info; }
+
+	/** Parses the positions and the triangulated faces of an OBJ file, splitting the text between the given number of threads. */
+	static bool parse_obj(const std::filesystem::path& path, Mesh& mesh, unsigned thread_count);
+
+	/** Builds the flattened triangles and the alias table sampling them proportionally to their area. */
+	static void build_surface_sampling(Mesh& mesh);
+
+	/** Reads the memory-mapped binary cache, returns false if it is missing, invalid, or does not match the source file. */
+	static bool read_cache(const std::filesystem::path& cache_path, const std::filesystem::path& source_path, Mesh& mesh);
+
+	/** Writes the binary cache of the mesh loaded from the source file. */
+	static bool write_cache(const std::filesystem::path& cache_path, const std::filesystem::path& source_path, const Mesh& mesh);
+
+protected:
+	/** The loop of the background thread. */
+	void worker_loop();
+
+protected:
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable request_available;
+
+	// The requested path and the number of the request, results of older requests are dropped.
+	std::filesystem::path requested_path;
+	uint64_t requested_generation = 0;
+	uint64_t loaded_generation = 0;
+
+	// The loaded mesh waiting to be polled.
+	Mesh loaded_mesh;
+	std::string loaded_info;
+	bool loaded = false;
+	bool stopping = false;
+
+	std::string last_load_info;
+};
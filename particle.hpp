@@ -0,0 +1,24 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+struct Particle {
+	glm::vec4 position; // The position of particles (on CPU).
+	glm::vec3 velocity; // The velocity of particles (on CPU).
+	float lifetime; // The lifetime of the particle
+	glm::vec3 color; // The colors of all particles (on GPU).
+	float remaining; // The remaining time of the particle
+};
+
+struct AliasEntry {
+	float probability; // The probability of keeping the triangle of the slot.
+	int alias; // The triangle chosen otherwise.
+};
+
+struct Mesh {
+	std::vector<glm::vec4> positions;
+	std::vector<int> indices;
+	std::vector<glm::vec4> triangles; // The three vertices of each triangle (flattened for sampling).
+	std::vector<AliasEntry> alias_table; // Chooses the triangles proportionally to their area.
+};
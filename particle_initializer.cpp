@@ -0,0 +1,122 @@
+#include "particle_initializer.hpp"
+#include "counter_rng.hpp"
+#include <algorithm>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace {
+	// The number of particles whose random numbers are drawn at once (the four arrays stay in the L1 cache).
+	constexpr int block_size = 256;
+
+	// The random numbers of one block of particles, one array per component so they are drawn by the SIMD path.
+	struct RandomBlock {
+		float x[block_size];
+		float y[block_size];
+		float z[block_size];
+		float w[block_size];
+
+		void draw(const CpuSimulation& simulation, uint32_t seed, uint32_t stream, int first, int count) {
+			simulation.uniform_block(seed, stream, 0, first, count, x, y, z, w);
+		}
+	};
+
+	// Splits the particles [first, first + count) between the threads of the pool and runs the body on blocks of at most 'block_size' of them.
+	template <typename Body>
+	void for_each_block(CpuSimulation& simulation, int first, int count, const Body& body) {
+		simulation.parallel_for(count, [&](int begin, int end) {
+			for (int block = first + begin; block < first + end; block += block_size) {
+				body(block, std::min(block_size, first + end - block));
+			}
+		});
+	}
+}
+
+void ParticleInitializer::initialize_pulsating(CpuSimulation& simulation, Particle* particles, int count, uint32_t seed, int first) {
+	for_each_block(simulation, first, count, [&](int block, int block_count) {
+		RandomBlock lifetime;
+		lifetime.draw(simulation, seed, CounterRng::STREAM_LIFETIME, block, block_count);
+		for (int j = 0; j < block_count; j++) {
+			// Initializes the particle position.
+			Particle& particle = particles[block + j];
+			particle.position = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			particle.velocity = glm::vec3(0.0f);
+			particle.color = glm::vec3(0.0f);
+			particle.lifetime = lifetime.x[j] * 5.0f;
+			particle.remaining = particle.lifetime;
+		}
+	});
+}
+
+void ParticleInitializer::initialize_attracting(CpuSimulation& simulation, Particle* particles, int count, uint32_t seed, int first) {
+	for_each_block(simulation, first, count, [&](int block, int block_count) {
+		RandomBlock position;
+		RandomBlock velocity;
+		position.draw(simulation, seed, CounterRng::STREAM_POSITION, block, block_count);
+		velocity.draw(simulation, seed, CounterRng::STREAM_VELOCITY, block, block_count);
+		for (int j = 0; j < block_count; j++) {
+			// The lifetime is drawn together with the velocity.
+			Particle& particle = particles[block + j];
+			particle.position = glm::vec4(CounterRng::inside_sphere(position.x[j], position.y[j], position.z[j], 50.0f), 1.0f);
+			particle.velocity = glm::vec3(velocity.x[j], velocity.y[j], velocity.z[j]) * 20.0f - glm::vec3(10.0f);
+			particle.color = glm::vec3(0.0f);
+			particle.lifetime = velocity.w[j] * 5.0f;
+			particle.remaining = particle.lifetime;
+		}
+	});
+}
+
+void ParticleInitializer::initialize_nbody(CpuSimulation& simulation, glm::vec4* positions, glm::vec4* velocities, int count, uint32_t seed, int first) {
+	for_each_block(simulation, first, count, [&](int block, int block_count) {
+		RandomBlock random;
+		random.draw(simulation, seed, CounterRng::STREAM_POSITION, block, block_count);
+		for (int j = 0; j < block_count; j++) {
+			// Initializes the particle position.
+			const float alpha = random.x[j] * 2.0f * static_cast<float>(M_PI);
+			const float beta = asinf(random.y[j] * 2.0f - 1.0f);
+			glm::vec3 point_on_sphere = glm::vec3(cosf(alpha) * cosf(beta), sinf(alpha) * cosf(beta), sinf(beta));
+
+			positions[block + j] = glm::vec4(point_on_sphere, 1.0f);
+			velocities[block + j] = glm::vec4(0.0f);
+		}
+	});
+}
+
+void ParticleInitializer::initialize_nbody_colors(CpuSimulation& simulation, glm::vec3* colors, int count, uint32_t seed) {
+	for_each_block(simulation, 0, count, [&](int block, int block_count) {
+		RandomBlock hue;
+		hue.draw(simulation, seed, CounterRng::STREAM_COLOR, block, block_count);
+		for (int j = 0; j < block_count; j++) {
+			colors[block + j] = glm::rgbColor(glm::vec3(hue.x[j] * 360.0f, 1.0f, 1.0f));
+		}
+	});
+}
+
+void ParticleInitializer::initialize_fluid(CpuSimulation& simulation, Particle* particles, int count, uint32_t seed, int first) {
+	for_each_block(simulation, first, count, [&](int block, int block_count) {
+		RandomBlock random;
+		random.draw(simulation, seed, CounterRng::STREAM_POSITION, block, block_count);
+		for (int j = 0; j < block_count; j++) {
+			Particle& particle = particles[block + j];
+			particle.position = glm::vec4(CounterRng::inside_sphere(random.x[j], random.y[j], random.z[j], 10.0f), 1.0f);
+			particle.velocity = glm::vec3(0.0f);
+			particle.color = glm::vec3(0.0f);
+		}
+	});
+}
+
+void ParticleInitializer::initialize_surface_estimator(CpuSimulation& simulation, Particle* particles, int count, uint32_t seed, int first) {
+	for_each_block(simulation, first, count, [&](int block, int block_count) {
+		RandomBlock random;
+		random.draw(simulation, seed, CounterRng::STREAM_POSITION, block, block_count);
+		for (int j = 0; j < block_count; j++) {
+			// Initializes the particle position.
+			Particle& particle = particles[block + j];
+			particle.position = glm::vec4(CounterRng::inside_sphere(random.x[j], random.y[j], random.z[j], 25.0f), 1.0f);
+			particle.velocity = glm::vec3(0.0f);
+			particle.color = glm::vec3(0.0f);
+		}
+	});
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "cpu_simulation.hpp"
+#include "particle.hpp"
+#include <cstdint>
+
+/**
+ * Generates the initial state of the particles of each scene on the CPU.
+ *
+ * It needs no OpenGL context, so the interactive application and the headless runner start from the same states.
+ * The numbers come from the counter-based CounterRng, so every particle is generated independently of the others:
+ * the particles are split between the threads of the CpuSimulation pool, the numbers of each block of particles are drawn
+ * eight at a time by its SIMD path, and the same seed gives bit-identical states however the work is split.
+ * particle_init.comp generates the same states on the GPU (up to the precision of its trigonometric functions), the colors are cleared.
+ * Each function fills the particles [first, first + count) of the arrays, so a range added later gets the same state it
+ * would have had in a reset with the larger count.
+ */
+class ParticleInitializer {
+public:
+	/** Sphere Pulsating: all particles start at the origin with a random lifetime. */
+	static void initialize_pulsating(CpuSimulation& simulation, Particle* particles, int count, uint32_t seed, int first = 0);
+
+	/** Single and Multi Attractor: random positions inside a sphere with random velocities and lifetimes. */
+	static void initialize_attracting(CpuSimulation& simulation, Particle* particles, int count, uint32_t seed, int first = 0);
+
+	/** N-Body: random positions on the unit sphere at rest. */
+	static void initialize_nbody(CpuSimulation& simulation, glm::vec4* positions, glm::vec4* velocities, int count, uint32_t seed, int first = 0);
+
+	/** N-Body: a random hue of full saturation and value for each particle. */
+	static void initialize_nbody_colors(CpuSimulation& simulation, glm::vec3* colors, int count, uint32_t seed);
+
+	/** Fluid: random positions inside a small sphere at rest, the color is computed by the steps. */
+	static void initialize_fluid(CpuSimulation& simulation, Particle* particles, int count, uint32_t seed, int first = 0);
+
+	/** Particle-Surface Estimator: random positions inside a sphere at rest. */
+	static void initialize_surface_estimator(CpuSimulation& simulation, Particle* particles, int count, uint32_t seed, int first = 0);
+};
@@ -0,0 +1,57 @@
+#include "permutation_tuner.hpp"
+#include <fstream>
+#include <sstream>
+
+void PermutationTuner::load(const std::filesystem::path& path) {
+	this->path = path;
+	results.clear();
+
+	std::ifstream file(path);
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream stream(line);
+		std::string key;
+		if (!(stream >> key)) continue;
+
+		std::vector<int> parameters;
+		int parameter;
+		while (stream >> parameter) {
+			parameters.push_back(parameter);
+		}
+		if (!parameters.empty()) results[key] = parameters;
+	}
+}
+
+bool PermutationTuner::find(const std::string& key, std::vector<int>& parameters) const {
+	const auto found = results.find(key);
+	if (found == results.end()) return false;
+	parameters = found->second;
+	return true;
+}
+
+void PermutationTuner::store(const std::string& key, const std::vector<int>& parameters) {
+	results[key] = parameters;
+	save();
+}
+
+void PermutationTuner::save() const {
+	if (path.empty()) return;
+
+	// Written into a temporary file first, so that an interrupted write never loses the earlier results.
+	std::filesystem::path temporary = path;
+	temporary += ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::trunc);
+		if (!file) return;
+		for (const auto& result : results) {
+			file << result.first;
+			for (int parameter : result.second) {
+				file << " " << parameter;
+			}
+			file << "\n";
+		}
+		if (!file) return;
+	}
+	std::error_code error;
+	std::filesystem::rename(temporary, path, error);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Remembers the fastest shader permutation measured for each scene and particle count on the current device.
+ *
+ * A result is the list of the parameters the permutation was built with (e.g., the workgroup size and the unroll
+ * factor), stored under a key that names the scene, its options and the particle count. The results are saved as text
+ * (one 'key value value ...' line per result) into a file of the driver they were measured with, so they are measured
+ * again after a driver update or on another device.
+ */
+class PermutationTuner {
+public:
+	/** Reads the results of the given file (nothing if it does not exist yet), the stored results are saved into it. */
+	void load(const std::filesystem::path& path);
+
+	/** Whether a file was loaded. */
+	bool is_loaded() const { return !path.empty(); }
+
+	/** Copies the parameters stored under the key into the output, returns false if the key has not been measured. */
+	bool find(const std::string& key, std::vector<int>& parameters) const;
+
+	/** Stores the parameters of the fastest permutation under the key and saves all results. */
+	void store(const std::string& key, const std::vector<int>& parameters);
+
+	/** The number of stored results. */
+	int get_result_count() const { return static_cast<int>(results.size()); }
+
+protected:
+	/** Writes all results into the file. */
+	void save() const;
+
+	std::filesystem::path path;
+	std::map<std::string, std::vector<int>> results;
+};
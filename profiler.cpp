@@ -0,0 +1,144 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <string>
+
+namespace {
+	// The nesting depth of the open CPU scopes of each thread.
+	thread_local int scope_depth = 0;
+
+	// The next free thread index.
+	std::atomic<int> next_thread_index{ 0 };
+
+	/** Writes the string as a JSON string literal. */
+	void write_json_string(std::ofstream& stream, const char* text) {
+		stream << '"';
+		for (const char* c = text; *c != '\0'; c++) {
+			if (*c == '"' || *c == '\\') stream << '\\';
+			stream << *c;
+		}
+		stream << '"';
+	}
+}
+
+Profiler::Profiler() : slots(CAPACITY) {
+	for (int i = 0; i <= MAX_THREADS; i++) {
+		thread_names[i].store(nullptr, std::memory_order_relaxed);
+	}
+	thread_names[GPU_THREAD].store("GPU", std::memory_order_relaxed);
+}
+
+Profiler& Profiler::get() {
+	static Profiler profiler;
+	return profiler;
+}
+
+int64_t Profiler::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int Profiler::get_thread_index() {
+	thread_local const int index = std::min(next_thread_index.fetch_add(1, std::memory_order_relaxed), MAX_THREADS - 1);
+	return index;
+}
+
+void Profiler::set_thread_name(const char* name) {
+	thread_names[get_thread_index()].store(name, std::memory_order_relaxed);
+}
+
+void Profiler::record(const ProfileEvent& event) {
+	if (!is_enabled()) return;
+
+	// Claims the slot, marks it as being written, writes it and publishes it (a sequence lock per slot).
+	const uint64_t index = write_index.fetch_add(1, std::memory_order_relaxed);
+	Slot& slot = slots[index & (CAPACITY - 1)];
+	slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.event = event;
+	slot.sequence.store(2 * (index + 1), std::memory_order_release);
+}
+
+void Profiler::snapshot(std::vector<ProfileEvent>& events, uint64_t frame_index) const {
+	const uint64_t end = write_index.load(std::memory_order_acquire);
+	const uint64_t begin = (end > CAPACITY) ? end - CAPACITY : 0;
+
+	for (uint64_t index = begin; index < end; index++) {
+		const Slot& slot = slots[index & (CAPACITY - 1)];
+		// Skips the slots still being written or already reused by a newer event.
+		const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+		if (sequence != 2 * (index + 1)) continue;
+		const ProfileEvent event = slot.event;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) != sequence) continue;
+		if (frame_index != ALL_FRAMES && event.frame != frame_index) continue;
+		events.push_back(event);
+	}
+
+	std::sort(events.begin(), events.end(), [](const ProfileEvent& a, const ProfileEvent& b) { return a.start < b.start; });
+}
+
+void Profiler::collect_frame(uint64_t frame_index, std::vector<ProfileEvent>& events) const {
+	snapshot(events, frame_index);
+}
+
+bool Profiler::export_chrome_trace(const std::filesystem::path& path) const {
+	std::vector<ProfileEvent> events;
+	snapshot(events);
+
+	std::ofstream stream(path, std::ios::trunc);
+	if (!stream) return false;
+	stream << std::fixed << std::setprecision(3);
+
+	// The timestamps are in microseconds from the first section.
+	const int64_t origin = events.empty() ? 0 : events.front().start;
+
+	stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	for (int i = 0; i <= MAX_THREADS; i++) {
+		const char* name = thread_names[i].load(std::memory_order_relaxed);
+		if (name == nullptr) continue;
+		stream << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i << ",\"args\":{\"name\":";
+		write_json_string(stream, name);
+		stream << "}}";
+		first = false;
+	}
+	for (const ProfileEvent& event : events) {
+		stream << (first ? "" : ",\n") << "{\"name\":";
+		write_json_string(stream, event.name);
+		stream << ",\"cat\":\"" << (event.thread == GPU_THREAD ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.thread
+			<< ",\"ts\":" << static_cast<double>(event.start - origin) * 1e-3 << ",\"dur\":" << static_cast<double>(event.duration) * 1e-3
+			<< ",\"args\":{\"frame\":" << event.frame << "}}";
+		first = false;
+	}
+	stream << "\n]}\n";
+
+	return static_cast<bool>(stream);
+}
+
+ProfileScope::ProfileScope(const char* name) : name(name) {
+	Profiler& profiler = Profiler::get();
+	if (!profiler.is_enabled()) return;
+
+	active = true;
+	frame = profiler.get_frame();
+	scope_depth++;
+	start = Profiler::now();
+}
+
+ProfileScope::~ProfileScope() {
+	if (!active) return;
+
+	const int64_t end = Profiler::now();
+	scope_depth--;
+
+	ProfileEvent event;
+	event.name = name;
+	event.start = start;
+	event.duration = end - start;
+	event.frame = frame;
+	event.depth = scope_depth;
+	event.thread = Profiler::get_thread_index();
+	Profiler::get().record(event);
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+/** One timed section recorded by the {@link Profiler}. */
+struct ProfileEvent {
+	// The name must be a string that outlives the profiler (a literal or a constant table entry).
+	const char* name = nullptr;
+	// The start and the duration in nanoseconds of the CPU clock (GPU events are converted to it).
+	int64_t start = 0;
+	int64_t duration = 0;
+	// The frame the section was issued in and its nesting depth on its thread (or on the GPU).
+	uint64_t frame = 0;
+	int depth = 0;
+	// The small index of the recording thread, Profiler::GPU_THREAD for the GPU sections.
+	int thread = 0;
+};
+
+/**
+ * Collects the timed sections of all threads into a lock-free ring buffer.
+ *
+ * Recording claims a slot with one atomic increment and publishes it with a sequence number, so the hot paths and the
+ * background threads never take a lock; readers skip the slots that are being rewritten. The oldest sections are
+ * overwritten once the ring is full. The sections are recorded by {@link ProfileScope} (CPU) and {@link GpuProfiler} (GPU),
+ * read back per frame for the UI and exported to the Chrome trace event format (chrome://tracing, Perfetto).
+ */
+class Profiler {
+public:
+	/** The number of slots of the ring, a power of two. */
+	static const int CAPACITY = 1 << 15;
+
+	/** The thread index used by the GPU sections. */
+	static const int GPU_THREAD = 63;
+
+	/** The maximum number of threads with their own index, the later ones share the last index before GPU_THREAD. */
+	static const int MAX_THREADS = 63;
+
+	/** Returns the profiler shared by all threads. */
+	static Profiler& get();
+
+	/** Returns the current time of the CPU clock in nanoseconds. */
+	static int64_t now();
+
+	/** Starts a new frame, the following sections are attributed to it. */
+	void begin_frame() { frame.fetch_add(1, std::memory_order_relaxed); }
+
+	/** Returns the index of the current frame. */
+	uint64_t get_frame() const { return frame.load(std::memory_order_relaxed); }
+
+	/** Records a finished section. */
+	void record(const ProfileEvent& event);
+
+	/** Names the calling thread in the exported traces. */
+	void set_thread_name(const char* name);
+
+	/** Returns the name of the thread with the given index, nullptr if it has none. */
+	const char* get_thread_name(int thread) const { return thread_names[thread].load(std::memory_order_relaxed); }
+
+	/** Returns the index of the calling thread. */
+	static int get_thread_index();
+
+	/** Appends the sections of the given frame that are still in the ring, ordered by their start. */
+	void collect_frame(uint64_t frame_index, std::vector<ProfileEvent>& events) const;
+
+	/** Writes all sections in the ring as Chrome trace event JSON. */
+	bool export_chrome_trace(const std::filesystem::path& path) const;
+
+	/** Enables or disables the recording, the scopes cost a single branch while disabled. */
+	void set_enabled(bool enabled) { this->enabled.store(enabled, std::memory_order_relaxed); }
+
+	/** Returns whether the sections are recorded. */
+	bool is_enabled() const { return enabled.load(std::memory_order_relaxed); }
+
+protected:
+	Profiler();
+
+	/** Appends the events of the given frame (or all) in the ring that are not being rewritten, ordered by their start. */
+	void snapshot(std::vector<ProfileEvent>& events, uint64_t frame_index = ALL_FRAMES) const;
+
+protected:
+	static const uint64_t ALL_FRAMES = UINT64_MAX;
+
+	// A slot of the ring, 'sequence' is odd while the event is written and 2 * (index + 1) once it is published.
+	struct Slot {
+		std::atomic<uint64_t> sequence{ 0 };
+		ProfileEvent event;
+	};
+
+	std::vector<Slot> slots;
+	std::atomic<uint64_t> write_index{ 0 };
+	std::atomic<uint64_t> frame{ 0 };
+	std::atomic<bool> enabled{ true };
+
+	std::atomic<const char*> thread_names[MAX_THREADS + 1];
+};
+
+/** Records the CPU time of the enclosing scope into the {@link Profiler}. */
+class ProfileScope {
+public:
+	explicit ProfileScope(const char* name);
+	~ProfileScope();
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+protected:
+	const char* name;
+	int64_t start = 0;
+	uint64_t frame = 0;
+	bool active = false;
+};
+
+#define PROFILE_CONCATENATE_IMPL(a, b) a##b
+#define PROFILE_CONCATENATE(a, b) PROFILE_CONCATENATE_IMPL(a, b)
+
+/** Times the rest of the enclosing scope on the CPU under the given name. */
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCATENATE(profile_scope_, __LINE__)(name)
@@ -0,0 +1,347 @@
+#include "program_cache.hpp"
+#include <GLFW/glfw3.h>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+	// The same constants as GL_KHR_parallel_shader_compile and GL_ARB_parallel_shader_compile.
+	const GLuint MAX_COMPILER_THREADS = 0xFFFFFFFFu;
+	using MaxShaderCompilerThreadsProc = void (APIENTRY*)(GLuint count);
+
+	// The header of the cached binaries.
+	const uint32_t BINARY_MAGIC = 0x4E494250; // "PBIN"
+	const uint32_t BINARY_VERSION = 1;
+
+	// FNV-1a, the hash only needs to tell the sources apart.
+	uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	uint64_t hash_string(uint64_t hash, const std::string& text) {
+		// The length separates the strings, so that moving text between them changes the hash.
+		const uint64_t length = text.size();
+		hash = hash_bytes(hash, &length, sizeof(length));
+		return hash_bytes(hash, text.data(), text.size());
+	}
+
+	bool read_text(const std::filesystem::path& path, std::string& text) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file) return false;
+		std::ostringstream stream;
+		stream << file.rdbuf();
+		text = stream.str();
+		return true;
+	}
+
+	// Inserts the defines after the '#version' line, '#line' keeps the line numbers of the errors.
+	std::string inject_defines(const std::string& source, const ShaderDefines& defines) {
+		if (defines.empty()) return source;
+
+		const size_t version = source.find("#version");
+		const size_t line_end = (version == std::string::npos) ? std::string::npos : source.find('\n', version);
+		const size_t insert_at = (line_end == std::string::npos) ? 0 : line_end + 1;
+		int line = 1;
+		for (size_t i = 0; i < insert_at; i++) {
+			if (source[i] == '\n') line++;
+		}
+
+		std::string block;
+		for (const auto& define : defines) {
+			block.append("#define ").append(define.first).append(" ").append(define.second).append("\n");
+		}
+		block.append("#line ").append(std::to_string(line)).append("\n");
+		return std::string(source).insert(insert_at, block);
+	}
+
+	GLenum get_stage(const std::filesystem::path& path) {
+		const std::string extension = path.extension().string();
+		if (extension == ".vert") return GL_VERTEX_SHADER;
+		if (extension == ".geom") return GL_GEOMETRY_SHADER;
+		if (extension == ".frag") return GL_FRAGMENT_SHADER;
+		if (extension == ".comp") return GL_COMPUTE_SHADER;
+		return GL_NONE;
+	}
+
+	std::string get_shader_log(GLuint shader) {
+		GLint length = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+		std::string log(std::max(length, 1), '\0');
+		glGetShaderInfoLog(shader, length, nullptr, log.data());
+		return log;
+	}
+
+	std::string get_program_log(GLuint program) {
+		GLint length = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+		std::string log(std::max(length, 1), '\0');
+		glGetProgramInfoLog(program, length, nullptr, log.data());
+		return log;
+	}
+}
+
+CachedShaderProgram::~CachedShaderProgram() {
+	if (program != 0) glDeleteProgram(program);
+}
+
+void CachedShaderProgram::use() const {
+	glUseProgram(program);
+}
+
+void CachedShaderProgram::set_program(GLuint new_program) {
+	if (program != 0) glDeleteProgram(program);
+	program = new_program;
+	locations.clear();
+}
+
+GLint CachedShaderProgram::get_location(const std::string& name) {
+	const auto found = locations.find(name);
+	if (found != locations.end()) return found->second;
+
+	// Unknown uniforms (-1) are cached too, setting them does nothing.
+	const GLint location = (program != 0) ? glGetUniformLocation(program, name.c_str()) : -1;
+	locations.emplace(name, location);
+	return location;
+}
+
+void CachedShaderProgram::uniform(const std::string& name, float value) { glProgramUniform1f(program, get_location(name), value); }
+void CachedShaderProgram::uniform(const std::string& name, int value) { glProgramUniform1i(program, get_location(name), value); }
+void CachedShaderProgram::uniform(const std::string& name, unsigned value) { glProgramUniform1ui(program, get_location(name), value); }
+void CachedShaderProgram::uniform(const std::string& name, bool value) { glProgramUniform1i(program, get_location(name), value ? 1 : 0); }
+void CachedShaderProgram::uniform(const std::string& name, const glm::vec2& value) { glProgramUniform2fv(program, get_location(name), 1, glm::value_ptr(value)); }
+void CachedShaderProgram::uniform(const std::string& name, const glm::vec3& value) { glProgramUniform3fv(program, get_location(name), 1, glm::value_ptr(value)); }
+void CachedShaderProgram::uniform(const std::string& name, const glm::vec4& value) { glProgramUniform4fv(program, get_location(name), 1, glm::value_ptr(value)); }
+void CachedShaderProgram::uniform(const std::string& name, const glm::ivec3& value) { glProgramUniform3iv(program, get_location(name), 1, glm::value_ptr(value)); }
+void CachedShaderProgram::uniform(const std::string& name, const glm::mat4& value) { glProgramUniformMatrix4fv(program, get_location(name), 1, GL_FALSE, glm::value_ptr(value)); }
+
+ProgramCache::ProgramCache(std::filesystem::path directory) : directory(std::move(directory)) {}
+
+bool ProgramCache::add(CachedShaderProgram& program, const std::vector<std::filesystem::path>& files, const ShaderDefines& defines) {
+	// Registering the same program again (on a reload or a new permutation) only updates its files and defines.
+	for (Entry& entry : entries) {
+		if (entry.program == &program) {
+			const bool changed = entry.files != files || entry.defines != defines;
+			entry.files = files;
+			entry.defines = defines;
+			return changed;
+		}
+	}
+	entries.push_back({ &program, files, defines, 0 });
+	return true;
+}
+
+void ProgramCache::remove(CachedShaderProgram& program) {
+	entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const Entry& entry) { return entry.program == &program; }), entries.end());
+}
+
+void ProgramCache::prepare_driver() {
+	if (driver_prepared) return;
+	driver_prepared = true;
+
+	// The binaries are only valid for the driver that produced them.
+	const GLubyte* vendor = glGetString(GL_VENDOR);
+	const GLubyte* renderer = glGetString(GL_RENDERER);
+	const GLubyte* version = glGetString(GL_VERSION);
+	driver_key = std::string(vendor ? reinterpret_cast<const char*>(vendor) : "")
+		.append("|").append(renderer ? reinterpret_cast<const char*>(renderer) : "")
+		.append("|").append(version ? reinterpret_cast<const char*>(version) : "");
+	driver_hash = hash_string(14695981039346656037ull, driver_key);
+
+	GLint binary_format_count = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binary_format_count);
+	binaries_supported = binary_format_count > 0;
+
+	GLint extension_count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+	for (GLint i = 0; i < extension_count; i++) {
+		const std::string extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		const bool khr = extension == "GL_KHR_parallel_shader_compile";
+		if (!khr && extension != "GL_ARB_parallel_shader_compile") continue;
+
+		// Lets the driver use as many compiler threads as it wants.
+		const auto max_threads = reinterpret_cast<MaxShaderCompilerThreadsProc>(
+			glfwGetProcAddress(khr ? "glMaxShaderCompilerThreadsKHR" : "glMaxShaderCompilerThreadsARB"));
+		if (max_threads != nullptr) {
+			max_threads(MAX_COMPILER_THREADS);
+			parallel_compile = true;
+			break;
+		}
+	}
+
+	if (binaries_supported) {
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+	}
+}
+
+std::filesystem::path ProgramCache::get_binary_path(uint64_t hash) const {
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(hash));
+	return directory / name;
+}
+
+GLuint ProgramCache::load_binary(uint64_t hash) const {
+	if (!binaries_supported) return 0;
+
+	std::ifstream file(get_binary_path(hash), std::ios::binary);
+	if (!file) return 0;
+
+	uint32_t header[4] = {};
+	file.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (!file || header[0] != BINARY_MAGIC || header[1] != BINARY_VERSION) return 0;
+
+	const GLenum format = header[2];
+	std::vector<char> binary(header[3]);
+	file.read(binary.data(), binary.size());
+	if (!file) return 0;
+
+	// The driver may still reject the binary (e.g., after an update that kept the version string), it is compiled then.
+	const GLuint program = glCreateProgram();
+	glProgramBinary(program, format, binary.data(), static_cast<GLsizei>(binary.size()));
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE) {
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+void ProgramCache::store_binary(GLuint program, uint64_t hash) const {
+	if (!binaries_supported) return;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+
+	std::vector<char> binary(length);
+	GLenum format = GL_NONE;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+
+	// Written into a temporary file first, so that an interrupted write never leaves a truncated binary behind.
+	const std::filesystem::path path = get_binary_path(hash);
+	std::filesystem::path temporary = path;
+	temporary += ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file) return;
+		const uint32_t header[4] = { BINARY_MAGIC, BINARY_VERSION, static_cast<uint32_t>(format), static_cast<uint32_t>(length) };
+		file.write(reinterpret_cast<const char*>(header), sizeof(header));
+		file.write(binary.data(), length);
+		if (!file) return;
+	}
+	std::error_code error;
+	std::filesystem::rename(temporary, path, error);
+}
+
+void ProgramCache::build() {
+	const auto start = std::chrono::high_resolution_clock::now();
+	prepare_driver();
+	unchanged_count = 0;
+	loaded_count = 0;
+	compiled_count = 0;
+	failed_count = 0;
+
+	// Hashes the current sources, the programs built from the same sources are kept.
+	std::vector<PendingBuild> pending;
+	std::vector<std::vector<std::string>> pending_sources;
+	for (Entry& entry : entries) {
+		std::vector<std::string> sources(entry.files.size());
+		uint64_t hash = driver_hash;
+		for (const auto& define : entry.defines) {
+			hash = hash_string(hash, define.first);
+			hash = hash_string(hash, define.second);
+		}
+		bool readable = true;
+		for (size_t i = 0; i < entry.files.size(); i++) {
+			if (!read_text(entry.files[i], sources[i])) {
+				std::cerr << "Cannot read the shader " << entry.files[i].generic_string() << std::endl;
+				readable = false;
+				break;
+			}
+			hash = hash_string(hash, entry.files[i].extension().string());
+			hash = hash_string(hash, sources[i]);
+			sources[i] = inject_defines(sources[i], entry.defines);
+		}
+		if (!readable) {
+			failed_count++;
+			continue;
+		}
+		if (hash == entry.hash && entry.program->get_program() != 0) {
+			unchanged_count++;
+			continue;
+		}
+
+		// Uses the cached binary when there is one.
+		const GLuint program = load_binary(hash);
+		if (program != 0) {
+			entry.program->set_program(program);
+			entry.hash = hash;
+			loaded_count++;
+			continue;
+		}
+
+		pending.push_back({ &entry, hash, 0, {} });
+		pending_sources.push_back(std::move(sources));
+	}
+
+	// Submits all compilations and links before querying any of them, so the driver can work on them in parallel.
+	for (size_t p = 0; p < pending.size(); p++) {
+		PendingBuild& build = pending[p];
+		build.program = glCreateProgram();
+		glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		for (size_t i = 0; i < build.entry->files.size(); i++) {
+			const GLuint shader = glCreateShader(get_stage(build.entry->files[i]));
+			const char* source = pending_sources[p][i].c_str();
+			glShaderSource(shader, 1, &source, nullptr);
+			glCompileShader(shader);
+			glAttachShader(build.program, shader);
+			build.shaders.push_back(shader);
+		}
+		glLinkProgram(build.program);
+	}
+
+	// Collects the results, the first queries wait for the driver.
+	for (PendingBuild& build : pending) {
+		GLint linked = GL_FALSE;
+		glGetProgramiv(build.program, GL_LINK_STATUS, &linked);
+		if (linked == GL_TRUE) {
+			store_binary(build.program, build.hash);
+			build.entry->program->set_program(build.program);
+			build.entry->hash = build.hash;
+			compiled_count++;
+		}
+		else {
+			// Reports the failed stages, the previous version of the program stays in use.
+			for (size_t i = 0; i < build.shaders.size(); i++) {
+				GLint compiled = GL_FALSE;
+				glGetShaderiv(build.shaders[i], GL_COMPILE_STATUS, &compiled);
+				if (compiled != GL_TRUE) {
+					std::cerr << "Cannot compile " << build.entry->files[i].generic_string() << ":" << std::endl << get_shader_log(build.shaders[i]) << std::endl;
+				}
+			}
+			std::cerr << "Cannot link " << build.entry->files.front().stem().generic_string() << ":" << std::endl << get_program_log(build.program) << std::endl;
+			glDeleteProgram(build.program);
+			failed_count++;
+		}
+		for (GLuint shader : build.shaders) {
+			glDeleteShader(shader);
+		}
+	}
+
+	const auto end = std::chrono::high_resolution_clock::now();
+	build_time = std::chrono::duration<float, std::milli>(end - start).count();
+
+	std::cout << "---" << std::endl;
+	std::cout << "Programs: " << unchanged_count << " unchanged, " << loaded_count << " loaded from the cache, " << compiled_count << " compiled"
+		<< (parallel_compile ? " (in parallel)" : "") << ", " << failed_count << " failed in " << build_time << " ms" << std::endl;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/** The preprocessor definitions (name and value) of a shader permutation, injected after the '#version' line. */
+using ShaderDefines = std::vector<std::pair<std::string, std::string>>;
+
+/**
+ * A shader program built by {@link ProgramCache}, with the same use and uniform methods as the framework's ShaderProgram.
+ *
+ * The program is owned by the cache entry that builds it and replaced in place when its sources change, so it cannot
+ * be copied. The uniforms are set with glProgramUniform, so the program does not need to be in use.
+ */
+class CachedShaderProgram {
+public:
+	CachedShaderProgram() = default;
+
+	/** Deletes the program. */
+	~CachedShaderProgram();
+
+	CachedShaderProgram(const CachedShaderProgram&) = delete;
+	CachedShaderProgram& operator=(const CachedShaderProgram&) = delete;
+
+	/** Makes the program current, nothing is drawn if it failed to build. */
+	void use() const;
+
+	void uniform(const std::string& name, float value);
+	void uniform(const std::string& name, int value);
+	void uniform(const std::string& name, unsigned value);
+	void uniform(const std::string& name, bool value);
+	void uniform(const std::string& name, const glm::vec2& value);
+	void uniform(const std::string& name, const glm::vec3& value);
+	void uniform(const std::string& name, const glm::vec4& value);
+	void uniform(const std::string& name, const glm::ivec3& value);
+	void uniform(const std::string& name, const glm::mat4& value);
+
+	/** Returns the OpenGL program, 0 if it has not been built yet. */
+	GLuint get_program() const { return program; }
+
+protected:
+	friend class ProgramCache;
+
+	/** Replaces the program with a newly linked one. */
+	void set_program(GLuint new_program);
+
+	/** Returns the location of the uniform, looked up once per program. */
+	GLint get_location(const std::string& name);
+
+	GLuint program = 0;
+	std::unordered_map<std::string, GLint> locations;
+};
+
+/**
+ * Builds the shader programs of the application from their source files, as fast as the driver allows.
+ *
+ * Each program is identified by a hash of its sources and of the driver (vendor, renderer and version). The linked
+ * binaries are stored in the cache directory (glGetProgramBinary) and loaded instead of compiling when the hash
+ * matches (glProgramBinary). The programs that still need compiling are all submitted before any result is queried,
+ * so that the driver compiles them in parallel, with as many threads as it allows when GL_KHR_parallel_shader_compile
+ * (or GL_ARB_parallel_shader_compile) is available. A rebuild skips the programs whose sources did not change, and a
+ * program that fails to compile keeps its previous version.
+ *
+ * The same files can be registered several times with different defines (the permutations), the defines are part of
+ * the hash, so each permutation has its own binary.
+ */
+class ProgramCache {
+public:
+	explicit ProgramCache(std::filesystem::path directory = "shader_cache");
+
+	/**
+	 * Registers the program with its shader files (the stage follows the extension: .vert, .geom, .frag or .comp) and the
+	 * defines of its permutation. Returns whether the files or the defines differ from the last registration.
+	 */
+	bool add(CachedShaderProgram& program, const std::vector<std::filesystem::path>& files, const ShaderDefines& defines = {});
+
+	/** Unregisters the program (e.g., a permutation that was only built to be measured). */
+	void remove(CachedShaderProgram& program);
+
+	/** Builds the registered programs whose sources (or the driver) changed since they were last built. */
+	void build();
+
+	/** The programs of the last build: unchanged, loaded from the cache, compiled and failed. */
+	int get_unchanged_count() const { return unchanged_count; }
+	int get_loaded_count() const { return loaded_count; }
+	int get_compiled_count() const { return compiled_count; }
+	int get_failed_count() const { return failed_count; }
+
+	/** The duration of the last build in milliseconds. */
+	float get_build_time() const { return build_time; }
+
+	/** Whether the driver compiles the shaders in parallel. */
+	bool is_parallel() const { return parallel_compile; }
+
+	/** The directory with the cached binaries. */
+	const std::filesystem::path& get_directory() const { return directory; }
+
+	/** The hash of the driver the binaries belong to, 0 before the first build. */
+	uint64_t get_driver_hash() const { return driver_hash; }
+
+protected:
+	struct Entry {
+		CachedShaderProgram* program;
+		std::vector<std::filesystem::path> files;
+		ShaderDefines defines;
+		uint64_t hash = 0; // The hash of the sources the current program was built from (0 if not built).
+	};
+
+	/** A program being compiled and linked. */
+	struct PendingBuild {
+		Entry* entry;
+		uint64_t hash;
+		GLuint program;
+		std::vector<GLuint> shaders;
+	};
+
+	/** Queries the driver and enables the parallel compilation on first use. */
+	void prepare_driver();
+
+	/** Returns the program linked from the cached binary with the given hash, 0 if there is none or the driver rejects it. */
+	GLuint load_binary(uint64_t hash) const;
+
+	/** Stores the binary of the linked program under the given hash. */
+	void store_binary(GLuint program, uint64_t hash) const;
+
+	/** Returns the path of the cached binary with the given hash. */
+	std::filesystem::path get_binary_path(uint64_t hash) const;
+
+	std::filesystem::path directory;
+	std::vector<Entry> entries;
+
+	bool driver_prepared = false;
+	bool binaries_supported = false;
+	bool parallel_compile = false;
+	std::string driver_key;
+	uint64_t driver_hash = 0;
+
+	int unchanged_count = 0;
+	int loaded_count = 0;
+	int compiled_count = 0;
+	int failed_count = 0;
+	float build_time = 0.0f;
+};
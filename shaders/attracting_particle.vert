@@ -15,11 +15,6 @@ layout (std140, binding = 0) uniform CameraBuffer
 	vec3 eye_position;		// The position of the eye in world space.
 };
 
-uniform float t_time;	// Time current time.
-uniform float t_delta;	// The time delta.
-uniform vec3 attractor_point; // The attractor point.
-uniform float attractor_force = 9.8f; // The force of the attractor.
-
 struct Particle {
 	vec4 position;	// The position of the particle.
 	vec3 velocity;	// The velocity of the particle.
@@ -28,27 +23,38 @@ struct Particle {
 	float remaining; // The remaining lifetime of the particle.
 };
 
-layout (std430, binding = 3) buffer ParticleBuffer
+layout (std430, binding = 3) readonly buffer ParticleBuffer
 {
 	Particle particles[]; // The array with particles.
 };
 
-// Function to generate a random number based on input (simple hash function)
-float random(float p)
+// The storage layout of the particles: 0 stores one Particle structure per particle in ParticleBuffer,
+// 1 stores each attribute in its own stream, and only the streams this scene uses are bound.
+uniform int particle_layout = 0;
+// Whether the velocity and color streams contain half floats.
+uniform bool half_precision = false;
+
+layout (std430, binding = 11) readonly buffer PositionStream
 {
-    p = fract(p * .1031);
-    p *= p + 33.33;
-    p *= p + p;
-    return fract(p);
+	float position_stream[]; // The positions (3 floats per particle).
+};
+
+layout (std430, binding = 13) readonly buffer ColorStream
+{
+	uint color_stream[]; // The colors (3 floats or 2 words of packed halves per particle).
+};
+
+vec4 load_position(int i)
+{
+	if (particle_layout == 0) return particles[i].position;
+	return vec4(position_stream[3 * i], position_stream[3 * i + 1], position_stream[3 * i + 2], 1.0f);
 }
 
-vec3 random_direction(float min, float max)
+vec3 load_color(int i)
 {
-    return vec3(
-        random(gl_VertexID + 1) * (max - min) + min, // X component
-        random(gl_VertexID + 2) * (max - min) + min, // Y component
-        random(gl_VertexID + 3) * (max - min) + min  // Z component
-    );
+	if (particle_layout == 0) return particles[i].color;
+	if (half_precision) return vec3(unpackHalf2x16(color_stream[2 * i]), unpackHalf2x16(color_stream[2 * i + 1]).x);
+	return uintBitsToFloat(uvec3(color_stream[3 * i], color_stream[3 * i + 1], color_stream[3 * i + 2]));
 }
 
 // ----------------------------------------------------------------------------
@@ -60,31 +66,15 @@ out VertexData
 	vec4 position_vs;  // The particle position in view space.
 } out_data;
 
-
 // ----------------------------------------------------------------------------
 // Main Method
 // ----------------------------------------------------------------------------
 void main()
 {
-	Particle particle = particles[gl_VertexID];
-
-	if (length(particle.color) == 0) {
-		float rv = random(gl_VertexID + t_time * 0.001);
-		float gv = random(gl_VertexID + t_time * 0.001 + 1);
-		float bv = random(gl_VertexID + t_time * 0.001 + 2);
-
-		particle.color = vec3(rv, gv, bv);
-	}
-    vec3 dir_to_attractor = normalize(attractor_point - particle.position.xyz) * attractor_force;
-
-	// Update the particle's position based on its velocity
-	particle.position += vec4(particle.velocity, 0) * t_delta + 0.5f * vec4(dir_to_attractor, 0) * t_delta * t_delta;
-	particle.velocity += dir_to_attractor * t_delta;
-
-    // Set the particle's position back into the buffer
-    particles[gl_VertexID] = particle;
+	// The particles are simulated in attracting_particle.comp, they are only read here.
+	vec4 position = load_position(gl_VertexID);
 
     // Output gl_Position for the current particle
-	out_data.color = particle.color;
-    out_data.position_vs = view * particle.position;
+	out_data.color = load_color(gl_VertexID);
+    out_data.position_vs = view * position;
 }
\ No newline at end of file
@@ -0,0 +1,20 @@
+#version 450 core
+
+// ----------------------------------------------------------------------------
+// Output Variables
+// ----------------------------------------------------------------------------
+out VertexData
+{
+	vec2 tex_coord;    // The texture coordinates of the screen.
+} out_data;
+
+// ----------------------------------------------------------------------------
+// Main Method
+// ----------------------------------------------------------------------------
+void main()
+{
+	// One triangle covering the whole screen, generated from the vertex index (draw 3 vertices with the empty VAO).
+	vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	out_data.tex_coord = position;
+	gl_Position = vec4(position * 2.0f - 1.0f, 0.0f, 1.0f);
+}
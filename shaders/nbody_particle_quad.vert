@@ -0,0 +1,84 @@
+#version 450 core
+
+// ----------------------------------------------------------------------------
+// Local Variables
+// ----------------------------------------------------------------------------
+// The texture coorinates of the quad corners, in the order of the geometry shader's triangle strip.
+const vec2 quad_tex_coords[4] = vec2[4](
+	vec2(0.0, 1.0),
+	vec2(0.0, 0.0),
+	vec2(1.0, 1.0),
+	vec2(1.0, 0.0)
+);
+// The position offsets of the quad corners.
+const vec2 quad_offsets[4] = vec2[4](
+	vec2(-0.5, +0.5),
+	vec2(-0.5, -0.5),
+	vec2(+0.5, +0.5),
+	vec2(+0.5, -0.5)
+);
+// The corners of the two triangles of the quad, the same as the triangles of the strip.
+const int quad_corners[6] = int[6](0, 1, 2, 2, 1, 3);
+
+// ----------------------------------------------------------------------------
+// Input Variables
+// ----------------------------------------------------------------------------
+// The shader storage buffer with the positions of the last step.
+layout (std430, binding = 0) readonly buffer PositionsBuffer
+{
+	vec4 particle_positions[];
+};
+// The shader storage buffer with the colors (3 tightly packed floats per particle).
+layout (std430, binding = 15) readonly buffer ColorsBuffer
+{
+	float particle_colors[];
+};
+
+// The UBO with camera data.	
+layout (std140, binding = 0) uniform CameraBuffer
+{
+	mat4 projection;		// The projection matrix.
+	mat4 projection_inv;	// The inverse of the projection matrix.
+	mat4 view;				// The view matrix
+	mat4 view_inv;			// The inverse of the view matrix.
+	mat3 view_it;			// The inverse of the transpose of the top-left part 3x3 of the view matrix
+	vec3 eye_position;		// The position of the eye in world space.
+};
+
+// The size of a particle in view space.
+uniform float particle_size_vs;
+// Whether the quads are drawn as instances (one per particle) or pulled from gl_VertexID (six vertices per particle).
+uniform bool instanced = false;
+// Whether the particles are drawn in the order of the depth sort (back to front) instead of the order in memory.
+uniform bool use_draw_order = false;
+
+layout (std430, binding = 16) readonly buffer DrawOrderBuffer
+{
+	uint draw_order[]; // The indices of the particles in the order they are drawn.
+};
+
+// ----------------------------------------------------------------------------
+// Output Variables
+// ----------------------------------------------------------------------------
+out VertexData
+{
+	vec3 color;	       // The particle color.
+	vec2 tex_coord;    // The texture coordinates for the particle.
+} out_data;
+
+// ----------------------------------------------------------------------------
+// Main Method
+// ----------------------------------------------------------------------------
+void main()
+{
+	// The quad of each particle replaces the points expanded by nbody_particle.geom.
+	int particle = instanced ? gl_InstanceID : gl_VertexID / 6;
+	if (use_draw_order) particle = int(draw_order[particle]);
+	int corner = quad_corners[instanced ? gl_VertexID : gl_VertexID % 6];
+
+	vec4 position_vs = view * particle_positions[particle];
+	gl_Position = projection * (position_vs + vec4(particle_size_vs * quad_offsets[corner], 0.0f, 0.0f));
+
+	out_data.color = vec3(particle_colors[3 * particle], particle_colors[3 * particle + 1], particle_colors[3 * particle + 2]);
+	out_data.tex_coord = quad_tex_coords[corner];
+}
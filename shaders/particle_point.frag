@@ -0,0 +1,30 @@
+#version 450 core
+
+// ----------------------------------------------------------------------------
+// Input Variables
+// ----------------------------------------------------------------------------
+in VertexData
+{
+	vec3 color;	       // The particle color.
+	float fade;        // The factor of the intensity.
+} in_data;
+
+// The average intensity of the particle texture, which the point stands in for.
+uniform float point_intensity = 0.25f;
+// The opacity of the alpha-blended smoke (1 with the additive star).
+uniform float opacity = 1.0f;
+
+// ----------------------------------------------------------------------------
+// Output Variables
+// ----------------------------------------------------------------------------
+// The final fragment color.
+layout (location = 0) out vec4 final_color;
+
+// ----------------------------------------------------------------------------
+// Main Method
+// ----------------------------------------------------------------------------
+void main()
+{
+	float intensity = point_intensity * opacity * in_data.fade;
+	final_color = vec4(in_data.color * intensity, intensity);
+}
@@ -0,0 +1,118 @@
+#version 450 core
+
+// ----------------------------------------------------------------------------
+// Input Variables
+// ----------------------------------------------------------------------------
+
+// The UBO with camera data.
+layout (std140, binding = 0) uniform CameraBuffer
+{
+	mat4 projection;		// The projection matrix.
+	mat4 projection_inv;	// The inverse of the projection matrix.
+	mat4 view;				// The view matrix
+	mat4 view_inv;			// The inverse of the view matrix.
+	mat3 view_it;			// The inverse of the transpose of the top-left part 3x3 of the view matrix
+	vec3 eye_position;		// The position of the eye in world space.
+};
+
+struct Particle {
+	vec4 position;	// The position of the particle.
+	vec3 velocity;	// The velocity of the particle.
+	float lifetime; // The lifetime of the particle.
+	vec3 color;		// The color of the particle.
+	float remaining; // The remaining lifetime of the particle.
+};
+
+layout (std430, binding = 3) readonly buffer ParticleBuffer
+{
+	Particle particles[]; // The array with particles.
+};
+
+// The storage layout of the particles: 0 stores one Particle structure per particle in ParticleBuffer,
+// 1 stores each attribute in its own stream, and only the streams this scene uses are bound.
+uniform int particle_layout = 0;
+// Whether the velocity and color streams contain half floats.
+uniform bool half_precision = false;
+
+layout (std430, binding = 11) readonly buffer PositionStream
+{
+	float position_stream[]; // The positions (3 floats per particle).
+};
+
+layout (std430, binding = 13) readonly buffer ColorStream
+{
+	uint color_stream[]; // The colors (3 floats or 2 words of packed halves per particle).
+};
+
+layout (std430, binding = 14) readonly buffer LifetimeStream
+{
+	vec2 lifetime_stream[]; // The lifetime (x) and the remaining lifetime (y).
+};
+
+// The positions and the colors (3 tightly packed floats per particle) of the N-Body scene.
+layout (std430, binding = 0) readonly buffer PositionsBuffer
+{
+	vec4 particle_positions[];
+};
+layout (std430, binding = 15) readonly buffer ColorsBuffer
+{
+	float particle_colors[];
+};
+
+// The particles too small for a quad, found by particle_cull.comp.
+layout (std430, binding = 36) readonly buffer PointListBuffer
+{
+	uint point_list[];
+};
+
+// Whether the particles are read from the N-Body buffers instead of the particle layout.
+uniform bool nbody_positions = false;
+// Whether the points fade out with the remaining lifetime (the pulsating scene).
+uniform bool fade_by_lifetime = false;
+// Whether all points have the constant color (the surface estimator).
+uniform bool use_constant_color = false;
+uniform vec3 constant_color;
+
+// ----------------------------------------------------------------------------
+// Output Variables
+// ----------------------------------------------------------------------------
+out VertexData
+{
+	vec3 color;	       // The particle color.
+	float fade;        // The factor of the intensity.
+} out_data;
+
+vec4 load_position(int i)
+{
+	if (nbody_positions) return particle_positions[i];
+	if (particle_layout == 0) return particles[i].position;
+	return vec4(position_stream[3 * i], position_stream[3 * i + 1], position_stream[3 * i + 2], 1.0f);
+}
+
+vec3 load_color(int i)
+{
+	if (use_constant_color) return constant_color;
+	if (nbody_positions) return vec3(particle_colors[3 * i], particle_colors[3 * i + 1], particle_colors[3 * i + 2]);
+	if (particle_layout == 0) return particles[i].color;
+	if (half_precision) return vec3(unpackHalf2x16(color_stream[2 * i]), unpackHalf2x16(color_stream[2 * i + 1]).x);
+	return uintBitsToFloat(uvec3(color_stream[3 * i], color_stream[3 * i + 1], color_stream[3 * i + 2]));
+}
+
+float load_fade(int i)
+{
+	if (!fade_by_lifetime) return 1.0f;
+	vec2 lifetime = (particle_layout == 0) ? vec2(particles[i].lifetime, particles[i].remaining) : lifetime_stream[i];
+	return lifetime.y / lifetime.x;
+}
+
+// ----------------------------------------------------------------------------
+// Main Method
+// ----------------------------------------------------------------------------
+void main()
+{
+	// One pixel per distant particle instead of a textured quad.
+	int particle = int(point_list[gl_VertexID]);
+	gl_Position = projection * view * load_position(particle);
+	out_data.color = load_color(particle);
+	out_data.fade = load_fade(particle);
+}
@@ -0,0 +1,56 @@
+#version 450 core
+
+// ----------------------------------------------------------------------------
+// Input Variables
+// ----------------------------------------------------------------------------
+in VertexData
+{
+	vec2 tex_coord;    // The texture coordinates of the screen.
+} in_data;
+
+// The particles drawn at the reduced resolution (premultiplied colors over transparent black).
+layout (binding = 0) uniform sampler2D particle_color;
+
+// The difference of the colors at which the weights of the taps fall off, relative to the brightness of the reference.
+uniform float range_sigma = 0.25f;
+
+// ----------------------------------------------------------------------------
+// Output Variables
+// ----------------------------------------------------------------------------
+// The final fragment color.
+layout (location = 0) out vec4 final_color;
+
+// ----------------------------------------------------------------------------
+// Main Method
+// ----------------------------------------------------------------------------
+void main()
+{
+	ivec2 size = textureSize(particle_color, 0);
+	vec2 position = in_data.tex_coord * vec2(size) - 0.5f;
+	ivec2 base = ivec2(floor(position));
+	vec2 f = fract(position);
+
+	// A bilateral upsample: the bilinear weights of the four nearest texels are scaled down by how much each differs
+	// from the nearest one, so the edges of bright sprites against the background stay sharp instead of smearing.
+	vec4 reference = texelFetch(particle_color, clamp(ivec2(round(position)), ivec2(0), size - 1), 0);
+	float scale = 1.0f / (range_sigma * max(max(reference.r, max(reference.g, reference.b)), 0.05f));
+
+	vec4 sum = vec4(0.0f);
+	float weight_sum = 0.0f;
+	for (int y = 0; y < 2; y++)
+	{
+		for (int x = 0; x < 2; x++)
+		{
+			vec4 value = texelFetch(particle_color, clamp(base + ivec2(x, y), ivec2(0), size - 1), 0);
+			float bilinear = ((x == 0) ? 1.0f - f.x : f.x) * ((y == 0) ? 1.0f - f.y : f.y);
+			vec3 difference = (value.rgb - reference.rgb) * scale;
+			float weight = bilinear * exp(-0.5f * dot(difference, difference)) + 1e-5f;
+			sum += weight * value;
+			weight_sum += weight;
+		}
+	}
+
+	// The additive particles can sum to an alpha above one, which still means full coverage.
+	final_color = sum / weight_sum;
+	final_color.a = clamp(final_color.a, 0.0f, 1.0f);
+}
@@ -13,6 +13,8 @@ in VertexData
 
 // The particle texture.
 layout (binding = 0) uniform sampler2D particle_texture;
+// The opacity of the alpha-blended smoke (1 with the additive star).
+uniform float opacity = 1.0f;
 
 // ----------------------------------------------------------------------------
 // Output Variables
@@ -28,6 +30,8 @@ void main()
 	// TASK 4: Use the intensity from the texture to modify color and opacity of the frament.
 	//  Hints: Note that the texture contains only shades of gray.
 	//         The color of the particle is defined in in_data.color
-	float intensity = texture(particle_texture, in_data.tex_coord).r * (in_data.remaining / in_data.lifetime);
+	// The brightest channel, the smoke texture is tinted unlike the gray star.
+	vec4 texel = texture(particle_texture, in_data.tex_coord);
+	float intensity = max(max(texel.r, texel.g), texel.b) * opacity * (in_data.remaining / in_data.lifetime);
 	final_color = vec4(in_data.color * intensity, intensity);
 }
\ No newline at end of file
@@ -15,9 +15,6 @@ layout (std140, binding = 0) uniform CameraBuffer
 	vec3 eye_position;		// The position of the eye in world space.
 };
 
-uniform float t_time;	// Time current time.
-uniform float t_delta;	// The time delta.
-
 struct Particle {
 	vec4 position;	// The position of the particle.
 	vec3 velocity;	// The velocity of the particle.
@@ -26,27 +23,55 @@ struct Particle {
 	float remaining; // The remaining lifetime of the particle.
 };
 
-layout (std430, binding = 3) buffer ParticleBuffer
+layout (std430, binding = 3) readonly buffer ParticleBuffer
 {
 	Particle particles[]; // The array with particles.
 };
 
-// Function to generate a random number based on input (simple hash function)
-float random(float p)
+// The storage layout of the particles: 0 stores one Particle structure per particle in ParticleBuffer,
+// 1 stores each attribute in its own stream, and only the streams this scene uses are bound.
+uniform int particle_layout = 0;
+// Whether the velocity and color streams contain half floats.
+uniform bool half_precision = false;
+
+layout (std430, binding = 11) readonly buffer PositionStream
+{
+	float position_stream[]; // The positions (3 floats per particle).
+};
+
+layout (std430, binding = 13) readonly buffer ColorStream
+{
+	uint color_stream[]; // The colors (3 floats or 2 words of packed halves per particle).
+};
+
+layout (std430, binding = 14) readonly buffer LifetimeStream
+{
+	vec2 lifetime_stream[]; // The lifetime (x) and the remaining lifetime (y).
+};
+
+// The indices of the live particles written by particle_compact.comp, only those are drawn.
+layout (std430, binding = 16) readonly buffer AliveListBuffer
+{
+	uint alive_list[];
+};
+
+vec4 load_position(int i)
 {
-    p = fract(p * .1031);
-    p *= p + 33.33;
-    p *= p + p;
-    return fract(p);
+	if (particle_layout == 0) return particles[i].position;
+	return vec4(position_stream[3 * i], position_stream[3 * i + 1], position_stream[3 * i + 2], 1.0f);
 }
 
-vec3 random_direction(float min, float max)
+vec3 load_color(int i)
 {
-    return vec3(
-        random(gl_VertexID + 1) * (max - min) + min, // X component
-        random(gl_VertexID + 2) * (max - min) + min, // Y component
-        random(gl_VertexID + 3) * (max - min) + min  // Z component
-    );
+	if (particle_layout == 0) return particles[i].color;
+	if (half_precision) return vec3(unpackHalf2x16(color_stream[2 * i]), unpackHalf2x16(color_stream[2 * i + 1]).x);
+	return uintBitsToFloat(uvec3(color_stream[3 * i], color_stream[3 * i + 1], color_stream[3 * i + 2]));
+}
+
+vec2 load_lifetime(int i)
+{
+	if (particle_layout == 0) return vec2(particles[i].lifetime, particles[i].remaining);
+	return lifetime_stream[i];
 }
 
 // ----------------------------------------------------------------------------
@@ -58,49 +83,23 @@ out VertexData
 	vec4 position_vs;  // The particle position in view space.
 	float lifetime;    // The lifetime of the particle.
 	float remaining;   // The remaining lifetime of the particle.
+	flat int id;       // The index of the particle.
 } out_data;
 
-
 // ----------------------------------------------------------------------------
 // Main Method
 // ----------------------------------------------------------------------------
 void main()
 {
-	Particle particle = particles[gl_VertexID];
-
-	float rv = random(gl_VertexID + t_time * 0.001);
-	float gv = random(gl_VertexID + t_time * 0.001 + 1);
-	float bv = random(gl_VertexID + t_time * 0.001 + 2);
-
-	vec3 color = vec3(rv, gv, bv);
-
-    if(particle.remaining < 0) {
-		vec3 rand_dir = random_direction(-1,1);
-		rand_dir = normalize(rand_dir);
-
-		// Random inside sphere
-		float radius = (random(gl_VertexID + 1) * (2.5f - 1.5f) + 1.5f) * sin(t_time  * 0.0001) + (random(gl_VertexID + 3) * (7.5f - 5.5f) + 5.5f);
-		particle.position = vec4(vec3(0.0f) + rand_dir * radius, 1);
-
-		particle.velocity = rand_dir * 3;
-
-		particle.color = color;
-
-		particle.lifetime =  random(gl_VertexID + t_delta * 0.001) * (5 - 0.5) + 0.5;
-		particle.remaining = particle.lifetime;
-	}
-
-	particle.remaining -= t_delta;
-
-	// Update the particle's position based on its velocity
-	particle.position += vec4(particle.velocity, 0) * t_delta;
-
-    // Set the particle's position back into the buffer
-    particles[gl_VertexID] = particle;
+	// The particles are simulated in pulsating_particle.comp, they are only read here.
+	int id = int(alive_list[gl_VertexID]);
+	vec4 position = load_position(id);
+	vec2 lifetime = load_lifetime(id);
 
     // Output gl_Position for the current particle
-	out_data.color = particle.color;
-    out_data.position_vs = view * particle.position;
-	out_data.lifetime = particle.lifetime;
-	out_data.remaining = particle.remaining;
+	out_data.color = load_color(id);
+    out_data.position_vs = view * position;
+	out_data.lifetime = lifetime.x;
+	out_data.remaining = lifetime.y;
+	out_data.id = id;
 }
\ No newline at end of file
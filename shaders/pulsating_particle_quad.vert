@@ -0,0 +1,169 @@
+#version 450 core
+
+// ----------------------------------------------------------------------------
+// Local Variables
+// ----------------------------------------------------------------------------
+// The texture coorinates of the quad corners, in the order of the geometry shader's triangle strip.
+const vec2 quad_tex_coords[4] = vec2[4](
+	vec2(0.0, 1.0),
+	vec2(0.0, 0.0),
+	vec2(1.0, 1.0),
+	vec2(1.0, 0.0)
+);
+// The position offsets of the quad corners.
+const vec2 quad_offsets[4] = vec2[4](
+	vec2(-0.5, +0.5),
+	vec2(-0.5, -0.5),
+	vec2(+0.5, +0.5),
+	vec2(+0.5, -0.5)
+);
+// The corners of the two triangles of the quad, the same as the triangles of the strip.
+const int quad_corners[6] = int[6](0, 1, 2, 2, 1, 3);
+
+// ----------------------------------------------------------------------------
+// Input Variables
+// ----------------------------------------------------------------------------
+
+// The UBO with camera data.	
+layout (std140, binding = 0) uniform CameraBuffer
+{
+	mat4 projection;		// The projection matrix.
+	mat4 projection_inv;	// The inverse of the projection matrix.
+	mat4 view;				// The view matrix
+	mat4 view_inv;			// The inverse of the view matrix.
+	mat3 view_it;			// The inverse of the transpose of the top-left part 3x3 of the view matrix
+	vec3 eye_position;		// The position of the eye in world space.
+};
+
+struct Particle {
+	vec4 position;	// The position of the particle.
+	vec3 velocity;	// The velocity of the particle.
+	float lifetime; // The lifetime of the particle.
+	vec3 color;		// The color of the particle.
+	float remaining; // The remaining lifetime of the particle.
+};
+
+layout (std430, binding = 3) readonly buffer ParticleBuffer
+{
+	Particle particles[]; // The array with particles.
+};
+
+// The storage layout of the particles: 0 stores one Particle structure per particle in ParticleBuffer,
+// 1 stores each attribute in its own stream, and only the streams this scene uses are bound.
+uniform int particle_layout = 0;
+// Whether the velocity and color streams contain half floats.
+uniform bool half_precision = false;
+
+layout (std430, binding = 11) readonly buffer PositionStream
+{
+	float position_stream[]; // The positions (3 floats per particle).
+};
+
+layout (std430, binding = 13) readonly buffer ColorStream
+{
+	uint color_stream[]; // The colors (3 floats or 2 words of packed halves per particle).
+};
+
+layout (std430, binding = 14) readonly buffer LifetimeStream
+{
+	vec2 lifetime_stream[]; // The lifetime (x) and the remaining lifetime (y).
+};
+
+// The indices of the live particles written by particle_compact.comp, only those are drawn.
+layout (std430, binding = 16) readonly buffer AliveListBuffer
+{
+	uint alive_list[];
+};
+
+vec4 load_position(int i)
+{
+	if (particle_layout == 0) return particles[i].position;
+	return vec4(position_stream[3 * i], position_stream[3 * i + 1], position_stream[3 * i + 2], 1.0f);
+}
+
+vec3 load_color(int i)
+{
+	if (particle_layout == 0) return particles[i].color;
+	if (half_precision) return vec3(unpackHalf2x16(color_stream[2 * i]), unpackHalf2x16(color_stream[2 * i + 1]).x);
+	return uintBitsToFloat(uvec3(color_stream[3 * i], color_stream[3 * i + 1], color_stream[3 * i + 2]));
+}
+
+vec2 load_lifetime(int i)
+{
+	if (particle_layout == 0) return vec2(particles[i].lifetime, particles[i].remaining);
+	return lifetime_stream[i];
+}
+
+// The size of a particle in view space.
+uniform float particle_size_vs;
+uniform float t_time;
+uniform int random_seed; // The seed of the counter-based random numbers.
+// Whether the quads are drawn as instances (one per particle) or pulled from gl_VertexID (six vertices per particle).
+uniform bool instanced = false;
+
+// ----------------------------------------------------------------------------
+// Output Variables
+// ----------------------------------------------------------------------------
+out VertexData
+{
+	vec3 color;	       // The particle color.
+	vec2 tex_coord;    // The texture coordinates for the particle.
+	float lifetime;    // The lifetime of the particle.
+	float remaining;   // The remaining lifetime of the particle.
+} out_data;
+
+const uint RANDOM_STREAM_ROTATION = 6u;
+
+// The counter-based generator, this must be the same as CounterRng in counter_rng.hpp.
+uvec4 pcg4d(uvec4 v)
+{
+	v = v * 1664525u + 1013904223u;
+	v.x += v.y * v.w; v.y += v.z * v.x; v.z += v.x * v.y; v.w += v.y * v.z;
+	v ^= v >> 16u;
+	v.x += v.y * v.w; v.y += v.z * v.x; v.z += v.x * v.y; v.w += v.y * v.z;
+	return v;
+}
+
+// Returns four uniform numbers in [0, 1) for the particle, the stream and the counter (exactly the same as on the CPU).
+vec4 random_uniform(int index, uint stream, uint counter)
+{
+	return vec4(pcg4d(uvec4(uint(index), counter, stream, uint(random_seed))) >> 8u) * (1.0 / 16777216.0);
+}
+
+float get_random_angle(int particleID, float time) {
+    float initialAngle = random_uniform(particleID, RANDOM_STREAM_ROTATION, 0u).x * 6.28318530718; // Random initial angle
+    float rotationAngle = time * 0.0005f; // Continuous rotation over time
+    return initialAngle + rotationAngle; // Combine initial and continuous rotation
+}
+
+// Rotates the corner offset the same way as the rotation matrix in the geometry shader, without building it.
+vec2 rotate(vec2 offset, float angle)
+{
+	float c = cos(angle);
+	float s = sin(angle);
+	return vec2(c * offset.x + s * offset.y, -s * offset.x + c * offset.y);
+}
+
+// ----------------------------------------------------------------------------
+// Main Method
+// ----------------------------------------------------------------------------
+void main()
+{
+	// The quad of each particle replaces the points expanded by pulsating_particle.geom.
+	int particle = int(alive_list[instanced ? gl_InstanceID : gl_VertexID / 6]);
+	int corner = quad_corners[instanced ? gl_VertexID : gl_VertexID % 6];
+
+	vec4 position_vs = view * load_position(particle);
+	vec2 lifetime = load_lifetime(particle);
+
+	// Scales the quad by the remaining lifetime.
+	float scale = lifetime.y / lifetime.x;
+
+	vec2 offset = rotate(quad_offsets[corner], get_random_angle(particle, t_time));
+	gl_Position = projection * (position_vs + vec4(particle_size_vs * offset * scale, 0.0f, 0.0f));
+
+	out_data.color = load_color(particle);
+	out_data.tex_coord = quad_tex_coords[corner];
+	out_data.lifetime = lifetime.x;
+	out_data.remaining = lifetime.y;
+}
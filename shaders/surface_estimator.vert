@@ -15,12 +15,6 @@ layout (std140, binding = 0) uniform CameraBuffer
 	vec3 eye_position;		// The position of the eye in world space.
 };
 
-uniform float t_time;	// Time current time.
-uniform float t_delta;	// The time delta.
-uniform int vertex_count; // The vertex count.
-uniform int index_count; // The index count.
-uniform float attractor_force = 9.81; // The attractor force.
-
 struct Particle {
 	vec4 position;	// The position of the particle.
 	vec3 velocity;	// The velocity of the particle.
@@ -29,55 +23,26 @@ struct Particle {
 	float remaining; // The remaining lifetime of the particle.
 };
 
-layout (std430, binding = 3) buffer ParticleBuffer
+layout (std430, binding = 3) readonly buffer ParticleBuffer
 {
 	Particle particles[]; // The array with particles.
 };
 
-layout (std430, binding = 4) readonly buffer MeshPositionBuffer
-{
-	vec4 positions[]; // The array with positions.
-};
+// The storage layout of the particles: 0 stores one Particle structure per particle in ParticleBuffer,
+// 1 stores each attribute in its own stream, and only the streams this scene uses are bound.
+uniform int particle_layout = 0;
+// Whether the velocity and color streams contain half floats.
+uniform bool half_precision = false;
 
-layout (std430, binding = 5) readonly buffer MeshIndexBuffer
+layout (std430, binding = 11) readonly buffer PositionStream
 {
-	int indices[]; // The array with indices.
+	float position_stream[]; // The positions (3 floats per particle).
 };
 
-// Function to generate a random number based on input (simple hash function)
-float random(float p)
+vec4 load_position(int i)
 {
-    p = fract(p * .1031);
-    p *= p + 33.33;
-    p *= p + p;
-    return fract(p);
-}
-
-vec3 random_inside_triangle(vec3 a, vec3 b, vec3 c, float s1, float s2) {
-    // Generate two random numbers using the random function
-    float r1 = sqrt(random(s1));
-    float r2 = random(s2);
-
-    // Barycentric Coordinate Interpolation of the random point
-    return (1.0 - r1) * a + (r1 * (1.0 - r2)) * b + (r1 * r2) * c;
-}
-
-vec3 get_random_position_on_triangle(int vertexID) {
-
-    // Calculate the triangle index
-    int triangle_idx = int(random(vertexID) * (index_count / 3));
-
-    // Get the positions of the three vertices of the triangle
-    vec3 a = positions[indices[triangle_idx * 3]].xyz;
-    vec3 b = positions[indices[triangle_idx * 3 + 1]].xyz;
-    vec3 c = positions[indices[triangle_idx * 3 + 2]].xyz;
-
-    // Generate random numbers for random point inside the triangle
-    float s1 = float(vertexID) + 1.0;
-    float s2 = float(vertexID) + 2.0;
-
-    // Get a random point inside the triangle
-    return random_inside_triangle(a, b, c, s1, s2);
+	if (particle_layout == 0) return particles[i].position;
+	return vec4(position_stream[3 * i], position_stream[3 * i + 1], position_stream[3 * i + 2], 1.0f);
 }
 
 // ----------------------------------------------------------------------------
@@ -89,32 +54,16 @@ out VertexData
 	vec4 position_vs;  // The particle position in view space.
 } out_data;
 
-
 // ----------------------------------------------------------------------------
 // Main Method
 // ----------------------------------------------------------------------------
 void main()
 {
-	Particle particle = particles[gl_VertexID];
+	// The particles are simulated in surface_estimator.comp, they are only read here.
+	vec4 position = load_position(gl_VertexID);
 	vec3 color = vec3(250 / 255.f, 202 / 255.f, 0.f);
 
-	vec3 random_dest = get_random_position_on_triangle(gl_VertexID);
-
-	if (length(particle.position.xyz - random_dest.xyz) > 0.05f)
-	{
-		vec3 dir_to_attractor = normalize(random_dest.xyz - particle.position.xyz) * attractor_force;
-		
-		particle.position += vec4(particle.velocity, 0) * t_delta + 0.5f * vec4(dir_to_attractor, 0) * t_delta * t_delta;
-		particle.velocity += dir_to_attractor * t_delta;
-	} else {
-		particle.position = vec4(random_dest, 1.0f);
-		particle.velocity = vec3(0);
-	}
-
-    // Set the particle's position back into the buffer
-    particles[gl_VertexID] = particle;
-
     // Output gl_Position for the current particle
 	out_data.color = color;
-    out_data.position_vs = view * particle.position;
+    out_data.position_vs = view * position;
 }
\ No newline at end of file
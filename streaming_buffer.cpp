@@ -0,0 +1,91 @@
+#include "streaming_buffer.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+	// The alignment of each upload within a segment.
+	const size_t ALIGNMENT = 16;
+}
+
+StreamingBuffer::StreamingBuffer(size_t segment_size, int segment_count)
+	: segment_size(segment_size), segment_fences(segment_count, nullptr) {
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	const size_t size = segment_size * segment_count;
+
+	glCreateBuffers(1, &staging_buffer);
+	glNamedBufferStorage(staging_buffer, size, nullptr, flags);
+	mapped_data = static_cast<char*>(glMapNamedBufferRange(staging_buffer, 0, size, flags));
+}
+
+StreamingBuffer::~StreamingBuffer() {
+	// The current segment has no fence until it is left.
+	if (segment_used > 0) {
+		segment_fences[current_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	for (int segment = 0; segment < static_cast<int>(segment_fences.size()); segment++) {
+		wait_for_segment(segment);
+	}
+	glUnmapNamedBuffer(staging_buffer);
+	glDeleteBuffers(1, &staging_buffer);
+}
+
+void StreamingBuffer::upload(GLuint destination, size_t offset, const void* data, size_t size) {
+	PROFILE_SCOPE("Staging Upload");
+	const char* source = static_cast<const char*>(data);
+
+	while (size > 0) {
+		// The uploads start aligned, the rest of a full segment is left unused.
+		segment_used = (segment_used + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+		if (segment_used >= segment_size) {
+			next_segment();
+		}
+
+		const size_t part_size = std::min(size, segment_size - segment_used);
+		const size_t segment_offset = current_segment * segment_size + segment_used;
+
+		// The coherent mapping makes the written data visible to the copy without any flush.
+		std::memcpy(mapped_data + segment_offset, source, part_size);
+		glCopyNamedBufferSubData(staging_buffer, destination, segment_offset, offset, part_size);
+
+		segment_used += part_size;
+		source += part_size;
+		offset += part_size;
+		size -= part_size;
+		uploaded_bytes += part_size;
+	}
+}
+
+void StreamingBuffer::next_segment() {
+	segment_fences[current_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	current_segment = (current_segment + 1) % static_cast<int>(segment_fences.size());
+	segment_used = 0;
+	wait_for_segment(current_segment);
+}
+
+void StreamingBuffer::reset_statistics() {
+	uploaded_bytes = 0;
+	wait_time = 0.0f;
+}
+
+void StreamingBuffer::wait_for_segment(int segment) {
+	GLsync& fence = segment_fences[segment];
+	if (fence == nullptr) return;
+
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	// The first wait flushes the commands so that the fence is guaranteed to signal.
+	GLbitfield wait_flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	while (true) {
+		const GLenum result = glClientWaitSync(fence, wait_flags, 1000000);
+		if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED) break;
+		wait_flags = 0;
+	}
+
+	const auto end = std::chrono::high_resolution_clock::now();
+	wait_time += std::chrono::duration<float, std::milli>(end - start).count();
+
+	glDeleteSync(fence);
+	fence = nullptr;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Uploads data into GPU buffers through a persistently mapped ring of staging segments.
+ *
+ * The staging buffer has immutable storage that stays mapped (coherent) for its whole life, so no upload allocates
+ * or maps anything. The uploads are packed one after another into the current segment and copied from there into the
+ * destination buffers by the GPU. A segment gets one fence when it is full (after all copies from it), and the CPU only
+ * waits when it is about to reuse a segment the GPU has not copied from yet. Many small uploads thus share a segment,
+ * and uploads of any size need no more staging memory than the ring and never stall the whole pipeline.
+ */
+class StreamingBuffer {
+public:
+	/** Creates the ring with the given number of segments of the given size (in bytes). */
+	explicit StreamingBuffer(size_t segment_size = 8 << 20, int segment_count = 3);
+
+	/** Waits for the pending copies, unmaps and deletes the staging buffer. */
+	~StreamingBuffer();
+
+	StreamingBuffer(const StreamingBuffer&) = delete;
+	StreamingBuffer& operator=(const StreamingBuffer&) = delete;
+
+	/** Copies the data into the destination buffer at the given offset (all in bytes), split into segment-sized parts. */
+	void upload(GLuint destination, size_t offset, const void* data, size_t size);
+
+	/** Returns the number of bytes uploaded since the last reset of the statistics. */
+	size_t get_uploaded_bytes() const { return uploaded_bytes; }
+
+	/** Returns the time the CPU spent waiting for free segments since the last reset of the statistics (in milliseconds). */
+	float get_wait_time() const { return wait_time; }
+
+	/** Resets the upload statistics. */
+	void reset_statistics();
+
+protected:
+	/** Waits until the GPU is done copying from the segment. */
+	void wait_for_segment(int segment);
+
+	/** Fences the copies from the current segment and moves on to the next one, once it is free. */
+	void next_segment();
+
+protected:
+	GLuint staging_buffer = 0;
+	char* mapped_data = nullptr;
+	size_t segment_size;
+
+	// The fence after the last copy from each segment (or null if there is none).
+	std::vector<GLsync> segment_fences;
+	int current_segment = 0;
+	size_t segment_used = 0; // The bytes of the current segment already used by earlier uploads.
+
+	size_t uploaded_bytes = 0;
+	float wait_time = 0.0f;
+};
@@ -0,0 +1,200 @@
+#include "trajectory_writer.hpp"
+#include <chrono>
+#include <cstring>
+
+namespace {
+	void write_varint(std::vector<uint8_t>& output, size_t value) {
+		while (value >= 0x80) {
+			output.push_back(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		output.push_back(static_cast<uint8_t>(value));
+	}
+
+	bool read_varint(const uint8_t*& data, const uint8_t* end, size_t& value) {
+		value = 0;
+		for (int shift = 0; data < end && shift < 64; shift += 7) {
+			const uint8_t byte = *data++;
+			value |= static_cast<size_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0) return true;
+		}
+		return false;
+	}
+}
+
+TrajectoryWriter::TrajectoryWriter(const std::filesystem::path& path, uint32_t scene, uint32_t particle_count, uint32_t components, float step_duration,
+	uint32_t snapshot_interval, uint32_t keyframe_interval)
+	: stream(path, std::ios::binary | std::ios::trunc), snapshot_size(static_cast<size_t>(particle_count) * components), keyframe_interval(keyframe_interval) {
+	TrajectoryHeader header;
+	std::memcpy(header.magic, "PTRJ", 4);
+	header.version = 1;
+	header.scene = scene;
+	header.particle_count = particle_count;
+	header.components = components;
+	header.step_duration = step_duration;
+	header.snapshot_interval = snapshot_interval;
+	header.keyframe_interval = keyframe_interval;
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(TrajectoryHeader));
+	written_bytes = sizeof(TrajectoryHeader);
+
+	staging[0].resize(snapshot_size);
+	staging[1].resize(snapshot_size);
+	worker = std::thread(&TrajectoryWriter::worker_loop, this);
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	snapshot_ready.notify_one();
+	worker.join();
+}
+
+float* TrajectoryWriter::begin_snapshot() {
+	const auto start = std::chrono::high_resolution_clock::now();
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		snapshot_written.wait(lock, [&] { return !staging_full[fill_index]; });
+	}
+	const auto end = std::chrono::high_resolution_clock::now();
+	wait_time += std::chrono::duration<float, std::milli>(end - start).count();
+	return staging[fill_index].data();
+}
+
+void TrajectoryWriter::end_snapshot(uint64_t step) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		staging_full[fill_index] = true;
+		staging_step[fill_index] = step;
+	}
+	snapshot_ready.notify_one();
+	raw_bytes += sizeof(float) * snapshot_size;
+	fill_index ^= 1;
+}
+
+uint64_t TrajectoryWriter::get_written_bytes() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return written_bytes;
+}
+
+void TrajectoryWriter::worker_loop() {
+	// The previous snapshot, the reference of the next one unless it is a keyframe.
+	std::vector<uint32_t> previous(snapshot_size, 0u);
+	std::vector<uint8_t> compressed;
+	uint64_t snapshot_index = 0;
+	int write_index = 0;
+
+	while (true) {
+		uint64_t step;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			snapshot_ready.wait(lock, [&] { return stopping || staging_full[write_index]; });
+			// The pending snapshots are written before stopping.
+			if (!staging_full[write_index]) return;
+			step = staging_step[write_index];
+		}
+
+		const uint32_t* words = reinterpret_cast<const uint32_t*>(staging[write_index].data());
+		const bool keyframe = keyframe_interval == 0 || snapshot_index % keyframe_interval == 0;
+		compress(words, keyframe ? nullptr : previous.data(), snapshot_size, compressed);
+		std::memcpy(previous.data(), words, sizeof(uint32_t) * snapshot_size);
+
+		TrajectoryChunkHeader chunk;
+		chunk.step = step;
+		chunk.compressed_size = static_cast<uint32_t>(compressed.size());
+		chunk.keyframe = keyframe ? 1u : 0u;
+		stream.write(reinterpret_cast<const char*>(&chunk), sizeof(TrajectoryChunkHeader));
+		stream.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			staging_full[write_index] = false;
+			written_bytes += sizeof(TrajectoryChunkHeader) + compressed.size();
+		}
+		snapshot_written.notify_one();
+		write_index ^= 1;
+		snapshot_index++;
+	}
+}
+
+void TrajectoryWriter::compress(const uint32_t* words, const uint32_t* reference, size_t count, std::vector<uint8_t>& output) {
+	// Splits the (XORed) words into byte planes, the sign and exponent bytes of similar floats become runs of zeros.
+	std::vector<uint8_t> planes(4 * count);
+	for (size_t i = 0; i < count; i++) {
+		const uint32_t word = reference ? words[i] ^ reference[i] : words[i];
+		planes[i] = static_cast<uint8_t>(word);
+		planes[count + i] = static_cast<uint8_t>(word >> 8);
+		planes[2 * count + i] = static_cast<uint8_t>(word >> 16);
+		planes[3 * count + i] = static_cast<uint8_t>(word >> 24);
+	}
+
+	// Alternates the lengths of literal bytes and of zero runs (of at least two bytes).
+	output.clear();
+	size_t position = 0;
+	while (position < planes.size()) {
+		const size_t literal_start = position;
+		while (position < planes.size() && !(planes[position] == 0 && position + 1 < planes.size() && planes[position + 1] == 0)) {
+			position++;
+		}
+		write_varint(output, position - literal_start);
+		output.insert(output.end(), planes.begin() + literal_start, planes.begin() + position);
+
+		const size_t zero_start = position;
+		while (position < planes.size() && planes[position] == 0) {
+			position++;
+		}
+		write_varint(output, position - zero_start);
+	}
+}
+
+bool TrajectoryWriter::decompress(const uint8_t* data, size_t size, const uint32_t* reference, size_t count, uint32_t* words) {
+	std::vector<uint8_t> planes(4 * count);
+	const uint8_t* end = data + size;
+	size_t position = 0;
+	while (position < planes.size()) {
+		size_t literal_count, zero_count;
+		if (!read_varint(data, end, literal_count) || literal_count > planes.size() - position || literal_count > static_cast<size_t>(end - data)) return false;
+		std::memcpy(planes.data() + position, data, literal_count);
+		data += literal_count;
+		position += literal_count;
+
+		if (!read_varint(data, end, zero_count) || zero_count > planes.size() - position) return false;
+		position += zero_count;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		const uint32_t word = planes[i] | (planes[count + i] << 8) | (planes[2 * count + i] << 16) | (static_cast<uint32_t>(planes[3 * count + i]) << 24);
+		words[i] = reference ? word ^ reference[i] : word;
+	}
+	return true;
+}
+
+TrajectoryReader::TrajectoryReader(const std::filesystem::path& path) : stream(path, std::ios::binary) {
+	stream.read(reinterpret_cast<char*>(&header), sizeof(TrajectoryHeader));
+	if (!stream || std::memcmp(header.magic, "PTRJ", 4) != 0 || header.version != 1) return;
+
+	snapshot_size = static_cast<size_t>(header.particle_count) * header.components;
+	previous.assign(snapshot_size, 0u);
+	valid = true;
+}
+
+bool TrajectoryReader::read_snapshot(uint64_t& step, std::vector<float>& snapshot) {
+	if (!valid) return false;
+
+	TrajectoryChunkHeader chunk;
+	stream.read(reinterpret_cast<char*>(&chunk), sizeof(TrajectoryChunkHeader));
+	if (!stream) return false;
+
+	compressed.resize(chunk.compressed_size);
+	stream.read(reinterpret_cast<char*>(compressed.data()), chunk.compressed_size);
+	if (!stream) return false;
+
+	snapshot.resize(snapshot_size);
+	uint32_t* words = reinterpret_cast<uint32_t*>(snapshot.data());
+	if (!TrajectoryWriter::decompress(compressed.data(), compressed.size(), chunk.keyframe ? nullptr : previous.data(), snapshot_size, words)) return false;
+
+	std::memcpy(previous.data(), words, sizeof(uint32_t) * snapshot_size);
+	step = chunk.step;
+	return true;
+}
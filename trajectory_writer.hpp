@@ -0,0 +1,127 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** The header at the start of a trajectory file. */
+struct TrajectoryHeader {
+	char magic[4]; // "PTRJ"
+	uint32_t version;
+	uint32_t scene; // The scene (DISPLAY_* in application.hpp).
+	uint32_t particle_count;
+	uint32_t components; // The number of floats per particle in each snapshot.
+	float step_duration; // The duration of one step in milliseconds.
+	uint32_t snapshot_interval; // The number of steps between the snapshots.
+	uint32_t keyframe_interval; // The number of snapshots between the snapshots encoded without the previous one.
+};
+
+/** The header of each chunk (one snapshot) in a trajectory file, followed by the compressed data. */
+struct TrajectoryChunkHeader {
+	uint64_t step; // The step after which the snapshot was taken.
+	uint32_t compressed_size; // The size of the compressed data in bytes.
+	uint32_t keyframe; // 1 if the snapshot is encoded on its own, 0 if it is encoded relative to the previous snapshot.
+};
+
+/**
+ * Streams snapshots of the particles into a chunked, compressed trajectory file on a background thread.
+ *
+ * The snapshots are filled into one of two staging buffers while the other one is compressed and written, so the
+ * simulation only waits if the disk falls a whole snapshot behind. Each snapshot is stored as one chunk: its words are
+ * XORed with the previous snapshot (except for the keyframes), split into byte planes and the runs of zero bytes
+ * are removed, which suits the slowly changing floats of a trajectory.
+ */
+class TrajectoryWriter {
+public:
+	/** Creates the file and starts the I/O thread, see TrajectoryHeader for the parameters. */
+	TrajectoryWriter(const std::filesystem::path& path, uint32_t scene, uint32_t particle_count, uint32_t components, float step_duration,
+		uint32_t snapshot_interval, uint32_t keyframe_interval = 16);
+
+	/** Writes the pending snapshots, stops the I/O thread and closes the file. */
+	~TrajectoryWriter();
+
+	TrajectoryWriter(const TrajectoryWriter&) = delete;
+	TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+	/** Returns whether the file was created. */
+	bool is_open() const { return stream.is_open(); }
+
+	/** Returns the staging buffer to fill with the next snapshot (particle_count * components floats), waits if both are still being written. */
+	float* begin_snapshot();
+
+	/** Hands the filled staging buffer over to the I/O thread. */
+	void end_snapshot(uint64_t step);
+
+	/** Returns the number of bytes of the snapshots before compression. */
+	uint64_t get_raw_bytes() const { return raw_bytes; }
+
+	/** Returns the number of bytes written into the file (after all written snapshots). */
+	uint64_t get_written_bytes() const;
+
+	/** Returns the time spent waiting for a free staging buffer in milliseconds. */
+	float get_wait_time() const { return wait_time; }
+
+	/** Compresses the words, XORed with the reference words if there are any (otherwise nullptr). */
+	static void compress(const uint32_t* words, const uint32_t* reference, size_t count, std::vector<uint8_t>& output);
+
+	/** Decompresses the words compressed by compress with the same reference, returns false if the data is malformed. */
+	static bool decompress(const uint8_t* data, size_t size, const uint32_t* reference, size_t count, uint32_t* words);
+
+protected:
+	/** The loop of the I/O thread. */
+	void worker_loop();
+
+protected:
+	std::ofstream stream;
+	size_t snapshot_size; // The number of floats in one snapshot.
+	uint32_t keyframe_interval;
+
+	// The double-buffered snapshots, a full buffer belongs to the I/O thread until it is written.
+	std::vector<float> staging[2];
+	bool staging_full[2] = { false, false };
+	uint64_t staging_step[2] = { 0, 0 };
+	int fill_index = 0;
+
+	std::thread worker;
+	mutable std::mutex mutex;
+	std::condition_variable snapshot_ready;
+	std::condition_variable snapshot_written;
+	bool stopping = false;
+
+	uint64_t raw_bytes = 0;
+	uint64_t written_bytes = 0;
+	float wait_time = 0.0f;
+};
+
+/**
+ * Reads the snapshots of a trajectory file written by TrajectoryWriter, one chunk after another.
+ *
+ * The chunks that are not keyframes are decoded relative to the previous snapshot, so the snapshots must be read in order.
+ */
+class TrajectoryReader {
+public:
+	/** Opens the file and reads its header, see is_open. */
+	explicit TrajectoryReader(const std::filesystem::path& path);
+
+	/** Returns whether the file was opened and has a valid header. */
+	bool is_open() const { return valid; }
+
+	/** Returns the header of the file. */
+	const TrajectoryHeader& get_header() const { return header; }
+
+	/** Decodes the next snapshot (particle_count * components floats), returns false at the end of the file or if the chunk is malformed. */
+	bool read_snapshot(uint64_t& step, std::vector<float>& snapshot);
+
+protected:
+	std::ifstream stream;
+	TrajectoryHeader header{};
+	bool valid = false;
+
+	size_t snapshot_size = 0; // The number of floats in one snapshot.
+	std::vector<uint32_t> previous; // The previous snapshot, the reference of the chunks that are not keyframes.
+	std::vector<uint8_t> compressed;
+};